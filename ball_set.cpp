@@ -0,0 +1,67 @@
+#include "ball_set.h"
+#include "physics.h"
+
+// Padding lanes sit far outside the table so they never overlap anything
+const float padding_position = 1e6f;
+
+void BallSet::resize(int n) {
+    count = n;
+    int padded = (n + simd_width - 1) / simd_width * simd_width + simd_width;
+
+    x.assign(padded, padding_position);
+    z.assign(padded, padding_position);
+    vx.assign(padded, 0.0f);
+    vz.assign(padded, 0.0f);
+    wx.assign(padded, 0.0f);
+    wz.assign(padded, 0.0f);
+    radius.assign(padded, 0.0f);
+    activeMask.assign(padded / 64 + 1, 0);
+    sleepMask.assign(padded / 64 + 1, 0);
+    awakeCount = n;
+
+    y.assign(n, 0.0f);
+    mass.assign(n, 1.0f);
+    color.assign(n, glm::vec3(0, 0, 0));
+    island.assign(n, -1);
+}
+
+// Bits j .. j + 7 of a mask, which may straddle two words
+static uint32_t bits8(const std::vector<uint64_t>& mask, int j) {
+    uint64_t bits = mask[j >> 6] >> (j & 63);
+    if((j & 63) > 56) {
+        bits |= mask[(j >> 6) + 1] << (64 - (j & 63));
+    }
+    return uint32_t(bits & 0xff);
+}
+
+uint32_t BallSet::activeBits8(int j) const {
+    return bits8(activeMask, j);
+}
+
+uint32_t BallSet::sleepingBits8(int j) const {
+    return bits8(sleepMask, j);
+}
+
+Ball BallSet::get(int i) const {
+    Ball ball(radius[i], color[i].x, color[i].y, color[i].z, x[i], y[i], z[i]);
+    ball.mass = mass[i];
+    ball.velocity = glm::vec3(vx[i], 0, vz[i]);
+    ball.spin = glm::vec3(wx[i], 0, wz[i]);
+    ball.active = isActive(i);
+    return ball;
+}
+
+void BallSet::set(int i, const Ball& ball) {
+    x[i] = ball.position.x;
+    y[i] = ball.position.y;
+    z[i] = ball.position.z;
+    vx[i] = ball.velocity.x;
+    vz[i] = ball.velocity.z;
+    wx[i] = ball.spin.x;
+    wz[i] = ball.spin.z;
+    radius[i] = ball.radius;
+    mass[i] = ball.mass;
+    color[i] = ball.color;
+    setActive(i, ball.active);
+    setSleeping(i, false);
+}
@@ -0,0 +1,66 @@
+#ifndef BALL_SET_H
+#define BALL_SET_H
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+class Ball;
+
+// Widest collision kernel lane count, hot arrays are padded so a kernel can
+// always load this many floats past any valid index
+const int simd_width = 8;
+
+// Structure-of-arrays ball storage. The hot fields read by the collision and
+// integration loops live in their own arrays, the rest is kept apart so it
+// doesn't share cache lines with them.
+class BallSet {
+public:
+    int count = 0;
+
+    // hot
+    std::vector<float> x, z, vx, vz, radius;
+    std::vector<float> wx, wz; // rolling velocity, see motion.h
+    std::vector<uint64_t> activeMask; // bit i set when ball i is on the table
+    std::vector<uint64_t> sleepMask;  // bit i set when ball i is asleep, see World::sleepIslands()
+    int awakeCount = 0;
+
+    // cold
+    std::vector<float> y, mass;
+    std::vector<glm::vec3> color;
+    std::vector<int> island; // island of a sleeping ball, the index of one of its balls
+
+    void resize(int n);
+
+    bool isActive(int i) const {
+        return (activeMask[i >> 6] >> (i & 63)) & 1;
+    }
+
+    void setActive(int i, bool active) {
+        if(active) activeMask[i >> 6] |= uint64_t(1) << (i & 63);
+        else activeMask[i >> 6] &= ~(uint64_t(1) << (i & 63));
+    }
+
+    // A sleeping ball has zero velocity and spin and is skipped by World until
+    // something wakes it
+    bool isSleeping(int i) const {
+        return (sleepMask[i >> 6] >> (i & 63)) & 1;
+    }
+
+    void setSleeping(int i, bool sleeping) {
+        if(sleeping == isSleeping(i)) return;
+        if(sleeping) sleepMask[i >> 6] |= uint64_t(1) << (i & 63);
+        else sleepMask[i >> 6] &= ~(uint64_t(1) << (i & 63));
+        awakeCount += sleeping ? -1 : 1;
+    }
+
+    // Active bits of balls j .. j + 7
+    uint32_t activeBits8(int j) const;
+    // Sleeping bits of balls j .. j + 7
+    uint32_t sleepingBits8(int j) const;
+
+    Ball get(int i) const;
+    void set(int i, const Ball& ball);
+};
+
+#endif
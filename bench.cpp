@@ -0,0 +1,435 @@
+// Physics benchmarks, no GL. Prints one JSON document so results can be
+// compared across builds:
+//   billiards_bench [--filter=<substring>] [--min-time=<seconds>] [--out=<file>]
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "collision_kernel.h"
+#include "lightmap.h"
+#include "physics.h"
+#include "shot_cache.h"
+#include "shot_search.h"
+#include "table_batch.h"
+#include "table_def.h"
+
+// Every heap allocation in the process goes through here so each case can
+// report how many it made
+static std::atomic<uint64_t> allocations{0};
+
+void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if(void* p = malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+struct Result {
+    std::string name;
+    long iterations = 0; // calls of the case body
+    long steps = 0;      // what the case counts as one step, summed
+    double seconds = 0;
+    uint64_t allocations = 0;
+};
+
+double minTime = 0.5;
+std::string filter;
+std::vector<Result> results;
+
+// Call body until minTime has passed; body returns the steps it ran
+void run(const std::string& name, const std::function<long()>& body) {
+    if(!filter.empty() && name.find(filter) == std::string::npos) return;
+
+    body(); // warm up caches and let vectors reach their final size
+
+    using Clock = std::chrono::steady_clock;
+    Result result;
+    result.name = name;
+
+    uint64_t allocationsBefore = allocations.load();
+    Clock::time_point start = Clock::now();
+    do {
+        result.steps += body();
+        result.iterations++;
+        result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    } while(result.seconds < minTime);
+    result.allocations = allocations.load() - allocationsBefore;
+
+    results.push_back(result);
+    fprintf(stderr, "%-32s %10.1f ns/step\n", name.c_str(), result.seconds * 1e9 / result.steps);
+}
+
+// n balls spread over the table without overlaps, moving in random directions.
+// Big counts get smaller balls so they still fit.
+void scatter(World& world, int n, unsigned seed) {
+    std::mt19937 random(seed);
+    world.balls.resize(n);
+
+    int columns = int(ceil(sqrt(n * table_width / table_height)));
+    int rows = (n + columns - 1) / columns;
+    float cellX = table_width / columns, cellZ = table_height / rows;
+    float radius = std::min(0.05f, 0.4f * std::min(cellX, cellZ));
+    std::uniform_real_distribution<float> jitter(-0.05f, 0.05f), speed(-0.01f, 0.01f);
+
+    for(int i = 0;i < n;i++) {
+        float x = -table_width / 2 + cellX * (i % columns + 0.5f + jitter(random));
+        float z = -table_height / 2 + cellZ * (i / columns + 0.5f + jitter(random));
+        Ball ball(radius, 1, 1, 1, x, 0.55, z);
+        ball.velocity = glm::vec3(speed(random), 0, speed(random));
+        world.setBall(i, ball);
+    }
+}
+
+// Whether a break in mode moves every object ball of the rack, so the break
+// cases time a break and not a cue ball rolling past the rack
+bool breakScatters(SolverMode mode) {
+    World world;
+    world.mode = mode;
+    world.breakShot();
+    World racked = world;
+    world.runUntilRest(100000);
+
+    int still = 0;
+    for(int i = 1;i < world.balls.count;i++) {
+        still += world.balls.isActive(i) && world.balls.x[i] == racked.balls.x[i] && world.balls.z[i] == racked.balls.z[i];
+    }
+    if(still) fprintf(stderr, "The break left %d rack balls where they were\n", still);
+    return still == 0;
+}
+
+// Whether a heavier cue ball changes where a break leaves the balls, so the
+// rack's masses really reach the contacts
+bool massMatters(SolverMode mode) {
+    World light;
+    light.mode = mode;
+    light.breakShot();
+    World heavy = light;
+    heavy.balls.mass[0] *= 2;
+    light.runUntilRest(100000);
+    heavy.runUntilRest(100000);
+
+    for(int i = 0;i < light.balls.count;i++) {
+        if(light.balls.x[i] != heavy.balls.x[i] || light.balls.z[i] != heavy.balls.z[i]) return true;
+    }
+    fprintf(stderr, "A cue ball of twice the mass left the break unchanged\n");
+    return false;
+}
+
+void benchBallCollisions() {
+    World world;
+    world.rack();
+    std::vector<Ball> rack(balls_count), balls;
+    for(int i = 0;i < balls_count;i++) rack[i] = world.ball(i);
+
+    // Every pair of the rack, one pair per step
+    run("check_ball_collisions", [&] {
+        balls = rack;
+        for(int i = 0;i < balls_count;i++) {
+            for(int j = i + 1;j < balls_count;j++) {
+                checkBallCollisions(balls[i], balls[j]);
+            }
+        }
+        return long(balls_count * (balls_count - 1) / 2);
+    });
+}
+
+void benchUpdate(int n) {
+    World world;
+    scatter(world, n, 1);
+    World start = world;
+
+    run("world_update/" + std::to_string(n), [&] {
+        const int steps = 64;
+        world.balls = start.balls;
+        for(int s = 0;s < steps;s++) world.update();
+        return long(steps);
+    });
+}
+
+void benchMove() {
+    World world;
+    world.rack();
+    std::vector<Ball> rack(balls_count), balls;
+    for(int i = 0;i < balls_count;i++) {
+        rack[i] = world.ball(i);
+        rack[i].setMovement(glm::vec3(0.01, 0, 0.005));
+    }
+
+    // One step is one ball moved one tick
+    run("ball_move", [&] {
+        const int ticks = 256;
+        balls = rack;
+        for(int t = 0;t < ticks;t++) {
+            for(Ball& ball : balls) ball.move();
+        }
+        return long(ticks * balls_count);
+    });
+
+    World moving = world;
+    for(int i = 0;i < balls_count;i++) moving.setMovement(i, glm::vec3(0.01, 0, 0.005));
+    run("world_move", [&] {
+        const int ticks = 256;
+        world.balls = moving.balls;
+        for(int t = 0;t < ticks;t++) world.move();
+        return long(ticks * balls_count);
+    });
+}
+
+// The motion model and the pair impulse in one scalar type, to weigh the
+// fixed-point builds against float (see scalar.h)
+template<class T>
+void benchScalar(const std::string& name) {
+    World world;
+    world.rack();
+    std::vector<BasicMotion<T>> rack(balls_count), motions;
+    for(int i = 0;i < balls_count;i++) {
+        rack[i] = {T(world.balls.x[i]), T(world.balls.z[i]), T(0.01), T(0.005), T(0), T(0)};
+    }
+
+    // One step is one ball moved one tick
+    run("scalar_motion/" + name, [&] {
+        const int ticks = 256;
+        motions = rack;
+        for(int t = 0;t < ticks;t++) {
+            for(BasicMotion<T>& m : motions) m = motionAt(m, T(1));
+        }
+        return long(ticks * balls_count);
+    });
+
+    // Every pair of the rack, heading into each other; one step is one pair
+    T sink = T(0);
+    run("scalar_pair/" + name, [&] {
+        for(int i = 0;i < balls_count;i++) {
+            for(int j = i + 1;j < balls_count;j++) {
+                PairImpulse<T> hit;
+                if(pairImpulse(rack[i].x - rack[j].x, rack[i].z - rack[j].z, rack[j].x - rack[i].x, rack[j].z - rack[i].z,
+                               T(1), T(1), hit)) sink += hit.impulse;
+            }
+        }
+        return long(balls_count * (balls_count - 1) / 2);
+    });
+    if(sink == T(1)) fprintf(stderr, "\n"); // keep the loop
+}
+
+void benchBreakShot(SolverMode mode, const char* name) {
+    World world;
+    world.mode = mode;
+
+    // One step is one tick of the shot
+    run(name, [&] {
+        world.breakShot();
+        return long(world.runUntilRest(100000));
+    });
+}
+
+// The same shot advanced a tick at a time, the way the sim thread drives it
+void benchTickedBreak(SolverMode mode, const char* name) {
+    World world;
+    world.mode = mode;
+
+    // One step is one tick of the shot
+    run(name, [&] {
+        world.breakShot();
+        long ticks = 0;
+        do {
+            world.advance(1);
+            ticks++;
+        } while(!world.atRest() && ticks < 100000);
+        return ticks;
+    });
+}
+
+void benchBatch(int balls) {
+    const int ticks = 600;
+    TableBatch batch(balls / balls_count);
+
+    // One step is one table ticked once
+    run("table_batch/" + std::to_string(balls), [&] {
+        for(World& table : batch.tables) table.breakShot();
+        batch.step(ticks);
+        return long(ticks) * batch.size();
+    });
+}
+
+void benchIdleBatch(int balls) {
+    const int ticks = 600;
+    TableBatch batch(balls / balls_count);
+    for(World& table : batch.tables) table.breakShot();
+    batch.runUntilRest(100000);
+
+    // Settled tables, where every ball sleeps. One step is one table ticked once.
+    run("table_batch_idle/" + std::to_string(balls), [&] {
+        batch.step(ticks);
+        return long(ticks) * batch.size();
+    });
+}
+
+void benchShotSearch() {
+    World world;
+    world.rack();
+    ShotSearch search;
+    ShotSearchOptions options;
+    options.samples = 256;
+    options.budgetMs = 1e9f; // measure the whole batch
+
+    // One step is one shot played to rest
+    run("shot_search/256", [&] {
+        return long(search.search(world, options).evaluated);
+    });
+}
+
+void benchShotCache() {
+    World world;
+    world.rack();
+    ShotSearch search;
+    ShotCache cache;
+    search.cache = &cache;
+    ShotSearchOptions options;
+    options.samples = 256;
+    options.budgetMs = 1e9f;
+
+    // Every shot found in the cache, one step is one shot looked up
+    search.search(world, options);
+    cache.resetStats();
+    run("shot_search_cached/256", [&] {
+        return long(search.search(world, options).evaluated);
+    });
+    ShotCacheStats stats = cache.stats();
+    if(stats.hits + stats.misses) fprintf(stderr, "%-32s %10.1f%% hits, %llu evicted\n", "", stats.hitRate() * 100, (unsigned long long)stats.evictions);
+
+    // The key of a table after a shot that moved one ball
+    TableKey key;
+    key.reset(world);
+    float x0 = world.balls.x[0];
+    run("table_key_update", [&] {
+        const int updates = 1024;
+        for(int u = 0;u < updates;u++) {
+            world.balls.x[0] = x0 + (u & 1) * 0.01f;
+            key.update(world);
+        }
+        return long(updates);
+    });
+}
+
+void benchTableLoad() {
+    // The standard table in both forms, one step is one table loaded
+    const char* tmp = getenv("TMPDIR");
+    std::string dir = tmp ? tmp : "/tmp";
+    std::string text = dir + "/billiards_bench.table", binary = dir + "/billiards_bench.tbl";
+    if(!writeTableText(standard_table, text) || !writeTableBinary(standard_table, binary)) {
+        fprintf(stderr, "Can't write table files to %s, skipping table_load\n", dir.c_str());
+        return;
+    }
+
+    TableAsset asset;
+    run("table_load/text", [&] {
+        asset.load(text);
+        return 1L;
+    });
+    run("table_load/binary", [&] {
+        asset.load(binary);
+        return 1L;
+    });
+    asset.close();
+    remove(text.c_str());
+    remove(binary.c_str());
+}
+
+// The static scene the renderer lights, baked from scratch and read back
+// from the cache; one step is one vertex lit
+void benchLightmap() {
+    const char* tmp = getenv("TMPDIR");
+    std::string cache = std::string(tmp ? tmp : "/tmp") + "/billiards_bench.lightmap";
+
+    auto bake = [&](const std::string& path) {
+        Mesh platform, body, leg, pocket;
+        buildPlatformMesh(platform);
+        buildTableBodyMesh(body);
+        LightBaker baker;
+        baker.addReceiver(&platform);
+        baker.addReceiver(&body);
+        for(int i = 0;i < legs_count;i++) buildLegMesh(leg, i);
+        baker.addReceiver(&leg);
+        for(int p = 0;p < standard_table.pocketCount;p++) buildPocketMesh(pocket, standard_table.pockets[p]);
+        baker.addOccluder(pocket);
+        return long(baker.bake(path).vertices);
+    };
+
+    run("lightmap_bake", [&] { return bake(""); });
+    bake(cache);
+    run("lightmap_cached", [&] { return bake(cache); });
+    remove(cache.c_str());
+}
+
+void writeJson(FILE* out) {
+    fprintf(out, "{\n");
+    fprintf(out, "  \"context\": {\"collision_kernel\": \"%s\", \"physics_scalar\": \"%s\", \"hardware_threads\": %u, \"min_time\": %g},\n",
+            collisionKernelName(activeCollisionKernel()), physics_scalar_name, std::thread::hardware_concurrency(), minTime);
+    fprintf(out, "  \"benchmarks\": [\n");
+    for(size_t i = 0;i < results.size();i++) {
+        const Result& r = results[i];
+        fprintf(out, "    {\"name\": \"%s\", \"iterations\": %ld, \"steps\": %ld, \"ns_per_step\": %.3f, "
+                     "\"steps_per_sec\": %.1f, \"ns_per_iteration\": %.1f, \"allocs_per_step\": %.6f}%s\n",
+                r.name.c_str(), r.iterations, r.steps, r.seconds * 1e9 / r.steps, r.steps / r.seconds,
+                r.seconds * 1e9 / r.iterations, double(r.allocations) / r.steps, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+int main(int argc, char** argv) {
+    std::string outPath;
+    for(int i = 1;i < argc;i++) {
+        std::string arg = argv[i];
+        if(arg.compare(0, 9, "--filter=") == 0) filter = arg.substr(9);
+        else if(arg.compare(0, 11, "--min-time=") == 0) minTime = atof(arg.c_str() + 11);
+        else if(arg.compare(0, 6, "--out=") == 0) outPath = arg.substr(6);
+        else {
+            fprintf(stderr, "usage: %s [--filter=<substring>] [--min-time=<seconds>] [--out=<file>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    benchBallCollisions();
+    for(int n : {16, 256, 4096}) benchUpdate(n);
+    benchMove();
+    benchScalar<float>("float");
+    benchScalar<double>("double");
+    benchScalar<Q16_16>("q16");
+    benchScalar<Q32_32>("q32");
+    if(!breakScatters(SolverMode::FixedTick) || !breakScatters(SolverMode::Continuous)) return 1;
+    if(!massMatters(SolverMode::FixedTick) || !massMatters(SolverMode::Continuous)) return 1;
+    benchBreakShot(SolverMode::FixedTick, "break_shot/fixed_tick");
+    benchBreakShot(SolverMode::Continuous, "break_shot/continuous");
+    benchTickedBreak(SolverMode::FixedTick, "break_ticked/fixed_tick");
+    benchTickedBreak(SolverMode::Continuous, "break_ticked/continuous");
+    for(int n : {16, 256, 4096}) benchBatch(n);
+    benchIdleBatch(4096);
+    benchShotSearch();
+    benchShotCache();
+    benchTableLoad();
+    benchLightmap();
+
+    FILE* out = stdout;
+    if(!outPath.empty() && !(out = fopen(outPath.c_str(), "w"))) {
+        fprintf(stderr, "Can't write %s\n", outPath.c_str());
+        return 1;
+    }
+    writeJson(out);
+    if(out != stdout) fclose(out);
+    return 0;
+}
@@ -0,0 +1,131 @@
+#include "broadphase.h"
+#include "physics.h"
+#include <algorithm>
+#include <cmath>
+
+void UniformGrid::update(const BallSet& balls, const TableDef& table) {
+    float maxRadius = 0;
+    for(int i = 0;i < balls.count;i++) {
+        maxRadius = std::max(maxRadius, balls.radius[i]);
+    }
+
+    if(balls.count != builtCount || 2 * maxRadius != cellSize || &table != builtTable) {
+        rebuild(balls, table, maxRadius);
+        return;
+    }
+
+    movedLastUpdate = 0;
+    for(int i = 0;i < balls.count;i++) {
+        int cell = balls.isActive(i) ? cellAt(balls.x[i], balls.z[i]) : -1;
+        if(cell == cellOf[i]) continue;
+
+        if(cellOf[i] >= 0) remove(i);
+        if(cell >= 0) insert(i, cell);
+        movedLastUpdate++;
+    }
+}
+
+void UniformGrid::rebuild(const BallSet& balls, const TableDef& table, float maxRadius) {
+    cellSize = 2 * maxRadius;
+    if(cellSize <= 0) cellSize = 2 * 0.05f;
+
+    float maxPocketRadius = 0;
+    for(int p = 0;p < table.pocketCount;p++) {
+        maxPocketRadius = std::max(maxPocketRadius, table.pockets[p].radius);
+    }
+
+    // Pockets sit on the table edge, so with this margin a ball that can
+    // still reach one is never clamped into a border cell
+    float margin = maxPocketRadius / 2 + maxRadius + cellSize;
+    originX = table.minX - margin;
+    originZ = table.minZ - margin;
+    cols = int(std::ceil((table.width() + 2 * margin) / cellSize));
+    rowCount = int(std::ceil((table.height() + 2 * margin) / cellSize));
+
+    head.assign(cols * rowCount, -1);
+    next.assign(balls.count, -1);
+    prev.assign(balls.count, -1);
+    cellOf.assign(balls.count, -1);
+    builtCount = balls.count;
+    builtTable = &table;
+
+    // A pocket is reachable from a cell when it is closer to the cell's
+    // rectangle than the pocket test distance of the largest ball
+    cellPockets.assign(cols * rowCount, 0);
+    for(int row = 0;row < rowCount;row++) {
+        for(int col = 0;col < cols;col++) {
+            float x0 = originX + col * cellSize, z0 = originZ + row * cellSize;
+            uint8_t mask = 0;
+            for(int p = 0;p < table.pocketCount;p++) {
+                const PocketDef& pocket = table.pockets[p];
+                float reach = pocket.radius / 2 + maxRadius;
+                float dx = std::max(std::max(x0 - pocket.x, pocket.x - (x0 + cellSize)), 0.0f);
+                float dz = std::max(std::max(z0 - pocket.z, pocket.z - (z0 + cellSize)), 0.0f);
+                if(dx * dx + dz * dz <= reach * reach) mask |= 1 << p;
+            }
+            cellPockets[row * cols + col] = mask;
+        }
+    }
+
+    movedLastUpdate = 0;
+    for(int i = 0;i < balls.count;i++) {
+        if(!balls.isActive(i)) continue;
+        insert(i, cellAt(balls.x[i], balls.z[i]));
+        movedLastUpdate++;
+    }
+}
+
+int UniformGrid::cellAt(float x, float z) const {
+    int col = int(std::floor((x - originX) / cellSize));
+    int row = int(std::floor((z - originZ) / cellSize));
+    col = std::min(std::max(col, 0), cols - 1);
+    row = std::min(std::max(row, 0), rowCount - 1);
+    return row * cols + col;
+}
+
+void UniformGrid::insert(int i, int cell) {
+    cellOf[i] = cell;
+    prev[i] = -1;
+    next[i] = head[cell];
+    if(head[cell] >= 0) prev[head[cell]] = i;
+    head[cell] = i;
+}
+
+void UniformGrid::remove(int i) {
+    int cell = cellOf[i];
+    if(prev[i] >= 0) next[prev[i]] = next[i];
+    else head[cell] = next[i];
+    if(next[i] >= 0) prev[next[i]] = prev[i];
+    cellOf[i] = -1;
+}
+
+void UniformGrid::candidates(const BallSet& balls, int i, std::vector<int>& out) const {
+    out.clear();
+    int cell = cellOf[i];
+    if(cell < 0) return;
+
+    int col = cell % cols, row = cell / cols;
+    for(int r = std::max(row - 1, 0);r <= std::min(row + 1, rowCount - 1);r++) {
+        for(int c = std::max(col - 1, 0);c <= std::min(col + 1, cols - 1);c++) {
+            for(int j = head[r * cols + c];j >= 0;j = next[j]) {
+                if(j > i && balls.isActive(j)) out.push_back(j);
+            }
+        }
+    }
+    std::sort(out.begin(), out.end());
+}
+
+void UniformGrid::neighbours(const BallSet& balls, int i, std::vector<int>& out) const {
+    out.clear();
+    int cell = cellOf[i];
+    if(cell < 0) return;
+
+    int col = cell % cols, row = cell / cols;
+    for(int r = std::max(row - 1, 0);r <= std::min(row + 1, rowCount - 1);r++) {
+        for(int c = std::max(col - 1, 0);c <= std::min(col + 1, cols - 1);c++) {
+            for(int j = head[r * cols + c];j >= 0;j = next[j]) {
+                if(j != i && balls.isActive(j)) out.push_back(j);
+            }
+        }
+    }
+}
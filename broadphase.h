@@ -0,0 +1,70 @@
+#ifndef BROADPHASE_H
+#define BROADPHASE_H
+
+#include <cstdint>
+#include <vector>
+#include "ball_set.h"
+#include "table_def.h"
+
+// Which candidate pairs World::update() hands to the narrow phase
+enum class BroadphaseMode {
+    Auto,       // brute force for small racks, grid above grid_min_balls
+    BruteForce, // every pair, the reference implementation
+    Grid        // uniform grid, only balls in neighbouring cells
+};
+
+// Ball count from which BroadphaseMode::Auto switches to the grid
+const int grid_min_balls = 64;
+
+// Uniform grid over the table with cells one ball diameter wide, so two
+// overlapping balls are always in the same or neighbouring cells. Each cell is
+// an intrusive doubly linked list of balls, which makes moving a ball to
+// another cell O(1) and lets update() only touch balls that changed cell.
+// Positions outside the table are clamped to the border cells; clamping never
+// pulls two balls further apart, so no pair is lost.
+//
+// Each cell also knows which pockets can be reached from inside it, so the
+// pocket test only looks at those instead of all of them.
+class UniformGrid {
+public:
+    // Bring the grid up to date with the current positions. Rebuilds from
+    // scratch when the table, the ball count or the largest radius changed.
+    void update(const BallSet& balls, const TableDef& table);
+
+    // Append to out every active ball j > i in the 3x3 cells around ball i,
+    // sorted by index so pairs are resolved in the same order as brute force
+    void candidates(const BallSet& balls, int i, std::vector<int>& out) const;
+
+    // Append to out every other active ball in the 3x3 cells around ball i,
+    // in no particular order
+    void neighbours(const BallSet& balls, int i, std::vector<int>& out) const;
+
+    // Bitmask of the pockets reachable from ball i's cell
+    uint8_t pocketsNear(int i) const { return cellOf[i] >= 0 ? cellPockets[cellOf[i]] : 0xff; }
+
+    float getCellSize() const { return cellSize; }
+    int columns() const { return cols; }
+    int rows() const { return rowCount; }
+
+    // Balls moved to another cell by the last update()
+    int movedLastUpdate = 0;
+
+private:
+    float cellSize = 0;
+    float originX = 0, originZ = 0;
+    int cols = 0, rowCount = 0;
+    int builtCount = -1;
+    const TableDef* builtTable = nullptr;
+
+    std::vector<int> head;       // first ball of each cell, -1 when empty
+    std::vector<int> next, prev; // per-ball links inside its cell
+    std::vector<int> cellOf;     // cell of each ball, -1 when not in the grid
+    std::vector<uint8_t> cellPockets;
+
+    void rebuild(const BallSet& balls, const TableDef& table, float maxRadius);
+    int cellAt(float x, float z) const;
+    void insert(int i, int cell);
+    void remove(int i);
+};
+
+#endif
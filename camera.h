@@ -0,0 +1,34 @@
+#ifndef CAMERA_H
+#define CAMERA_H
+
+#include <glm/glm.hpp>
+#include "physics.h"
+
+const float fov_y = 45.0f; // vertical field of view, degrees
+
+// Free-fly camera. The game moves it from the mouse and keyboard, the
+// headless renderer sets it from the command line.
+class Camera {
+public:
+    glm::vec3 position = glm::vec3(0, 1.3, 5);
+    glm::vec3 look = glm::vec3(0, 0, -1);
+    glm::vec3 up = glm::vec3(0, 1, 0);
+
+    float cameraMovementSpeed = 0.01;
+    float cameraSensitivity = 0.001;
+
+    glm::vec3 getPropperVector() {
+        glm::vec3 ret = look;
+        ret.y = position.y;
+        ret /= distance(ret);
+        return ret;
+    }
+
+    // Point the camera at target
+    void lookAt(glm::vec3 target) {
+        look = target - position;
+        look /= distance(look);
+    }
+};
+
+#endif
@@ -0,0 +1,120 @@
+#include "collision_kernel.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#endif
+
+uint32_t overlapMask8Scalar(const BallSet& balls, int i, int j) {
+    float xi = balls.x[i], zi = balls.z[i], ri = balls.radius[i];
+
+    uint32_t mask = 0;
+    for(int k = 0;k < simd_width;k++) {
+        float dx = xi - balls.x[j + k];
+        float dz = zi - balls.z[j + k];
+        float dx2 = dx * dx;
+        float dz2 = dz * dz;
+        float dist2 = dx2 + dz2;
+        float rs = ri + balls.radius[j + k];
+        float rs2 = rs * rs;
+        if(dist2 < rs2) {
+            mask |= 1u << k;
+        }
+    }
+    return mask;
+}
+
+#ifdef HAVE_X86_KERNELS
+
+__attribute__((target("sse2")))
+uint32_t overlapMask8SSE(const BallSet& balls, int i, int j) {
+    __m128 xi = _mm_set1_ps(balls.x[i]);
+    __m128 zi = _mm_set1_ps(balls.z[i]);
+    __m128 ri = _mm_set1_ps(balls.radius[i]);
+
+    uint32_t mask = 0;
+    for(int half = 0;half < 2;half++) {
+        int base = j + half * 4;
+        __m128 dx = _mm_sub_ps(xi, _mm_loadu_ps(&balls.x[base]));
+        __m128 dz = _mm_sub_ps(zi, _mm_loadu_ps(&balls.z[base]));
+        __m128 dist2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz));
+        __m128 rs = _mm_add_ps(ri, _mm_loadu_ps(&balls.radius[base]));
+        __m128 hit = _mm_cmplt_ps(dist2, _mm_mul_ps(rs, rs));
+        mask |= uint32_t(_mm_movemask_ps(hit)) << (half * 4);
+    }
+    return mask;
+}
+
+__attribute__((target("avx2")))
+uint32_t overlapMask8AVX2(const BallSet& balls, int i, int j) {
+    __m256 xi = _mm256_set1_ps(balls.x[i]);
+    __m256 zi = _mm256_set1_ps(balls.z[i]);
+    __m256 ri = _mm256_set1_ps(balls.radius[i]);
+
+    __m256 dx = _mm256_sub_ps(xi, _mm256_loadu_ps(&balls.x[j]));
+    __m256 dz = _mm256_sub_ps(zi, _mm256_loadu_ps(&balls.z[j]));
+    __m256 dist2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dz, dz));
+    __m256 rs = _mm256_add_ps(ri, _mm256_loadu_ps(&balls.radius[j]));
+    __m256 hit = _mm256_cmp_ps(dist2, _mm256_mul_ps(rs, rs), _CMP_LT_OQ);
+    return uint32_t(_mm256_movemask_ps(hit));
+}
+
+CollisionKernel detectCollisionKernel() {
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) return CollisionKernel::AVX2;
+    if(__builtin_cpu_supports("sse2")) return CollisionKernel::SSE;
+    return CollisionKernel::Scalar;
+}
+
+#else
+
+uint32_t overlapMask8SSE(const BallSet& balls, int i, int j) {
+    return overlapMask8Scalar(balls, i, j);
+}
+
+uint32_t overlapMask8AVX2(const BallSet& balls, int i, int j) {
+    return overlapMask8Scalar(balls, i, j);
+}
+
+CollisionKernel detectCollisionKernel() {
+    return CollisionKernel::Scalar;
+}
+
+#endif
+
+static CollisionKernel currentKernel = CollisionKernel::Scalar;
+
+static uint32_t (*kernelFor(CollisionKernel kernel))(const BallSet&, int, int) {
+    switch(kernel) {
+        case CollisionKernel::AVX2: return overlapMask8AVX2;
+        case CollisionKernel::SSE: return overlapMask8SSE;
+        default: return overlapMask8Scalar;
+    }
+}
+
+static uint32_t (*initialKernel())(const BallSet&, int, int) {
+    currentKernel = detectCollisionKernel();
+    return kernelFor(currentKernel);
+}
+
+uint32_t (*overlapMask8)(const BallSet& balls, int i, int j) = initialKernel();
+
+CollisionKernel activeCollisionKernel() {
+    return currentKernel;
+}
+
+void selectCollisionKernel(CollisionKernel kernel) {
+    if(int(kernel) > int(detectCollisionKernel())) {
+        kernel = CollisionKernel::Scalar;
+    }
+    currentKernel = kernel;
+    overlapMask8 = kernelFor(kernel);
+}
+
+const char* collisionKernelName(CollisionKernel kernel) {
+    switch(kernel) {
+        case CollisionKernel::AVX2: return "avx2";
+        case CollisionKernel::SSE: return "sse";
+        default: return "scalar";
+    }
+}
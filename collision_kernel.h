@@ -0,0 +1,44 @@
+#ifndef COLLISION_KERNEL_H
+#define COLLISION_KERNEL_H
+
+#include <cstdint>
+#include "ball_set.h"
+
+// Narrow-phase overlap test of ball i against balls j .. j + 7.
+// Bit k of the result is set when ball j + k overlaps ball i, using the
+// squared distance so no sqrt is needed. Every implementation does the same
+// float operations in the same order (sub, mul, mul, add, add, mul, compare)
+// so their masks are identical bit for bit. Build with -ffp-contract=off so the
+// scalar version isn't fused into FMAs.
+enum class CollisionKernel { Scalar, SSE, AVX2 };
+
+uint32_t overlapMask8Scalar(const BallSet& balls, int i, int j);
+uint32_t overlapMask8SSE(const BallSet& balls, int i, int j);
+uint32_t overlapMask8AVX2(const BallSet& balls, int i, int j);
+
+// Single pair version of the same test, for candidate lists from a broadphase
+inline bool ballsOverlap(const BallSet& balls, int i, int j) {
+    float dx = balls.x[i] - balls.x[j];
+    float dz = balls.z[i] - balls.z[j];
+    float dx2 = dx * dx;
+    float dz2 = dz * dz;
+    float dist2 = dx2 + dz2;
+    float rs = balls.radius[i] + balls.radius[j];
+    float rs2 = rs * rs;
+    return dist2 < rs2;
+}
+
+// Best kernel the running CPU supports
+CollisionKernel detectCollisionKernel();
+
+// Currently selected kernel, defaults to detectCollisionKernel()
+extern uint32_t (*overlapMask8)(const BallSet& balls, int i, int j);
+CollisionKernel activeCollisionKernel();
+
+// Force a kernel, e.g. the scalar reference for comparisons. Falls back to the
+// scalar one if the CPU doesn't support the requested instruction set.
+void selectCollisionKernel(CollisionKernel kernel);
+
+const char* collisionKernelName(CollisionKernel kernel);
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef CONTACT_H
+#define CONTACT_H
+
+// Contact rules of the fixed-tick solver: cushions, pockets and ball pairs.
+// Like the motion model they are written once for any scalar of scalar.h and
+// World runs them in ContactScalar.
+#include "scalar.h"
+#include "table_def.h"
+
+// Share of the speed into a cushion that the ball keeps coming off it
+const float cushion_restitution = 0.8;
+
+// Velocity component v of a ball at p past the cushion at low or high, after the bounce
+template<class T>
+T bounce(T p, T v, T low, T high) {
+    if((p < low && v < T(0)) || (p > high && v > T(0))) {
+        return -T(cushion_restitution) * v;
+    }
+    return v;
+}
+
+// Whether a ball of radius at (x, z) dropped into pocket. The distance is
+// taken and compared in double, which rounds the same everywhere too.
+template<class T>
+bool inPocket(T x, T z, T radius, const PocketDef& pocket) {
+    T dx = x - T(pocket.x);
+    T dz = z - T(pocket.z);
+    return detSqrt(double(dx * dx + dz * dz)) < pocket.radius / 2.0 + double(radius);
+}
+
+// Impulse along the normal between two overlapping balls
+template<class T>
+struct PairImpulse {
+    T nx, nz;    // unit normal from the second ball to the first
+    T impulse;   // <= 0, the first ball takes -impulse * n / its mass
+};
+
+// Impulse for balls of mass mi and mj at offset (dx, dz) = first - second
+// with relative velocity (dvx, dvz). False when they're already separating or
+// their centres coincide and there is no normal.
+template<class T>
+bool pairImpulse(T dx, T dz, T dvx, T dvz, T mi, T mj, PairImpulse<T>& out) {
+    T dist = detLength(dx, dz);
+    if(dist == T(0)) return false;
+
+    out.nx = dx / dist;
+    out.nz = dz / dist;
+    T velocityAlongNormal = dvx * out.nx + dvz * out.nz;
+    if(velocityAlongNormal > T(0)) return false;
+
+    T restitution = T(1);
+    out.impulse = (T(1) + restitution) * velocityAlongNormal;
+    out.impulse /= T(1) / mi + T(1) / mj;
+    return true;
+}
+
+#endif
@@ -0,0 +1,397 @@
+#include "event_solver.h"
+#include "physics.h"
+#include <algorithm>
+#include <cmath>
+
+// Safety net against pathological event storms (e.g. many balls squeezed into
+// a corner), the solver gives up on the call after this many events
+const int max_events_per_call = 1000000;
+
+// A phase event finishes the phase when at most this many ticks of it are
+// left, so float rounding of the stored state can't leave a sliver behind
+const double phase_snap = 1e-3;
+
+// Real roots of a*x² + b*x + c, returns how many were written to roots
+static int solveQuadratic(double a, double b, double c, double roots[2]) {
+    double scale = std::max(std::fabs(b), std::fabs(c));
+    if(std::fabs(a) <= 1e-12 * scale) {
+        if(b == 0) return 0;
+        roots[0] = -c / b;
+        return 1;
+    }
+
+    double disc = b * b - 4 * a * c;
+    if(disc < 0) return 0;
+
+    // Numerically stable form, avoids cancelling b against the square root
+    double q = -0.5 * (b + std::copysign(std::sqrt(disc), b));
+    if(q == 0) {
+        roots[0] = 0;
+        return 1;
+    }
+    roots[0] = q / a;
+    roots[1] = c / q;
+    if(roots[0] > roots[1]) std::swap(roots[0], roots[1]);
+    return 2;
+}
+
+// Real roots of a*x³ + b*x² + c*x + d
+static int solveCubic(double a, double b, double c, double d, double roots[3]) {
+    double scale = std::max(std::fabs(b), std::max(std::fabs(c), std::fabs(d)));
+    if(std::fabs(a) <= 1e-12 * scale) {
+        return solveQuadratic(b, c, d, roots);
+    }
+
+    double A = b / a, B = c / a, C = d / a;
+    double Q = (A * A - 3 * B) / 9;
+    double R = (2 * A * A * A - 9 * A * B + 27 * C) / 54;
+
+    if(R * R < Q * Q * Q) {
+        double theta = std::acos(R / std::sqrt(Q * Q * Q));
+        double m = -2 * std::sqrt(Q);
+        roots[0] = m * std::cos(theta / 3) - A / 3;
+        roots[1] = m * std::cos((theta + 2 * M_PI) / 3) - A / 3;
+        roots[2] = m * std::cos((theta - 2 * M_PI) / 3) - A / 3;
+        return 3;
+    }
+
+    double S = -std::copysign(std::cbrt(std::fabs(R) + std::sqrt(R * R - Q * Q * Q)), R);
+    double T = S != 0 ? Q / S : 0;
+    roots[0] = S + T - A / 3;
+    return 1;
+}
+
+static double evalQuartic(const double c[5], double t) {
+    return (((c[4] * t + c[3]) * t + c[2]) * t + c[1]) * t + c[0];
+}
+
+double EventSolver::firstQuadraticRoot(double a, double b, double c, double window) {
+    if(c <= 0) return 0;
+
+    double roots[2];
+    int n = solveQuadratic(a, b, c, roots);
+    for(int k = 0;k < n;k++) {
+        if(roots[k] >= 0 && roots[k] <= window) return roots[k];
+    }
+    return -1;
+}
+
+double EventSolver::firstEntry(const double c[5], double window) {
+    if(window <= 0) return -1;
+
+    // Already touching and closing in
+    if(c[0] <= 0 && c[1] < 0) return 0;
+
+    // Work in s = t / window so the coefficients have comparable magnitudes
+    double d[5];
+    double w = 1;
+    for(int k = 0;k < 5;k++) {
+        d[k] = c[k] * w;
+        w *= window;
+    }
+
+    // Split [0, 1] where f is monotone, plus a few fixed cuts in case a
+    // critical point got lost to rounding
+    double cuts[3 + 5];
+    int count = solveCubic(4 * d[4], 3 * d[3], 2 * d[2], d[1], cuts);
+    for(int k = 0;k <= 4;k++) {
+        cuts[count++] = k / 4.0;
+    }
+    for(int k = 1;k < count;k++) {
+        for(int m = k;m > 0 && cuts[m - 1] > cuts[m];m--) {
+            std::swap(cuts[m - 1], cuts[m]);
+        }
+    }
+
+    double a = 0, fa = evalQuartic(d, 0);
+    for(int k = 0;k < count;k++) {
+        double b = cuts[k];
+        if(b <= a || b > 1) continue;
+
+        double fb = evalQuartic(d, b);
+        if(fa > 0 && fb <= 0) {
+            // f is monotone on [a, b]: Illinois false position converges in a
+            // handful of steps and always keeps the root bracketed
+            double lo = a, hi = b, flo = fa, fhi = fb;
+            int side = 0;
+            for(int it = 0;it < 64 && hi - lo > 1e-12;it++) {
+                double mid = (lo * fhi - hi * flo) / (fhi - flo);
+                if(!(mid > lo && mid < hi)) mid = 0.5 * (lo + hi);
+                double fm = evalQuartic(d, mid);
+                if(fm > 0) {
+                    lo = mid;
+                    flo = fm;
+                    if(side == -1) fhi *= 0.5;
+                    side = -1;
+                }
+                else {
+                    hi = mid;
+                    fhi = fm;
+                    if(fm == 0) break;
+                    if(side == 1) flo *= 0.5;
+                    side = 1;
+                }
+            }
+            return hi * window;
+        }
+        a = b;
+        fa = fb;
+    }
+    return -1;
+}
+
+void EventSolver::push(EventType type, double time, int i, int j) {
+    Event event;
+    event.time = time;
+    event.type = type;
+    event.i = i;
+    event.j = j;
+    event.versionI = versions[i];
+    event.versionJ = type == EventType::Ball ? versions[j] : 0;
+    queue.push(event);
+}
+
+void EventSolver::moveAll(World& world, double dt) {
+    if(dt <= 0) return;
+
+    for(int i = 0;i < world.balls.count;i++) {
+        if(!world.isMoving(i)) continue;
+        world.setMotion(i, motionAt(world.motion(i), dt));
+    }
+}
+
+void EventSolver::predict(World& world, int i, int skip) {
+    BallSet& balls = world.balls;
+    if(!balls.isActive(i)) return;
+
+    double x = balls.x[i], z = balls.z[i], r = balls.radius[i];
+    double vx = balls.vx[i], vz = balls.vz[i];
+    MotionPhase phase = motionPhase(world.motion(i));
+
+    horizon[i] = HUGE_VAL;
+    if(!phase.atRest()) {
+        double end = phase.duration;
+        push(EventType::Phase, now + end, i, -1);
+        horizon[i] = now + end;
+
+        double ax = phase.ax, az = phase.az;
+
+        // Cushions: remaining distance to each wall, measured positive while
+        // the ball is still inside. A sliding ball can curve, so both walls
+        // of an axis are candidates.
+        const TableDef& table = *world.table;
+        double lows[2] = {table.minX + r, table.minZ + r}, highs[2] = {table.maxX - r, table.maxZ - r};
+        double pos[2] = {x, z}, vel[2] = {vx, vz}, acc[2] = {ax, az};
+        for(int axis = 0;axis < 2;axis++) {
+            for(double sign : {1.0, -1.0}) {
+                double c = sign > 0 ? highs[axis] - pos[axis] : pos[axis] - lows[axis];
+                // Already out there but on its way back in after a bounce
+                if(c <= 0 && sign * vel[axis] <= 0) continue;
+
+                double t = firstQuadraticRoot(-sign * 0.5 * acc[axis], -sign * vel[axis], c, end);
+                if(t >= 0) {
+                    push(EventType::Cushion, now + t, i, axis);
+                    horizon[i] = std::min(horizon[i], now + t);
+                }
+            }
+        }
+
+        // Pockets: |p(t) - centre|² = (radius / 2 + r)²
+        double travel = std::sqrt(vx * vx + vz * vz) * end + 0.5 * std::sqrt(ax * ax + az * az) * end * end;
+        for(int p = 0;p < table.pocketCount;p++) {
+            const PocketDef& pocket = table.pockets[p];
+            double reach = pocket.radius / 2.0 + r;
+            double Ax = x - pocket.x, Az = z - pocket.z;
+            // Can't get there before stopping
+            if(std::sqrt(Ax * Ax + Az * Az) - reach > travel) continue;
+            double Cx = 0.5 * ax, Cz = 0.5 * az;
+            double c[5] = {
+                Ax * Ax + Az * Az - reach * reach,
+                2 * (Ax * vx + Az * vz),
+                vx * vx + vz * vz + 2 * (Ax * Cx + Az * Cz),
+                2 * (vx * Cx + vz * Cz),
+                Cx * Cx + Cz * Cz
+            };
+            double t = firstEntry(c, end);
+            if(t >= 0) push(EventType::Pocket, now + t, i, p);
+        }
+    }
+
+    if(skip == -2) return;
+    for(int j = 0;j < balls.count;j++) {
+        if(j == i || j == skip || !balls.isActive(j)) continue;
+        predictPair(world, i, j);
+    }
+}
+
+void EventSolver::predictPair(World& world, int i, int j) {
+    BallSet& balls = world.balls;
+
+    MotionPhase pi = motionPhase(world.motion(i)), pj = motionPhase(world.motion(j));
+    if(pi.atRest() && pj.atRest()) return;
+
+    // The polynomial only holds until the first of the two balls changes phase
+    // or bounces off a cushion, that event re-predicts the pair afterwards.
+    // Past the end of the call nothing is looked at.
+    double window = std::min(std::min(horizon[i], horizon[j]), end) - now;
+    double vix = balls.vx[i], viz = balls.vz[i];
+    double vjx = balls.vx[j], vjz = balls.vz[j];
+    double aix = pi.ax, aiz = pi.az, ajx = pj.ax, ajz = pj.az;
+
+    double Ax = double(balls.x[i]) - balls.x[j], Az = double(balls.z[i]) - balls.z[j];
+    double Bx = vix - vjx, Bz = viz - vjz;
+    double Cx = 0.5 * (aix - ajx), Cz = 0.5 * (aiz - ajz);
+    double R = double(balls.radius[i]) + balls.radius[j];
+
+    // Cheap reject: |d(t)| >= |A| - |B| t - |C| t², so the gap can't close
+    // inside the window if that bound stays above R
+    double gap = std::sqrt(Ax * Ax + Az * Az) - R;
+    double reach = std::sqrt(Bx * Bx + Bz * Bz) * window + std::sqrt(Cx * Cx + Cz * Cz) * window * window;
+    if(gap > reach) return;
+
+    double c[5] = {
+        Ax * Ax + Az * Az - R * R,
+        2 * (Ax * Bx + Az * Bz),
+        Bx * Bx + Bz * Bz + 2 * (Ax * Cx + Az * Cz),
+        2 * (Bx * Cx + Bz * Cz),
+        Cx * Cx + Cz * Cz
+    };
+    double t = firstEntry(c, window);
+    if(t >= 0) push(EventType::Ball, now + t, i, j);
+}
+
+void EventSolver::rebuild(World& world, double end) {
+    BallSet& balls = world.balls;
+    int n = balls.count;
+
+    now = 0;
+    this->end = end;
+    eventsProcessed = 0;
+    versions.assign(n, 0);
+    horizon.assign(n, HUGE_VAL);
+    queue = decltype(queue)();
+
+    // Pocketed balls are gone from the table
+    bool moving = false;
+    for(int i = 0;i < n;i++) {
+        if(!balls.isActive(i)) {
+            world.setMotion(i, {balls.x[i], balls.z[i], 0, 0, 0, 0});
+        }
+        else moving = moving || world.isMoving(i);
+    }
+    if(!moving) return;
+
+    for(int i = 0;i < n;i++) {
+        predict(world, i, -2);
+    }
+
+    // How far along x each ball can get before the call or its trajectory
+    // ends. Two balls whose ranges don't overlap can't touch in the window
+    // predictPair() would use, so only overlapping ranges are solved.
+    order.clear();
+    low.resize(n);
+    high.resize(n);
+    for(int i = 0;i < n;i++) {
+        if(!balls.isActive(i)) continue;
+        MotionPhase phase = motionPhase(world.motion(i));
+        double window = std::min(horizon[i], end);
+        double reach = std::sqrt(double(balls.vx[i]) * balls.vx[i] + double(balls.vz[i]) * balls.vz[i]) * window +
+                       0.5 * std::sqrt(phase.ax * phase.ax + phase.az * phase.az) * window * window;
+        double extent = balls.radius[i] + reach + 1e-6; // slack for rounding
+        low[i] = balls.x[i] - extent;
+        high[i] = balls.x[i] + extent;
+        order.push_back(i);
+    }
+    std::sort(order.begin(), order.end(), [&](int a, int b) {
+        return low[a] != low[b] ? low[a] < low[b] : a < b;
+    });
+    for(size_t a = 0;a < order.size();a++) {
+        int i = order[a];
+        for(size_t b = a + 1;b < order.size() && low[order[b]] <= high[i];b++) {
+            int j = order[b];
+            predictPair(world, std::min(i, j), std::max(i, j));
+        }
+    }
+}
+
+bool EventSolver::processUntil(World& world, double limit) {
+    BallSet& balls = world.balls;
+
+    while(!queue.empty() && queue.top().time <= limit) {
+        Event event = queue.top();
+        queue.pop();
+
+        if(event.versionI != versions[event.i] || !balls.isActive(event.i)) continue;
+        if(event.type == EventType::Ball && (event.versionJ != versions[event.j] || !balls.isActive(event.j))) continue;
+
+        if(event.time > now) {
+            moveAll(world, event.time - now);
+            now = event.time;
+        }
+
+        int i = event.i, j = event.j;
+        switch(event.type) {
+            case EventType::Phase: {
+                BallMotion m = world.motion(i);
+                MotionPhase phase = motionPhase(m);
+                if(phase.duration <= phase_snap) world.setMotion(i, motionAt(m, phase.duration));
+                versions[i]++;
+                predict(world, i);
+                break;
+            }
+
+            case EventType::Cushion: {
+                float& v = j == 0 ? balls.vx[i] : balls.vz[i];
+                float p = j == 0 ? balls.x[i] : balls.z[i];
+                float middle = j == 0 ? 0.5f * (world.table->minX + world.table->maxX) : 0.5f * (world.table->minZ + world.table->maxZ);
+                if((p - middle) * v > 0) v = -cushion_restitution * v; // only while heading out
+                versions[i]++;
+                predict(world, i);
+                break;
+            }
+
+            case EventType::Pocket:
+                balls.setActive(i, false);
+                world.setMotion(i, {balls.x[i], balls.z[i], 0, 0, 0, 0});
+                versions[i]++;
+                break;
+
+            case EventType::Ball: {
+                world.resolveBallPair(i, j);
+                versions[i]++;
+                versions[j]++;
+
+                // A grazing contact can still be closing in after the float
+                // resolve. Predicting the pair again would find it at this
+                // same instant forever, so it waits for the next event of
+                // either ball instead.
+                double Ax = double(balls.x[i]) - balls.x[j], Az = double(balls.z[i]) - balls.z[j];
+                double Bx = double(balls.vx[i]) - balls.vx[j], Bz = double(balls.vz[i]) - balls.vz[j];
+                bool closing = Ax * Bx + Az * Bz < 0;
+                predict(world, i, closing ? j : -1);
+                predict(world, j, i);
+                break;
+            }
+        }
+
+        if(++eventsProcessed >= max_events_per_call) return false;
+    }
+    return true;
+}
+
+void EventSolver::advance(World& world, double ticks) {
+    rebuild(world, ticks);
+    processUntil(world, ticks);
+    moveAll(world, ticks - now);
+    now = ticks;
+}
+
+double EventSolver::runUntilRest(World& world, double maxTicks) {
+    rebuild(world, maxTicks);
+    processUntil(world, maxTicks);
+    if(!world.atRest()) {
+        moveAll(world, maxTicks - now);
+        now = maxTicks;
+    }
+    return now;
+}
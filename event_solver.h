@@ -0,0 +1,88 @@
+#ifndef EVENT_SOLVER_H
+#define EVENT_SOLVER_H
+
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <vector>
+
+class World;
+
+// Continuous collision solver. Instead of moving every ball one tick and then
+// looking for overlaps, it computes when the next ball-ball, ball-cushion and
+// ball-pocket contact happens and jumps straight there, so nothing can tunnel
+// and a shot resolves in a few dozen events.
+//
+// Motion follows the closed form model in motion.h, the same one World::move()
+// steps through: inside a phase (sliding or rolling) a ball has a constant
+// acceleration a, so
+//     p(t) = p0 + v0 t + 0.5 a t²   until the phase ends.
+// The end of a phase is an event of its own. Times are in ticks. Contact
+// times come from the roots of the quadratic (cushion) or quartic (ball,
+// pocket) distance polynomials.
+//
+// Every call starts over from the ball state alone, so what a call does never
+// depends on earlier ones; replays and seeking rely on that. Only contacts
+// inside the call matter, so pair windows end with it, and the pairs worth
+// solving come from a sort and sweep along x over each ball's reach in that
+// window rather than from all O(n²) of them.
+class EventSolver {
+public:
+    enum class EventType { Phase, Cushion, Pocket, Ball };
+
+    struct Event {
+        double time;
+        EventType type;
+        int i, j;            // j is the other ball, or the axis for cushions
+        uint32_t versionI, versionJ;
+
+        // Ties go by type and balls, not by the order the events went in
+        bool operator>(const Event& other) const {
+            if(time != other.time) return time > other.time;
+            if(type != other.type) return type > other.type;
+            if(i != other.i) return i > other.i;
+            return j > other.j;
+        }
+    };
+
+    // Events handled by the last advance() or runUntilRest() call
+    int eventsProcessed = 0;
+
+    // Simulate ticks ticks of continuous motion
+    void advance(World& world, double ticks);
+
+    // Simulate until every ball has stopped or maxTicks passed, whichever is
+    // first. Returns the number of ticks simulated.
+    double runUntilRest(World& world, double maxTicks);
+
+    // Earliest time in [0, window] at which a*t² + b*t + c reaches zero, or -1
+    static double firstQuadraticRoot(double a, double b, double c, double window);
+    // Earliest time in [0, window] at which the quartic c[4]*t⁴ + ... + c[0]
+    // crosses from positive to non-positive, or -1
+    static double firstEntry(const double c[5], double window);
+
+private:
+    double now = 0;
+    double end = 0; // of the current call
+    std::vector<uint32_t> versions;
+    // Time of each ball's next phase or cushion event, its trajectory is only
+    // a single polynomial up to there
+    std::vector<double> horizon;
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> queue;
+
+    // Sweep scratch, sorted by the low end of each ball's reach along x
+    std::vector<int> order;
+    std::vector<double> low, high;
+
+    void rebuild(World& world, double end);
+    // Run queued events up to time limit, returns false if it gave up at
+    // max_events_per_call
+    bool processUntil(World& world, double limit);
+    void moveAll(World& world, double dt);
+
+    void predict(World& world, int i, int skip = -1);
+    void predictPair(World& world, int i, int j);
+    void push(EventType type, double time, int i, int j);
+};
+
+#endif
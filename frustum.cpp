@@ -0,0 +1,46 @@
+#include "frustum.h"
+#include <cmath>
+
+void Frustum::fromMatrices(const float* projection, const float* modelview) {
+    // clip = projection * modelview, column-major: m[column * 4 + row]
+    float m[16];
+    for(int c = 0;c < 4;c++) {
+        for(int r = 0;r < 4;r++) {
+            float sum = 0;
+            for(int k = 0;k < 4;k++) sum += projection[k * 4 + r] * modelview[c * 4 + k];
+            m[c * 4 + r] = sum;
+        }
+    }
+
+    // Gribb/Hartmann: each plane is the last row plus or minus one of the others
+    for(int i = 0;i < 3;i++) {
+        for(int side = 0;side < 2;side++) {
+            float sign = side == 0 ? 1.0f : -1.0f;
+            glm::vec4 plane(m[3] + sign * m[i], m[7] + sign * m[4 + i],
+                            m[11] + sign * m[8 + i], m[15] + sign * m[12 + i]);
+
+            float length = sqrtf(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+            planes[i * 2 + side] = glm::vec4(plane.x / length, plane.y / length, plane.z / length, plane.w / length);
+        }
+    }
+}
+
+bool Frustum::sphereVisible(glm::vec3 center, float radius) const {
+    for(int i = 0;i < 6;i++) {
+        const glm::vec4& p = planes[i];
+        if(p.x * center.x + p.y * center.y + p.z * center.z + p.w < -radius) return false;
+    }
+    return true;
+}
+
+bool Frustum::boxVisible(glm::vec3 lo, glm::vec3 hi) const {
+    for(int i = 0;i < 6;i++) {
+        const glm::vec4& p = planes[i];
+        // The corner furthest along the plane normal
+        float x = p.x >= 0 ? hi.x : lo.x;
+        float y = p.y >= 0 ? hi.y : lo.y;
+        float z = p.z >= 0 ? hi.z : lo.z;
+        if(p.x * x + p.y * y + p.z * z + p.w < 0) return false;
+    }
+    return true;
+}
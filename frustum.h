@@ -0,0 +1,21 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+// View frustum as six planes, for throwing away objects the camera can't see
+// before they are submitted. No GL in here, the renderer reads the matrices.
+class Frustum {
+public:
+    // xyz is the inward normal, a point p is inside when dot(xyz, p) + w >= 0
+    glm::vec4 planes[6] = {}; // all zero accepts everything
+
+    // Both column-major, as returned by glGetFloatv(GL_PROJECTION_MATRIX / GL_MODELVIEW_MATRIX)
+    void fromMatrices(const float* projection, const float* modelview);
+
+    bool sphereVisible(glm::vec3 center, float radius) const;
+    // Axis aligned box from lo to hi
+    bool boxVisible(glm::vec3 lo, glm::vec3 hi) const;
+};
+
+#endif
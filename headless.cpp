@@ -0,0 +1,142 @@
+// Renders a shot to images without a window or X server:
+//   billiards_render [--replay=<file>] [--from=<tick>] [--to=<tick>]
+//                    [--size=<w>x<h>] [--eye=<x,y,z>] [--target=<x,y,z>]
+//                    [--step=<ticks per frame>] [--format=png|yuv] [--out=<path>]
+// Without --replay it renders the opening break until the balls stop. PNG
+// output is one file per frame: --out holds one %d (or %5d, %05d) for the
+// frame number and %% for a percent sign, frame_%05d.png by default. yuv
+// writes raw I420 frames to --out, stdout by default:
+//   billiards_render --format=yuv | ffmpeg -f rawvideo -pix_fmt yuv420p -s 640x360 -r 60 -i - clip.mp4
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glu.h>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include "camera.h"
+#include "offscreen.h"
+#include "physics.h"
+#include "renderer.h"
+#include "replay.h"
+
+static bool parseVector(const std::string& text, glm::vec3& v) {
+    return sscanf(text.c_str(), "%f,%f,%f", &v.x, &v.y, &v.z) == 3;
+}
+
+int main(int argc, char** argv) {
+    std::string replayPath, outPath, format = "png";
+    long from = -1, to = -1;
+    int width = 640, height = 360, step = 1;
+    Camera camera;
+    glm::vec3 target(0, 0.5, 0);
+
+    for(int i = 1;i < argc;i++) {
+        std::string arg = argv[i];
+        std::string value = arg.substr(arg.find('=') + 1);
+        bool ok = arg.find('=') != std::string::npos;
+        if(arg.compare(0, 9, "--replay=") == 0) replayPath = value;
+        else if(arg.compare(0, 7, "--from=") == 0) from = atol(value.c_str());
+        else if(arg.compare(0, 5, "--to=") == 0) to = atol(value.c_str());
+        else if(arg.compare(0, 7, "--size=") == 0) ok = sscanf(value.c_str(), "%dx%d", &width, &height) == 2 && width > 0 && height > 0;
+        else if(arg.compare(0, 6, "--eye=") == 0) ok = parseVector(value, camera.position);
+        else if(arg.compare(0, 9, "--target=") == 0) ok = parseVector(value, target);
+        else if(arg.compare(0, 7, "--step=") == 0) ok = (step = atoi(value.c_str())) > 0;
+        else if(arg.compare(0, 9, "--format=") == 0) ok = (format = value) == "png" || format == "yuv";
+        else if(arg.compare(0, 6, "--out=") == 0) outPath = value;
+        else ok = false;
+
+        if(!ok) {
+            std::cerr << "Bad argument " << arg << ", see the top of headless.cpp for usage" << std::endl;
+            return 1;
+        }
+    }
+    camera.lookAt(target);
+
+    FrameFormat frameFormat = format == "yuv" ? FrameFormat::Yuv420 : FrameFormat::Png;
+    if(frameFormat == FrameFormat::Yuv420) {
+        width &= ~1; // 4:2:0 needs even sizes
+        height &= ~1;
+    }
+    if(outPath.empty()) outPath = frameFormat == FrameFormat::Png ? "frame_%05d.png" : "-";
+    std::string firstName;
+    if(frameFormat == FrameFormat::Png && !frameFileName(outPath, 0, firstName)) {
+        std::cerr << "--out needs exactly one %d for the frame number (%% for a percent sign): " << outPath << std::endl;
+        return 1;
+    }
+
+    // The shot: a recording, or the break
+    World world;
+    ReplayReader replay;
+    if(!replayPath.empty()) {
+        if(!replay.open(replayPath)) {
+            std::cerr << "Can't read replay " << replayPath << std::endl;
+            return 1;
+        }
+        if(from < 0) from = replay.firstTick();
+        if(to < 0) to = replay.endTick();
+        if(!replay.seek(world, from)) {
+            std::cerr << "Tick " << from << " is before the recording starts" << std::endl;
+            return 1;
+        }
+    }
+    else {
+        world.breakShot();
+        if(from < 0) from = 0;
+        world.advance(from);
+    }
+
+    OffscreenContext context;
+    if(!context.create(width, height)) return 1;
+
+    Renderer renderer;
+    renderer.init();
+    renderer.setProjection(fov_y, height);
+
+    glViewport(0, 0, width, height);
+    glEnable(GL_DEPTH_TEST);
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    gluPerspective(fov_y, (double)width / (double)height, 1.0f, 100.0f);
+    glMatrixMode(GL_MODELVIEW);
+
+    FrameReadback readback;
+    readback.init(width, height, renderer.usingBuffers());
+    FrameEncoder encoder(frameFormat, width, height, outPath);
+
+    // Without an end tick the break runs until everything stops
+    const long max_ticks = 60 * 60;
+    for(long tick = from;;tick += step) {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glLoadIdentity();
+        loadCamera(camera);
+
+        renderer.beginFrame();
+        renderer.setEye(camera.position);
+        renderer.drawPlatform();
+        renderer.drawTable();
+        renderer.drawBalls(world.balls);
+
+        std::vector<uint8_t> pixels = encoder.buffer();
+        if(readback.read(pixels)) encoder.push(std::move(pixels));
+
+        bool done = to >= 0 ? tick + step > to : world.atRest() || tick - from >= max_ticks;
+        if(done) break;
+
+        if(replay.keyframeCount()) replay.play(world, tick, tick + step);
+        else world.advance(step);
+    }
+
+    for(;;) {
+        std::vector<uint8_t> pixels = encoder.buffer();
+        if(!readback.flush(pixels)) break;
+        encoder.push(std::move(pixels));
+    }
+    readback.release();
+    renderer.release();
+
+    bool ok = encoder.finish();
+    std::cerr << encoder.framesWritten() << " frames, " << width << "x" << height << std::endl;
+    return ok ? 0 : 1;
+}
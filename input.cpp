@@ -0,0 +1,201 @@
+#include "input.h"
+#include <X11/Xlib.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#ifdef BILLIARDS_XINPUT2
+#include <X11/extensions/XInput2.h>
+#endif
+
+bool ScriptedInput::load(const std::string& path) {
+    script.clear();
+    next = 0;
+    frame = 0;
+
+    std::ifstream file(path);
+    if(!file) return false;
+
+    std::string line;
+    int lineNumber = 0;
+    while(std::getline(file, line)) {
+        lineNumber++;
+        std::istringstream in(line);
+        Step step;
+        std::string kind, state;
+        if(!(in >> step.frame)) continue; // blank line or comment
+        in >> kind;
+
+        bool ok = true;
+        if(kind == "key") {
+            std::string key;
+            ok = bool(in >> key >> state) && key.size() == 1;
+            step.event.type = state == "up" ? InputEventType::KeyUp : InputEventType::KeyDown;
+            if(ok) step.event.key = key[0];
+        }
+        else if(kind == "motion") {
+            step.event.type = InputEventType::Motion;
+            ok = bool(in >> step.event.dx >> step.event.dy);
+        }
+        else if(kind == "button") {
+            ok = bool(in >> state);
+            step.event.type = state == "up" ? InputEventType::ButtonUp : InputEventType::ButtonDown;
+        }
+        else ok = false;
+
+        if(!ok) {
+            std::cerr << path << ":" << lineNumber << ": bad input line, skipped" << std::endl;
+            continue;
+        }
+        script.push_back(step);
+    }
+
+    std::stable_sort(script.begin(), script.end(), [](const Step& a, const Step& b) {
+        return a.frame < b.frame;
+    });
+    return true;
+}
+
+void ScriptedInput::poll(std::vector<InputEvent>& events) {
+    while(next < script.size() && script[next].frame <= frame) {
+        events.push_back(script[next].event);
+        next++;
+    }
+    frame++;
+}
+
+X11Input::X11Input() {
+    display = XOpenDisplay(nullptr);
+    if(!display) {
+        std::cerr << "Unable to open X display, mouse look is off" << std::endl;
+        return;
+    }
+
+    root = DefaultRootWindow(display);
+    Screen* screen = DefaultScreenOfDisplay(display);
+    centerX = screen->width / 2;
+    centerY = screen->height / 2;
+
+#ifdef BILLIARDS_XINPUT2
+    int event, error;
+    int major = 2, minor = 0;
+    if(XQueryExtension(display, "XInputExtension", &xiOpcode, &event, &error) &&
+       XIQueryVersion(display, &major, &minor) == Success) {
+        unsigned char bits[XIMaskLen(XI_LASTEVENT)] = {0};
+        XISetMask(bits, XI_RawMotion);
+
+        XIEventMask mask;
+        mask.deviceid = XIAllMasterDevices;
+        mask.mask_len = sizeof(bits);
+        mask.mask = bits;
+        XISelectEvents(display, root, &mask, 1);
+        XFlush(display);
+    }
+    else xiOpcode = -1;
+#endif
+}
+
+X11Input::~X11Input() {
+    if(display) XCloseDisplay(display);
+}
+
+const char* X11Input::name() const {
+    if(!display) return "x11 (no display)";
+    return xiOpcode >= 0 ? "x11 raw motion" : "x11 pointer";
+}
+
+void X11Input::glutKey(unsigned char key, bool down) {
+    InputEvent event;
+    event.type = down ? InputEventType::KeyDown : InputEventType::KeyUp;
+    event.key = key;
+    pending.push_back(event);
+}
+
+void X11Input::glutButton(bool down) {
+    InputEvent event;
+    event.type = down ? InputEventType::ButtonDown : InputEventType::ButtonUp;
+    pending.push_back(event);
+}
+
+void X11Input::poll(std::vector<InputEvent>& events) {
+    events.insert(events.end(), pending.begin(), pending.end());
+    pending.clear();
+    if(!display) return;
+
+    float dx = 0, dy = 0;
+    if(xiOpcode >= 0) pollRawMotion(dx, dy);
+    else pollPointer(dx, dy);
+
+    if(dx != 0 || dy != 0) {
+        InputEvent event;
+        event.type = InputEventType::Motion;
+        event.dx = dx;
+        event.dy = dy;
+        events.push_back(event);
+    }
+}
+
+void X11Input::pollRawMotion(float& dx, float& dy) {
+#ifdef BILLIARDS_XINPUT2
+    bool moved = false;
+    while(XPending(display)) {
+        XEvent event;
+        XNextEvent(display, &event);
+
+        XGenericEventCookie* cookie = &event.xcookie;
+        if(cookie->type != GenericEvent || cookie->extension != xiOpcode) continue;
+        if(!XGetEventData(display, cookie)) continue;
+
+        if(cookie->evtype == XI_RawMotion) {
+            const XIRawEvent* raw = (const XIRawEvent*)cookie->data;
+            const double* value = raw->raw_values;
+            // Only the valuators present in the mask have a value, in order
+            for(int axis = 0;axis < raw->valuators.mask_len * 8 && axis < 2;axis++) {
+                if(!XIMaskIsSet(raw->valuators.mask, axis)) continue;
+                if(axis == 0) dx += *value;
+                else dy += *value;
+                value++;
+            }
+            moved = true;
+        }
+        XFreeEventData(display, cookie);
+    }
+
+    // Keep the hidden cursor over the window so clicks still land there.
+    // Warps don't produce raw motion, so this doesn't feed back.
+    if(moved) {
+        XWarpPointer(display, None, root, 0, 0, 0, 0, centerX, centerY);
+        XFlush(display);
+    }
+#else
+    (void)dx;
+    (void)dy;
+#endif
+}
+
+void X11Input::pollPointer(float& dx, float& dy) {
+    Window rootReturn, child;
+    int x, y, windowX, windowY;
+    unsigned int buttons;
+    if(!XQueryPointer(display, root, &rootReturn, &child, &x, &y, &windowX, &windowY, &buttons)) return;
+
+    dx = x - centerX;
+    dy = y - centerY;
+    if(dx != 0 || dy != 0) {
+        XWarpPointer(display, None, root, 0, 0, 0, 0, centerX, centerY);
+        XFlush(display);
+    }
+}
+
+std::unique_ptr<InputBackend> createInputBackend(const std::string& spec) {
+    if(spec == "x11") return std::unique_ptr<InputBackend>(new X11Input());
+    if(spec == "null") return std::unique_ptr<InputBackend>(new NullInput());
+
+    const std::string script = "script:";
+    if(spec.compare(0, script.size(), script) == 0) {
+        std::unique_ptr<ScriptedInput> input(new ScriptedInput());
+        if(!input->load(spec.substr(script.size()))) return nullptr;
+        return input;
+    }
+    return nullptr;
+}
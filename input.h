@@ -0,0 +1,102 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+enum class InputEventType { KeyDown, KeyUp, Motion, ButtonDown, ButtonUp };
+
+struct InputEvent {
+    InputEventType type;
+    unsigned char key = 0; // KeyDown, KeyUp
+    float dx = 0, dy = 0;  // Motion: pointer movement in pixels, right and down positive
+};
+
+// Where keyboard, button and pointer input comes from. The GLUT callbacks
+// forward what GLUT sees, the game pulls the resulting events once a frame
+// with poll(). Backends with a source of their own ignore the GLUT side.
+class InputBackend {
+public:
+    virtual ~InputBackend() {}
+
+    virtual const char* name() const = 0;
+
+    virtual void glutKey(unsigned char /*key*/, bool /*down*/) {}
+    virtual void glutButton(bool /*down*/) {}
+
+    // Append everything that happened since the last call
+    virtual void poll(std::vector<InputEvent>& events) = 0;
+};
+
+// No input at all, for headless runs
+class NullInput : public InputBackend {
+public:
+    const char* name() const override { return "null"; }
+    void poll(std::vector<InputEvent>&) override {}
+};
+
+// Replays a text script, one event per line:
+//   <frame> key <char> down|up
+//   <frame> motion <dx> <dy>
+//   <frame> button down|up
+// Lines starting with # are comments. Events fire on the poll() whose frame
+// count reaches their frame.
+class ScriptedInput : public InputBackend {
+public:
+    // Returns false and leaves the script empty if the file can't be read
+    bool load(const std::string& path);
+
+    const char* name() const override { return "script"; }
+    void poll(std::vector<InputEvent>& events) override;
+
+    bool finished() const { return next >= script.size(); }
+
+private:
+    struct Step {
+        long frame;
+        InputEvent event;
+    };
+
+    std::vector<Step> script;
+    size_t next = 0;
+    long frame = 0;
+};
+
+// Keys and buttons from GLUT, pointer motion from one X connection kept open
+// for the whole run. With XInput2 (built with BILLIARDS_XINPUT2) the motion is
+// the device's raw relative motion; otherwise it is read back from the
+// pointer position, which then gets put back in the middle of the screen.
+// Without an X display it carries on with keys and buttons only.
+class X11Input : public InputBackend {
+public:
+    X11Input();
+    ~X11Input() override;
+
+    X11Input(const X11Input&) = delete;
+    X11Input& operator=(const X11Input&) = delete;
+
+    const char* name() const override;
+    void glutKey(unsigned char key, bool down) override;
+    void glutButton(bool down) override;
+    void poll(std::vector<InputEvent>& events) override;
+
+    bool hasDisplay() const { return display != nullptr; }
+
+private:
+    struct _XDisplay* display = nullptr;
+    unsigned long root = 0;
+    int centerX = 0, centerY = 0;
+    int xiOpcode = -1; // XInput2 major opcode, -1 when raw motion isn't used
+
+    std::vector<InputEvent> pending; // from the GLUT callbacks
+
+    void pollRawMotion(float& dx, float& dy);
+    void pollPointer(float& dx, float& dy);
+};
+
+// "x11", "null" or "script:<path>"; nullptr for anything else or a script
+// that can't be loaded
+std::unique_ptr<InputBackend> createInputBackend(const std::string& spec);
+
+#endif
@@ -0,0 +1,346 @@
+#include "lightmap.h"
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "thread_pool.h"
+
+const uint32_t lightmap_magic = 0x504d4c42; // "BLMP"
+const uint32_t lightmap_version = 1;
+
+struct LightmapHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t hash;
+    uint32_t count;
+    uint32_t reserved;
+};
+
+// Rays start this far off the surface so they don't hit it
+const float ray_offset = 1e-4f;
+
+// Shadow rays only: one-sided triangles, any hit ends the ray. A ray from
+// inside a closed mesh leaves through back faces and isn't stopped, which
+// lets overlapping boxes and the coarser detail tiers of a leg sit inside
+// each other without darkening what's hidden in there.
+class Bvh {
+public:
+    explicit Bvh(const std::vector<glm::vec3>& corners);
+    bool occluded(glm::vec3 origin, glm::vec3 direction, float distance) const;
+
+private:
+    struct Triangle {
+        glm::vec3 a, e1, e2; // corner and edges, counterclockwise seen from the front (see addCorners())
+    };
+    struct Node {
+        float low[3], high[3];
+        int first, count; // leaf triangles; count 0 makes first the second child, the first follows the node
+    };
+
+    std::vector<Triangle> triangles;
+    std::vector<Node> nodes;
+
+    int build(std::vector<int>& order, std::vector<glm::vec3>& centroids, int begin, int end);
+};
+
+Bvh::Bvh(const std::vector<glm::vec3>& corners) {
+    size_t count = corners.size() / 3;
+    std::vector<Triangle> input(count);
+    std::vector<glm::vec3> centroids(count);
+    std::vector<int> order(count);
+    for(size_t t = 0;t < count;t++) {
+        glm::vec3 a = corners[3 * t], b = corners[3 * t + 1], c = corners[3 * t + 2];
+        input[t] = {a, b - a, c - a};
+        centroids[t] = (a + b + c) / 3.0f;
+        order[t] = int(t);
+    }
+
+    triangles.swap(input);
+    if(count) build(order, centroids, 0, int(count));
+
+    // Leaves refer to order, put the triangles in that order
+    std::vector<Triangle> sorted(count);
+    for(size_t t = 0;t < count;t++) sorted[t] = triangles[order[t]];
+    triangles.swap(sorted);
+}
+
+// Median split along the longest axis of the centroids
+int Bvh::build(std::vector<int>& order, std::vector<glm::vec3>& centroids, int begin, int end) {
+    int index = int(nodes.size());
+    nodes.push_back(Node());
+
+    Node node;
+    glm::vec3 low(HUGE_VALF), high(-HUGE_VALF), centerLow(HUGE_VALF), centerHigh(-HUGE_VALF);
+    for(int i = begin;i < end;i++) {
+        const Triangle& t = triangles[order[i]];
+        glm::vec3 b = t.a + t.e1, c = t.a + t.e2;
+        low = glm::min(low, glm::min(t.a, glm::min(b, c)));
+        high = glm::max(high, glm::max(t.a, glm::max(b, c)));
+        centerLow = glm::min(centerLow, centroids[order[i]]);
+        centerHigh = glm::max(centerHigh, centroids[order[i]]);
+    }
+    for(int k = 0;k < 3;k++) {
+        node.low[k] = low[k];
+        node.high[k] = high[k];
+    }
+
+    if(end - begin <= 4) {
+        node.first = begin;
+        node.count = end - begin;
+        nodes[index] = node;
+        return index;
+    }
+
+    glm::vec3 extent = centerHigh - centerLow;
+    int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+    int middle = (begin + end) / 2;
+    std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end,
+                     [&](int a, int b) { return centroids[a][axis] < centroids[b][axis]; });
+
+    build(order, centroids, begin, middle);
+    node.first = build(order, centroids, middle, end);
+    node.count = 0;
+    nodes[index] = node;
+    return index;
+}
+
+bool Bvh::occluded(glm::vec3 origin, glm::vec3 direction, float distance) const {
+    if(nodes.empty()) return false;
+
+    float inverse[3], start[3] = {origin.x, origin.y, origin.z};
+    for(int k = 0;k < 3;k++) {
+        float d = direction[k];
+        inverse[k] = 1.0f / (d != 0 ? d : 1e-30f);
+    }
+
+    int stack[64], top = 0;
+    stack[top++] = 0;
+    while(top > 0) {
+        const Node& node = nodes[stack[--top]];
+
+        float near = 0, far = distance;
+        for(int k = 0;k < 3;k++) {
+            float t0 = (node.low[k] - start[k]) * inverse[k];
+            float t1 = (node.high[k] - start[k]) * inverse[k];
+            if(t0 > t1) std::swap(t0, t1);
+            near = std::max(near, t0);
+            far = std::min(far, t1);
+        }
+        if(near > far) continue;
+
+        if(node.count == 0) {
+            stack[top++] = node.first;
+            stack[top++] = int(&node - nodes.data()) + 1;
+            continue;
+        }
+
+        // Möller-Trumbore, front faces only
+        for(int i = node.first;i < node.first + node.count;i++) {
+            const Triangle& t = triangles[i];
+            glm::vec3 p = glm::cross(direction, t.e2);
+            float det = glm::dot(t.e1, p);
+            if(det <= 1e-12f) continue;
+
+            glm::vec3 s = origin - t.a;
+            float u = glm::dot(s, p);
+            if(u < 0 || u > det) continue;
+            glm::vec3 q = glm::cross(s, t.e1);
+            float v = glm::dot(direction, q);
+            if(v < 0 || u + v > det) continue;
+            float hit = glm::dot(t.e2, q);
+            if(hit > 0 && hit < distance * det) return true;
+        }
+    }
+    return false;
+}
+
+// Per-vertex random numbers, the same on every bake so the cache stays valid
+struct SampleRandom {
+    uint64_t state;
+
+    float next() {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        z ^= z >> 31;
+        return float(z >> 40) / float(1 << 24);
+    }
+};
+
+// Light arriving at position with normal
+static float lightAt(const Bvh& bvh, const LightingSettings& settings, glm::vec3 position, glm::vec3 normal, SampleRandom& random) {
+    glm::vec3 origin = position + normal * ray_offset;
+
+    // Ambient occlusion: cosine-weighted directions around the normal
+    glm::vec3 tangent = glm::normalize(fabsf(normal.x) > 0.5f ? glm::cross(normal, glm::vec3(0, 1, 0)) : glm::cross(normal, glm::vec3(1, 0, 0)));
+    glm::vec3 bitangent = glm::cross(normal, tangent);
+    int open = 0;
+    for(int s = 0;s < settings.aoSamples;s++) {
+        float u = random.next(), angle = 2 * float(M_PI) * random.next();
+        float r = sqrtf(u);
+        glm::vec3 direction = tangent * (r * cosf(angle)) + bitangent * (r * sinf(angle)) + normal * sqrtf(1 - u);
+        open += !bvh.occluded(origin, direction, settings.aoDistance);
+    }
+    float light = settings.ambient * open / std::max(settings.aoSamples, 1);
+
+    // The lamp: points on its lower half, each lit or in shadow
+    float direct = 0;
+    for(int s = 0;s < settings.shadowSamples;s++) {
+        float y = random.next(), angle = 2 * float(M_PI) * random.next();
+        float r = sqrtf(1 - y * y);
+        glm::vec3 point = lamp_position + lamp_radius * glm::vec3(r * cosf(angle), -y, r * sinf(angle));
+
+        glm::vec3 toLamp = point - origin;
+        float distance = glm::length(toLamp);
+        float facing = glm::dot(normal, toLamp) / distance;
+        if(facing <= 0) continue;
+        if(!bvh.occluded(origin, toLamp / distance, distance - ray_offset)) direct += facing / (distance * distance);
+    }
+    light += settings.lampPower * direct / std::max(settings.shadowSamples, 1);
+    return std::min(light, settings.maxLight);
+}
+
+static void hashBytes(uint64_t& hash, const void* data, size_t size) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    for(size_t i = 0;i < size;i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+}
+
+// Corners of the triangles of mesh, wound counterclockwise around the side
+// their vertex normals point to whichever way the mesh winds them
+static void addCorners(std::vector<glm::vec3>& corners, const Mesh& mesh) {
+    for(size_t t = 0;t + 2 < mesh.indices.size();t += 3) {
+        const Vertex& a = mesh.vertices[mesh.indices[t]];
+        const Vertex& b = mesh.vertices[mesh.indices[t + 1]];
+        const Vertex& c = mesh.vertices[mesh.indices[t + 2]];
+        glm::vec3 pa(a.x, a.y, a.z), pb(b.x, b.y, b.z), pc(c.x, c.y, c.z);
+        glm::vec3 normal(a.nx + b.nx + c.nx, a.ny + b.ny + c.ny, a.nz + b.nz + c.nz);
+        if(glm::dot(glm::cross(pb - pa, pc - pa), normal) < 0) std::swap(pb, pc);
+        corners.push_back(pa);
+        corners.push_back(pb);
+        corners.push_back(pc);
+    }
+}
+
+void LightBaker::addReceiver(Mesh* mesh) {
+    receivers.push_back(mesh);
+}
+
+void LightBaker::addOccluder(const Mesh& mesh) {
+    addCorners(occluders, mesh);
+}
+
+BakeStats LightBaker::bake(const std::string& cachePath, int threads) {
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point start = Clock::now();
+    BakeStats stats;
+
+    // Receivers shadow each other at their original size, which is the same
+    // surface in fewer triangles
+    std::vector<glm::vec3> corners = occluders;
+    for(Mesh* mesh : receivers) {
+        addCorners(corners, *mesh);
+        subdivideMesh(*mesh, settings.maxEdge, settings.farScale);
+    }
+
+    // Where each receiver's vertices start in the light values
+    std::vector<int> first;
+    for(Mesh* mesh : receivers) {
+        first.push_back(stats.vertices);
+        stats.vertices += int(mesh->vertices.size());
+    }
+
+    uint64_t hash = 14695981039346656037ull;
+    hashBytes(hash, &settings, sizeof(settings));
+    hashBytes(hash, &lamp_position, sizeof(lamp_position));
+    hashBytes(hash, &lamp_radius, sizeof(lamp_radius));
+    hashBytes(hash, corners.data(), corners.size() * sizeof(glm::vec3));
+    for(Mesh* mesh : receivers) {
+        for(const Vertex& v : mesh->vertices) hashBytes(hash, &v, offsetof(Vertex, r));
+    }
+
+    std::vector<float> light(stats.vertices);
+    LightmapHeader header = {};
+    FILE* file = cachePath.empty() ? nullptr : fopen(cachePath.c_str(), "rb");
+    if(file) {
+        stats.fromCache = fread(&header, sizeof(header), 1, file) == 1 && header.magic == lightmap_magic &&
+                          header.version == lightmap_version && header.hash == hash && header.count == uint32_t(stats.vertices) &&
+                          fread(light.data(), sizeof(float), light.size(), file) == light.size();
+        fclose(file);
+    }
+
+    if(!stats.fromCache) {
+        Bvh bvh(corners);
+        ThreadPool pool(threads);
+        for(size_t m = 0;m < receivers.size();m++) {
+            const Mesh& mesh = *receivers[m];
+            pool.parallelFor(int(mesh.vertices.size()), 64, [&](int begin, int end, int) {
+                for(int i = begin;i < end;i++) {
+                    const Vertex& v = mesh.vertices[i];
+                    SampleRandom random = {uint64_t(first[m] + i) * 0x2545f4914f6cdd1dull};
+                    light[first[m] + i] = lightAt(bvh, settings, glm::vec3(v.x, v.y, v.z), glm::vec3(v.nx, v.ny, v.nz), random);
+                }
+            });
+        }
+        stats.rays = int64_t(stats.vertices) * (settings.aoSamples + settings.shadowSamples);
+
+        file = cachePath.empty() ? nullptr : fopen(cachePath.c_str(), "wb");
+        if(file) {
+            header = {lightmap_magic, lightmap_version, hash, uint32_t(stats.vertices), 0};
+            bool ok = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(light.data(), sizeof(float), light.size(), file) == light.size();
+            if(fclose(file) != 0 || !ok) std::cerr << "Can't write lighting cache " << cachePath << std::endl;
+        }
+        else if(!cachePath.empty()) {
+            std::cerr << "Can't write lighting cache " << cachePath << std::endl;
+        }
+    }
+
+    for(size_t m = 0;m < receivers.size();m++) {
+        std::vector<Vertex>& vertices = receivers[m]->vertices;
+        for(size_t i = 0;i < vertices.size();i++) {
+            float l = light[first[m] + i];
+            vertices[i].r *= l;
+            vertices[i].g *= l;
+            vertices[i].b *= l;
+        }
+    }
+
+    stats.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return stats;
+}
+
+// A directory we can write the cache into, made if need be
+static bool writableDirectory(const std::string& dir) {
+    if(dir.empty()) return false;
+    if(access(dir.c_str(), W_OK) == 0) return true;
+    return errno == ENOENT && mkdir(dir.c_str(), 0755) == 0;
+}
+
+std::string defaultLightmapPath() {
+    // Next to the executable, unless that's an install directory we can't
+    // write, then the per-user cache, then the working directory
+    char path[4096];
+    ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if(length > 0) {
+        path[length] = 0;
+        char* slash = strrchr(path, '/');
+        if(slash && writableDirectory(std::string(path, slash))) return std::string(path, slash + 1) + "lightmap.cache";
+    }
+
+    std::string cache;
+    const char* xdg = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+    if(xdg && xdg[0] == '/') cache = xdg;
+    else if(home && home[0] == '/') cache = std::string(home) + "/.cache";
+    if(writableDirectory(cache) && writableDirectory(cache + "/billiards")) return cache + "/billiards/lightmap.cache";
+    return "lightmap.cache";
+}
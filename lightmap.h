@@ -0,0 +1,67 @@
+#ifndef LIGHTMAP_H
+#define LIGHTMAP_H
+
+// Lighting of the static scene, worked out once on the CPU and baked into the
+// vertex colors: ambient occlusion from the room and soft shadows from the
+// lamp over the table. The floor and the table never move, so drawing them lit
+// costs the same as drawing them flat. The receiving meshes are subdivided
+// first so the light has vertices to land on.
+//
+// A bake traces rays against a bounding volume hierarchy of every triangle,
+// split over a thread pool, and is cached in a file keyed on a hash of the
+// geometry and settings, so only the first run after a change pays for it.
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "mesh.h"
+
+// The lamp drawLightSphere() draws under the lamp bar. Only its lower half
+// gives light, the upper half is inside the bar.
+const glm::vec3 lamp_position(0, 1.4f, 0);
+const float lamp_radius = 0.025f;
+
+struct LightingSettings {
+    float ambient = 0.75f;    // light from the room on an unoccluded vertex
+    float lampPower = 0.35f;  // direct light facing the lamp from 1 unit away
+    float maxLight = 2.0f;    // cap, right next to the lamp the falloff blows up
+    float aoDistance = 0.6f;  // occluders further away don't darken
+    int aoSamples = 96;
+    int shadowSamples = 8;    // rays to points on the lamp, for soft edges
+    float maxEdge = 0.15f;    // longest receiver edge at the table
+    float farScale = 1.0f;    // edges may grow with distance from the table, see subdivideMesh()
+};
+
+struct BakeStats {
+    int vertices = 0;
+    int64_t rays = 0;
+    double seconds = 0;
+    bool fromCache = false;
+};
+
+class LightBaker {
+public:
+    LightingSettings settings;
+
+    // A mesh to light; it casts shadows too. Kept by pointer until bake().
+    void addReceiver(Mesh* mesh);
+    // A mesh that only casts shadows, copied
+    void addOccluder(const Mesh& mesh);
+
+    // Subdivide the receivers and scale their vertex colors by the light.
+    // Reads cachePath when it holds a bake of the same geometry and settings,
+    // otherwise traces on threads threads (0 for all) and writes cachePath.
+    // An empty path always traces and writes nothing.
+    BakeStats bake(const std::string& cachePath, int threads = 0);
+
+private:
+    std::vector<Mesh*> receivers;
+    std::vector<glm::vec3> occluders; // three corners per triangle
+};
+
+// lightmap.cache in the directory of the running executable, or when that
+// isn't writable in $XDG_CACHE_HOME/billiards (~/.cache/billiards), or else in
+// the working directory
+std::string defaultLightmapPath();
+
+#endif
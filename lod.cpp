@@ -0,0 +1,31 @@
+#include "lod.h"
+#include <cmath>
+
+float LodView::projectedSize(glm::vec3 center, float radius) const {
+    glm::vec3 d = center - eye;
+    float dist = sqrt(d.x * d.x + d.y * d.y + d.z * d.z);
+    if(dist <= radius) return 1e9f; // camera inside the bounds
+
+    float halfFov = fovY * float(M_PI) / 360.0f;
+    return radius * viewportHeight / (dist * tanf(halfFov));
+}
+
+// Finest tier whose threshold the size reaches, thresholds scaled by bias
+static int tierFor(float pixels, const float* thresholds, int tiers, float bias) {
+    for(int k = 0;k < tiers - 1;k++) {
+        if(pixels >= thresholds[k] * bias) return k;
+    }
+    return tiers - 1;
+}
+
+int selectLod(float pixels, const float* thresholds, int tiers, int current) {
+    if(current < 0) return tierFor(pixels, thresholds, tiers, 1.0f);
+
+    int finer = tierFor(pixels, thresholds, tiers, 1.0f + lod_hysteresis);
+    if(finer < current) return finer;
+
+    int coarser = tierFor(pixels, thresholds, tiers, 1.0f - lod_hysteresis);
+    if(coarser > current) return coarser;
+
+    return current;
+}
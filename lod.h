@@ -0,0 +1,38 @@
+#ifndef LOD_H
+#define LOD_H
+
+#include <glm/glm.hpp>
+
+// Distance based level of detail. Objects pick a tessellation tier from how
+// many pixels tall they end up on screen; tier 0 is the finest.
+
+const int sphere_lod_tiers = 4;
+const int sphere_lod_segments[sphere_lod_tiers] = {50, 24, 12, 6};
+// Smallest projected diameter (pixels) for tiers 0 .. n-2, the last tier
+// takes everything smaller
+const float sphere_lod_pixels[sphere_lod_tiers - 1] = {80, 30, 10};
+
+// Pockets and legs
+const int round_lod_tiers = 3;
+const int round_lod_segments[round_lod_tiers] = {32, 16, 8};
+const float round_lod_pixels[round_lod_tiers - 1] = {60, 20};
+
+// A tier only changes once the size is this far (relative) past the
+// threshold, so objects sitting right at a boundary don't flicker between two
+const float lod_hysteresis = 0.15f;
+
+class LodView {
+public:
+    glm::vec3 eye = glm::vec3(0, 0, 0);
+    float fovY = 45.0f;       // degrees, as passed to gluPerspective
+    int viewportHeight = 800; // pixels
+
+    // On-screen diameter in pixels of a sphere of the given radius
+    float projectedSize(glm::vec3 center, float radius) const;
+};
+
+// Tier for an object of the given projected size that is currently drawn at
+// tier current (-1 for none yet)
+int selectLod(float pixels, const float* thresholds, int tiers, int current);
+
+#endif
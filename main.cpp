@@ -1,109 +1,70 @@
 #include <GL/glut.h>
+#include <algorithm>
 #include <iostream>
+#include <cerrno>
 #include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <glm/glm.hpp>                  // Core GLM functions
 #include <glm/gtc/matrix_transform.hpp> // For matrix transformations like lookAt
 #include <glm/gtc/type_ptr.hpp>         // For converting glm types to OpenGL types (e.g., mat4 to float*)
-#include <X11/Xlib.h>
+#include "camera.h"
+#include "input.h"
+#include "physics.h"
+#include "profiler.h"
+#include "renderer.h"
+#include "shot_search.h"
+#include "sim_thread.h"
+#include "spectator.h"
 
 // screen resolutions
-const float EPS = 1e-6;
 const int screen_width = 1200;
 const int screen_height = 800;
 
-const float pocketRadius = 0.1;
-const float pocketDepth = 0.2;
-const float table_width = 2.8f;
-const float table_height = 1.4;
-
-const int balls_count = 16;
-bool isMousePressed = false;
-float strength = 0.0;
-
-bool keys[256];  // Array to keep track of key presses
-
-float distance(glm::vec3 p1, glm::vec3 p2 = {0, 0 ,0}) {
-    return sqrt( (p1.x - p2.x) * (p1.x - p2.x) + (p1.y - p2.y) * (p1.y - p2.y) + (p1.z - p2.z) * (p1.z - p2.z) );
-}
-
-class Camera {
-public:
-    glm::vec3 position = glm::vec3(0, 1.3, 5);
-    glm::vec3 look = glm::vec3(0, 0, -1);
-    glm::vec3 up = glm::vec3(0, 1, 0);
-
-    float cameraMovementSpeed = 0.01;
-    float cameraSensitivity = 0.001;
-
-    glm::vec3 getPropperVector() {
-        glm::vec3 ret = look;
-        ret.y = position.y;
-        ret /= distance(ret);
-        return ret;
-    }
-
-} camera;
-
-class Ball {
-public:
-    bool active = true;
-    float radius, mass = 1.0;
-    glm::vec3 position, color, velocity = {0, 0, 0};
-
-    Ball() {
-        active = true;
-    }
-    
-    Ball(float r) {
-        radius = r;
-        active = true;
-    }
-    
-    Ball(float rad, float r, float g, float b) {
-        radius = rad;
-        color = {r, g, b};
-        active = true;
-    }
-
-    Ball(float rad, float r, float g, float b, float x, float y, float z) {
-        radius = rad;
-        color = glm::vec3(r, g, b);
-        position = glm::vec3(x, y, z);
-        active = true;
-    }
-
-    // Function to draw a colored sphere
-    void drawColoredSphere() {
-        glColor3f(color.x, color.y, color.z); // Set the color (RGB)
-        glPushMatrix(); // Save the current transformation matrix
-        glTranslatef(position.x, position.y, position.z); // Move the sphere to the desired position
-        glutSolidSphere(radius, 50, 50); // Draw the sphere
-        glPopMatrix(); // Restore the previous transformation matrix
-    }
-
-    void setMovement(glm::vec3 v) {
-        velocity = v;
-        velocity.y = 0;
-    }
-
-    void move() {
-        float dec = 0.0000625;
-        
-        position += velocity;
-        float len = distance(velocity);
-        float ratio = ((len - dec) / len);
-        velocity *= ratio;
-
-        if(len - dec < 0) {
-            velocity = {0, 0, 0};
-        }
-
-    }
-
-} balls[balls_count]; // zero is the cue ball
-
-float dot(glm::vec3 v1, glm::vec3 v2) {
-    return (v1.x * v2.x + v1.y * v2.y + v1.z * v2.z);
+bool keys[256];  // Array to keep track of key presses, camera only
+
+// Keyboard, buttons and mouse look, '--input=x11|null|script:<file>'
+std::unique_ptr<InputBackend> input;
+std::vector<InputEvent> inputEvents;
+
+// Physics runs on its own thread, the callbacks below only read its snapshots
+// and send it commands
+ReplayWriter recorder; // '--record=<file>', '--record-checksums' adds per-tick checksums
+ReplayReader replay;   // '--replay=<file>'
+TableAsset tableAsset; // '--table-file=<asset>', racked with '--rack=<name>'; not with --record or --replay
+SimThread sim;         // declared after the replay objects it points to
+// Clock multiplier, '--speed=<x>'; '+' and '-' double and halve it, '0' goes
+// back to real time and 'k' skips to the end of the shot; not with --spectate
+double simSpeed = 1;
+BallSet shownBalls; // the latest snapshot, interpolated to the current frame
+
+// '--spectate=<address> [--table=<n>]' watches a table of billiards_server
+// instead of playing, the sim thread doesn't run then
+std::unique_ptr<SpectatorClient> spectator;
+int spectatedTable = 0;
+
+// Lighting is baked into the floor and table at startup, '--flat' skips it;
+// 'o' turns the ball shadows on and off
+Renderer renderer;
+bool retainedMode = true; // 'r' switches back to the immediate-mode drawing
+// 'h' searches for a good shot from the current table and shows it as a line
+std::unique_ptr<ShotSearch> shotSearch;
+ShotCache shotCache;       // outcomes of hint shots already played
+std::string shotCachePath; // '--shot-cache=<file>' keeps them across runs
+bool hintShown = false;
+ShotCandidate hint;
+
+bool showProfile = false; // 'p' shows the stage timings, 't' writes trace.json
+
+Camera camera;
+
+// Function to draw a colored sphere
+void drawColoredSphere(const Ball& ball) {
+    glColor3f(ball.color.x, ball.color.y, ball.color.z); // Set the color (RGB)
+    glPushMatrix(); // Save the current transformation matrix
+    glTranslatef(ball.position.x, ball.position.y, ball.position.z); // Move the sphere to the desired position
+    glutSolidSphere(ball.radius, 50, 50); // Draw the sphere
+    glPopMatrix(); // Restore the previous transformation matrix
 }
 
 void print(glm::vec3 v) {
@@ -139,15 +100,15 @@ void rotatVector(glm::vec3 &vector, glm::vec3 axis, float angle) {
 // Function to draw a circle (for a pocket)
 void drawCircle(float x, float y, float z, float radius, float depth, float r, float g, float b) {
     glColor3f(r, g, b);
-    int segments = 32;
+    const int segments = round_segments;
+    const UnitCircle<segments>& circle = unit_circle<segments>;
 
     // Draw pocket's top opening as a circle
     glBegin(GL_TRIANGLE_FAN);
     glVertex3f(x, y, z); // Center of the circle
     for (int i = 0; i <= segments; i++) {
-        float angle = 2.0f * M_PI * i / segments;
-        float dx = radius * cos(angle);
-        float dz = radius * sin(angle);
+        float dx = radius * circle.cosines[i];
+        float dz = radius * circle.sines[i];
         glVertex3f(x + dx, y, z + dz);
     }
     glEnd();
@@ -155,9 +116,8 @@ void drawCircle(float x, float y, float z, float radius, float depth, float r, f
     // Optional: Draw pocket depth as a vertical cylinder
     glBegin(GL_QUAD_STRIP);
     for (int i = 0; i <= segments; i++) {
-        float angle = 2.0f * M_PI * i / segments;
-        float dx = radius * cos(angle);
-        float dz = radius * sin(angle);
+        float dx = radius * circle.cosines[i];
+        float dz = radius * circle.sines[i];
         glVertex3f(x + dx, y, z + dz);         // Top edge
         glVertex3f(x + dx, y - depth, z + dz); // Bottom edge
     }
@@ -211,14 +171,14 @@ void drawRectangle(float x, float y, float z, float width, float depth, float he
 // Function to draw a cylinder (for legs)
 void drawCylinder(float x, float y, float z, float radius, float height, float r, float g, float b) {
     glColor3f(r, g, b);
-    int slices = 32;
+    const int slices = round_segments;
+    const UnitCircle<slices>& circle = unit_circle<slices>;
 
     // Draw cylinder sides
     glBegin(GL_QUAD_STRIP);
     for (int i = 0; i <= slices; i++) {
-        float angle = 2.0f * M_PI * i / slices;
-        float dx = radius * cos(angle);
-        float dz = radius * sin(angle);
+        float dx = radius * circle.cosines[i];
+        float dz = radius * circle.sines[i];
         glVertex3f(x + dx, y, z + dz);
         glVertex3f(x + dx, y - height, z + dz);
     }
@@ -228,9 +188,8 @@ void drawCylinder(float x, float y, float z, float radius, float height, float r
     glBegin(GL_TRIANGLE_FAN);
     glVertex3f(x, y, z); // Center of top circle
     for (int i = 0; i <= slices; i++) {
-        float angle = 2.0f * M_PI * i / slices;
-        float dx = radius * cos(angle);
-        float dz = radius * sin(angle);
+        float dx = radius * circle.cosines[i];
+        float dz = radius * circle.sines[i];
         glVertex3f(x + dx, y, z + dz);
     }
     glEnd();
@@ -238,9 +197,8 @@ void drawCylinder(float x, float y, float z, float radius, float height, float r
     glBegin(GL_TRIANGLE_FAN);
     glVertex3f(x, y - height, z); // Center of bottom circle
     for (int i = 0; i <= slices; i++) {
-        float angle = 2.0f * M_PI * i / slices;
-        float dx = radius * cos(angle);
-        float dz = radius * sin(angle);
+        float dx = radius * circle.cosines[i];
+        float dz = radius * circle.sines[i];
         glVertex3f(x + dx, y - height, z + dz);
     }
     glEnd();
@@ -262,13 +220,14 @@ void drawTable() {
     drawRectangle(-1.12, 1.6, -0.2, 2.24, 0.5, 0.2, 0.4, 0.2, 0.0); // Top Rail
 
     // Table Base
-    drawRectangle(-1.4, 0.5, -0.7, 2.8, 1.4, 0.1, 0.0, 0.5, 0.0);
+    const TableDef& table = *sim.world.table;
+    drawRectangle(table.minX, table_surface, table.minZ, table.width(), table.height(), 0.1, 0.0, 0.5, 0.0);
 
     // Rails
-    drawRectangle(-1.5, 0.6, -0.8, 3.0, 0.1, 0.2, 0.4, 0.2, 0.0); // Top Rail
-    drawRectangle(-1.5, 0.6, 0.7, 3.0, 0.1, 0.2, 0.4, 0.2, 0.0);  // Bottom Rail
-    drawRectangle(-1.5, 0.6, -0.7, 0.1, 1.4, 0.2, 0.4, 0.2, 0.0); // Left Rail
-    drawRectangle(1.4, 0.6, -0.7, 0.1, 1.4, 0.2, 0.4, 0.2, 0.0);  // Right Rail
+    for(int i = 0;i < table.cushionCount;i++) {
+        RailRect rail = railRect(table, i);
+        drawRectangle(rail.x, rail_top, rail.z, rail.width, rail.depth, rail_height, 0.4, 0.2, 0.0);
+    }
 
     // Legs
     drawCylinder(-1.3, 0.49, -0.6, 0.1, 0.5, 0.3, 0.2, 0.1);
@@ -276,21 +235,17 @@ void drawTable() {
     drawCylinder(-1.3, 0.49, 0.6, 0.1, 0.5, 0.3, 0.2, 0.1);
     drawCylinder(1.3, 0.49, 0.6, 0.1, 0.5, 0.3, 0.2, 0.1);
 
-    // Corner pockets
-    drawCircle(-1.4, 0.52, -0.7, pocketRadius, pocketDepth, 0.0, 0.0, 0.0); // Bottom-left
-    drawCircle(1.4, 0.52, -0.7, pocketRadius, pocketDepth, 0.0, 0.0, 0.0);  // Bottom-right
-    drawCircle(-1.4, 0.52, 0.7, pocketRadius, pocketDepth, 0.0, 0.0, 0.0);  // Top-left
-    drawCircle(1.4, 0.52, 0.7, pocketRadius, pocketDepth, 0.0, 0.0, 0.0);   // Top-right
-
-    // Side pockets
-    drawCircle(0.0, 0.52, -0.7, pocketRadius, pocketDepth, 0.0, 0.0, 0.0);  // Bottom-center
-    drawCircle(0.0, 0.52, 0.7, pocketRadius, pocketDepth, 0.0, 0.0, 0.0);   // Top-center
+    // Pockets
+    for(int p = 0;p < table.pocketCount;p++) {
+        const PocketDef& pocket = table.pockets[p];
+        drawCircle(pocket.x, pocket_top, pocket.z, pocket.radius, pocketDepth, 0.0, 0.0, 0.0);
+    }
 }
 
-// Function to handle mouse movement
-void mouseMotion(int x, int y) {
-    float deltaX = (screen_width/2 - x) * camera.cameraSensitivity; // Calculate the change in mouse position
-    float deltaY = (screen_height/2 - y) * camera.cameraSensitivity + 0.004;
+// Function to handle mouse movement, dx and dy in pixels
+void mouseMotion(float dx, float dy) {
+    float deltaX = -dx * camera.cameraSensitivity; // Turn the pointer movement into angles
+    float deltaY = -dy * camera.cameraSensitivity;
 
     // Vector to rotate
     glm::vec3 vector(camera.look.x, camera.look.y, camera.look.z);
@@ -306,6 +261,10 @@ void mouseMotion(int x, int y) {
 // Function to handle the camera movement based on input
 void handleKeys() {
     if (keys[27]) { // Escape key to exit
+        sim.stop(); // finishes the recording, if any
+        if(!shotCachePath.empty() && !shotCache.save(shotCachePath)) {
+            std::cerr << "Can't write " << shotCachePath << std::endl;
+        }
         exit(0);
     }
 
@@ -343,45 +302,6 @@ void handleKeys() {
     }
 }
 
-// Function to reposition the mouse to the center of the screen
-void recenterMouse(Display* display, Window root) {
-    // Get screen dimensions
-    Screen* screen = DefaultScreenOfDisplay(display);
-    int screenWidth = screen->width;
-    int screenHeight = screen->height;
-
-    // Center coordinates
-    float centerX = screenWidth / 2.0;
-    float centerY = screenHeight / 2.0;
-
-    // Move the mouse cursor to the center of the screen
-    XWarpPointer(display, None, root, 0, 0, 0, 0, centerX, centerY);
-
-    // Ensure the command is executed
-    XFlush(display);
-}
-
-void timer(int value) {
-    // Open a connection to the X server
-    Display* display = XOpenDisplay(NULL);
-    if (!display) {
-        std::cerr << "Unable to open X display" << std::endl;
-        exit(1);
-    }
-
-    // Get the root window
-    Window root = DefaultRootWindow(display);
-
-    // Recenter the mouse
-    recenterMouse(display, root);
-
-    // Close the display connection
-    XCloseDisplay(display);
-
-    // Set the timer again for periodic updates (optional)
-    glutTimerFunc(1000 / 60, timer, 0); // Call every 1000 ms (1 second)
-}
-
 // Function to render the platform
 void renderPlatform() {
     glBegin(GL_QUADS); // Start drawing a quadrilateral (platform)
@@ -442,109 +362,163 @@ void drawAimDot() {
     glEnable(GL_DEPTH_TEST);    // Re-enable depth testing
 }
 
-void swap(glm::vec3 &s1, glm::vec3 &s2) {
-    glm::vec3 temp = s1;
-    s1 = s2;
-    s2 = temp;
-}
+// Line from the cue ball along the suggested shot, longer for harder shots
+void drawHint() {
+    if(!hintShown || !shownBalls.isActive(0)) return;
 
-void checkWallCollisions(Ball& ball) {
-    if (ball.position.x - ball.radius < -table_width / 2 || ball.position.x + ball.radius > table_width / 2) {
-        ball.velocity.x *= -1;
-    }
+    float length = 0.2f + 5.0f * hint.strength;
+    glm::vec3 from(shownBalls.x[0], shownBalls.y[0], shownBalls.z[0]);
+    glm::vec3 to = from + hint.direction * length;
 
-    if (ball.position.z - ball.radius < -table_height / 2 || ball.position.z + ball.radius > table_height / 2) {
-        ball.velocity.z *= -1;
-    }
+    glLineWidth(2.0f);
+    glColor3f(1.0f, 1.0f, 0.0f);
+    glBegin(GL_LINES);
+    glVertex3f(from.x, from.y, from.z);
+    glVertex3f(to.x, to.y, to.z);
+    glEnd();
 }
 
-void checkBallCollisions(Ball& b1, Ball& b2) {
-    glm::vec3 delta = b1.position - b2.position;
-    float dist = glm::length(delta);
-
-    if (dist < b1.radius + b2.radius) {
-        glm::vec3 collisionNormal = glm::normalize(delta);
-        glm::vec3 relativeVelocity = b1.velocity - b2.velocity;
-
-        float velocityAlongNormal = glm::dot(relativeVelocity, collisionNormal);
-        if (velocityAlongNormal > 0) return;
-
-        float restitution = 1.0f;
-        float impulse = (1 + restitution) * velocityAlongNormal;
-        impulse /= 1 / b1.radius + 1 / b2.radius;
-
-        glm::vec3 impulseVector = impulse * collisionNormal;
-        b1.velocity -= impulseVector / b1.radius;
-        b2.velocity += impulseVector / b2.radius;
+// Rolling min/avg/p99 of every profiled stage over the last two seconds,
+// top left. The numbers are refreshed four times a second.
+void drawProfileHud() {
+    static std::vector<std::string> lines;
+    static int lastUpdate = -1000;
+    int now = glutGet(GLUT_ELAPSED_TIME);
+    if(now - lastUpdate >= 250) {
+        lastUpdate = now;
+        lines.clear();
+#ifdef BILLIARDS_PROFILE
+        lines.push_back("stage                   min     avg     p99  ms");
+        for(const ProfileStat& stat : profiler.stats(2000000000ull)) {
+            char line[128];
+            std::string name = std::string(profiler.threadName(stat.thread)) + "/" + stat.name;
+            snprintf(line, sizeof(line), "%-22.22s %6.3f  %6.3f  %6.3f", name.c_str(), stat.minMs, stat.avgMs, stat.p99Ms);
+            lines.push_back(line);
+        }
+#else
+        lines.push_back("profiling compiled out (BILLIARDS_PROFILE)");
+#endif
     }
-}
 
-void checkPocketCollisions(Ball& ball) {
-    if(distance(glm::vec2(ball.position.x, ball.position.z), glm::vec2(1.4, 0.7)) < (pocketRadius/2.0 + ball.radius)) {
-        ball.active = false;
-    }
-    if(distance(glm::vec2(ball.position.x, ball.position.z), glm::vec2(-1.4, 0.7)) < (pocketRadius/2.0 + ball.radius)) {
-        ball.active = false;
-    }
-    if(distance(glm::vec2(ball.position.x, ball.position.z), glm::vec2(1.4, -0.7)) < (pocketRadius/2.0 + ball.radius)) {
-        ball.active = false;
-    }
-    if(distance(glm::vec2(ball.position.x, ball.position.z), glm::vec2(-1.4, -0.7)) < (pocketRadius/2.0 + ball.radius)) {
-        ball.active = false;
-    }
+    int width = glutGet(GLUT_WINDOW_WIDTH), height = glutGet(GLUT_WINDOW_HEIGHT);
+    glDisable(GL_DEPTH_TEST);
 
-    if(distance(glm::vec2(ball.position.x, ball.position.z), glm::vec2(0.0, -0.7)) < (pocketRadius/2.0 + ball.radius)) {
-        ball.active = false;
-    }
-    if(distance(glm::vec2(ball.position.x, ball.position.z), glm::vec2(0.0, 0.7)) < (pocketRadius/2.0 + ball.radius)) {
-        ball.active = false;
+    // Pixel coordinates, same save and restore as drawAimDot()
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    gluOrtho2D(0.0, width, 0.0, height);
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+
+    glColor3f(1.0f, 1.0f, 0.0f);
+    for(size_t i = 0;i < lines.size();i++) {
+        glRasterPos2i(10, height - 20 - 15 * int(i));
+        for(char c : lines[i]) glutBitmapCharacter(GLUT_BITMAP_8_BY_13, c);
     }
 
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    glEnable(GL_DEPTH_TEST);
 }
 
-void update() {
-    for(int i = 0;i < balls_count;i++) {
-        if(!balls[i].active) continue;
+void swap(glm::vec3 &s1, glm::vec3 &s2) {
+    glm::vec3 temp = s1;
+    s1 = s2;
+    s2 = temp;
+}
 
-        checkWallCollisions(balls[i]);
-        checkPocketCollisions(balls[i]);
-        for(int j = i + 1;j < balls_count;j++) {
-            if(!balls[j].active) continue;
+// Puts the renderer's culling counts in the window title, twice a second
+void showStats() {
+    static int lastShown = 0;
+    int now = glutGet(GLUT_ELAPSED_TIME);
+    if(now - lastShown < 500) return;
+    lastShown = now;
 
-            checkBallCollisions(balls[i], balls[j]);
-        }
+    char title[128], speed[32] = "";
+    if(simSpeed != 1) snprintf(speed, sizeof(speed), " - %gx", simSpeed);
+    if(retainedMode) {
+        snprintf(title, sizeof(title), "8 Ball Pool - drawn %d, culled %d, ball draws %d%s",
+                 renderer.stats.drawn, renderer.stats.culled, renderer.stats.ballDrawCalls, speed);
+    }
+    else {
+        snprintf(title, sizeof(title), "8 Ball Pool - immediate mode%s", speed);
     }
+    glutSetWindowTitle(title);
 }
 
 // Display callback function
 void display() {
-    update();
-    
+    PROFILE_SCOPE("display");
+
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // Clear the screen
 
     glLoadIdentity(); // Reset transformations
     
-    // Set the camera position using gluLookAt (eye position, center, up direction)
-    gluLookAt(camera.position.x, camera.position.y, camera.position.z, // Camera position (x, y, z)
-              camera.position.x + camera.look.x, camera.position.y + camera.look.y, camera.position.z + camera.look.z,  // Look at a point 1 unit in front of the camera
-              camera.up.x, camera.up.y, camera.up.z); // Up direction (y-axis)
+    loadCamera(camera); // gluLookAt from the camera position and direction
 
     // drawLightSphere();
-    
-    // Render the platform
-    renderPlatform();
 
-    // Draw the table
-    drawTable();
+    {
+        PROFILE_SCOPE("interpolate");
+        if(spectator) {
+            if(spectator->isOpen() && spectator->poll() < 0) std::cerr << "Spectator stream closed" << std::endl;
+            spectator->table(spectatedTable, shownBalls);
+        }
+        else {
+            const SimSnapshot& snapshot = sim.latest();
+            snapshot.interpolate(shownBalls, snapshot.alphaAt(SimSnapshot::Clock::now()));
+        }
+    }
 
-    for(int i = 0;i < balls_count;i++) {
-        if(!balls[i].active) continue;
+    if(retainedMode) {
+        renderer.beginFrame();
+        renderer.setEye(camera.position);
+        {
+            PROFILE_SCOPE("drawPlatform");
+            renderer.drawPlatform();
+        }
+        {
+            PROFILE_SCOPE("drawTable");
+            renderer.drawTable();
+        }
+        {
+            PROFILE_SCOPE("drawBalls");
+            renderer.drawBalls(shownBalls);
+        }
+    }
+    else {
+        {
+            PROFILE_SCOPE("drawPlatform");
+            renderPlatform(); // Render the platform
+        }
+        {
+            PROFILE_SCOPE("drawTable");
+            drawTable(); // Draw the table
+        }
 
-        balls[i].drawColoredSphere();
+        {
+            PROFILE_SCOPE("drawBalls");
+            for(int i = 0;i < shownBalls.count;i++) {
+                if(!shownBalls.isActive(i)) continue;
+
+                drawColoredSphere(shownBalls.get(i));
+            }
+        }
     }
 
-    drawAimDot();
+    {
+        PROFILE_SCOPE("overlay");
+        drawHint();
+        drawAimDot();
+        if(showProfile) drawProfileHud();
+        showStats();
+    }
 
+    PROFILE_SCOPE("glutSwapBuffers");
     glutSwapBuffers(); // Swap buffers to display the rendered scene
 }
 
@@ -554,27 +528,16 @@ void init() {
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f); // Set background color to black
     // setupLighting();
 
-    balls[0] = Ball(0.05, 1.0, 1.0, 1.0, 2.0 + (-1.15), 0.55, 1.0 + (-1.0));
-
-    balls[1] = Ball(0.05, 1.0, 0.0, 0.0, 1.0 + (-1.7), 0.55, 1.0 + (-1.0));
-    balls[2] = Ball(0.05, 1.0, 0.0, 0.0, 1.0 + (-1.7), 0.55, 1.1 + (-1.0));
-    balls[3] = Ball(0.05, 1.0, 0.0, 0.0, 1.0 + (-1.7), 0.55, 0.9 + (-1.0));
-    balls[4] = Ball(0.05, 1.0, 0.0, 0.0, 1.0 + (-1.7), 0.55, 1.2 + (-1.0));
-    balls[5] = Ball(0.05, 1.0, 0.0, 0.0, 1.0 + (-1.7), 0.55, 0.8 + (-1.0));
-
-    balls[6] = Ball(0.05, 1.0, 0.0, 0.0, 1.1 + (-1.7) - (0.0134 * 1), 0.55, 1.05 + (-1.0));
-    balls[7] = Ball(0.05, 1.0, 0.0, 0.0, 1.1 + (-1.7) - (0.0134 * 1), 0.55, 1.15 + (-1.0));
-    balls[9] =  Ball(0.05, 1.0, 0.0, 0.0, 1.1 + (-1.7) - (0.0134 * 1), 0.55, 0.95 + (-1.0));
-    balls[10] = Ball(0.05, 1.0, 0.0, 0.0, 1.1 + (-1.7) - (0.0134 * 1), 0.55, 0.85 + (-1.0));
-    
-    balls[8] =  Ball(0.05, 0.0, 0.0, 0.0, 1.2 + (-1.7) - (0.0134 * 2), 0.55, 1.0 + (-1.0));
-    balls[11] = Ball(0.05, 1.0, 0.0, 0.0, 1.2 + (-1.7) - (0.0134 * 2), 0.55, 1.1 + (-1.0));
-    balls[12] = Ball(0.05, 1.0, 0.0, 0.0, 1.2 + (-1.7) - (0.0134 * 2), 0.55, 0.9 + (-1.0));
+    renderer.init(*sim.world.table); // Upload the static meshes once
+    if(renderer.bakedLighting) {
+        const BakeStats& baked = renderer.bakeStats;
+        if(baked.fromCache) std::cout << "Lighting: " << baked.vertices << " vertices from the cache" << std::endl;
+        else std::cout << "Lighting: baked " << baked.vertices << " vertices, " << baked.rays << " rays in " << baked.seconds << " s" << std::endl;
+    }
 
-    balls[13] = Ball(0.05, 1.0, 0.0, 0.0, 1.3 + (-1.7) - (0.0134 * 3), 0.55, 1.05 + (-1.0));
-    balls[14] = Ball(0.05, 1.0, 0.0, 0.0, 1.3 + (-1.7) - (0.0134 * 3), 0.55, 0.95 + (-1.0));
-    
-    balls[15] = Ball(0.05, 1.0, 0.0, 0.0, 1.4 + (-1.7) - (0.0134 * 4), 0.55, 1.00 + (-1.0));
+    if(spectator) return;
+    sim.world.rack();
+    sim.start();
 }
 
 // Function to handle window resizing
@@ -582,66 +545,258 @@ void reshape(int w, int h) {
     glViewport(0, 0, w, h); // Set the viewport size
     glMatrixMode(GL_PROJECTION); // Switch to projection matrix
     glLoadIdentity(); // Reset projection matrix
-    gluPerspective(45.0f, (double)w / (double)h, 1.0f, 100.0f); // Set the perspective view
+    gluPerspective(fov_y, (double)w / (double)h, 1.0f, 100.0f); // Set the perspective view
+    renderer.setProjection(fov_y, h); // Level of detail goes by on-screen size
     glMatrixMode(GL_MODELVIEW); // Switch back to modelview matrix
 }
 
 // Keyboard input callback (key press)
-void keyboard(unsigned char key, int x, int y) {
-    keys[key] = true;
+void keyboard(unsigned char key, int, int) {
+    input->glutKey(key, true);
 }
 
 // Keyboard input callback (key release)
-void keyboardUp(unsigned char key, int x, int y) {
-    keys[key] = false;
+void keyboardUp(unsigned char key, int, int) {
+    input->glutKey(key, false);
 }
 
-// Idle callback to handle continuous movement
-void idle() {
-    // updateCamera();
-    handleKeys();  // Update the camera position based on input
-    glutPostRedisplay();  // Request a redraw to update the scene
+void mouse(int button, int state, int, int) {
+    // Detect left mouse button press/release
+    if (button == GLUT_LEFT_BUTTON) {
+        input->glutButton(state == GLUT_DOWN);
+    }
+}
 
-    bool noMovement = true;
-    for(int i = 0;i < 16;i++) {
-        if(distance(balls[i].velocity) > 1e-6) {
-            noMovement = false;
-        }
+void findHint() {
+    if(hintShown) {
+        hintShown = false;
+        return;
+    }
+    if(spectator) return;
+
+    const SimSnapshot& snapshot = sim.latest();
+    if(!snapshot.atRest) return;
 
-        balls[i].move();
+    if(!shotSearch) {
+        shotSearch.reset(new ShotSearch());
+        shotSearch->cache = &shotCache;
     }
+    World table;
+    table.mode = sim.world.mode; // fixed before the sim thread started
+    table.table = sim.world.table;
+    table.balls = snapshot.balls;
 
-    float limit = 0.1, inc = 0.00025;
-    if(noMovement && isMousePressed) {
-        strength += inc;
-        if(strength > limit) {
-            strength = limit;
+    ShotSearchOptions options;
+    options.maxStrength = SimThread::max_strength;
+    ShotSearchResult result = shotSearch->search(table, options);
+    if(result.best.empty()) return;
+
+    hint = result.best[0];
+    hintShown = true;
+    ShotCacheStats cached = shotCache.stats();
+    std::cout << "Hint: " << hint.pocketed << " pocketed" << (hint.scratch ? ", scratch" : "") << ", strength "
+              << hint.strength << " (" << result.evaluated << " shots in " << result.seconds * 1000 << " ms, cache "
+              << cached.entries << " entries, " << cached.hitRate() * 100 << "% hits, " << cached.evictions << " evicted)" << std::endl;
+}
+
+void setSpeed(double speed) {
+    simSpeed = std::min(SimThread::max_speed, std::max(SimThread::min_speed, speed));
+    SimCommand command = {SimCommandType::SetSpeed};
+    command.speed = simSpeed;
+    sim.send(command);
+}
+
+void keyPressed(unsigned char key) {
+    keys[key] = true;
+
+    if(key == 'r') {
+        retainedMode = !retainedMode;
+    }
+    if(key == 'i') {
+        renderer.instancingEnabled = !renderer.instancingEnabled;
+    }
+    if(key == 'l') {
+        renderer.lodEnabled = !renderer.lodEnabled;
+    }
+    if(key == 'c') {
+        renderer.cullingEnabled = !renderer.cullingEnabled;
+    }
+    if(key == 'o') {
+        renderer.ballShadows = !renderer.ballShadows;
+    }
+    // The sim clock, which doesn't run while spectating
+    if(!spectator) {
+        if(key == '+' || key == '=') {
+            setSpeed(simSpeed * 2);
         }
+        if(key == '-') {
+            setSpeed(simSpeed / 2);
+        }
+        if(key == '0') {
+            setSpeed(1);
+        }
+        if(key == 'k') {
+            sim.send({SimCommandType::SkipToRest});
+        }
+    }
+    if(key == 'p') {
+        showProfile = !showProfile;
+    }
+    if(key == 'h') {
+        findHint();
+    }
+    if(key == 't') {
+        if(profiler.writeTrace("trace.json")) std::cout << "Wrote trace.json" << std::endl;
+        else std::cerr << "Can't write trace.json" << std::endl;
     }
-    else strength = 0;
+}
 
+void buttonReleased() {
+    // Shoot if the cue ball is under the aim dot
+    Ball cue = sim.latest().balls.get(0);
+    float dist = distance(cue.position, projectPointOntoLine(cue.position, camera.position, camera.look));
+    if(dist < cue.radius) {
+        sim.send({SimCommandType::Shoot, camera.getPropperVector()});
+        hintShown = false;
+    }
+    else {
+        sim.send({SimCommandType::CancelCharge});
+    }
 }
 
-void mouse(int button, int state, int x, int y) {
-    // Detect left mouse button press/release
-    if (button == GLUT_LEFT_BUTTON) {
-        if (state == GLUT_DOWN) {
-            isMousePressed = true; // Mouse is pressed
-        } else if (state == GLUT_UP) {
-            isMousePressed = false; // Mouse is released
-            
-            float dist = distance(balls[0].position, projectPointOntoLine(balls[0].position, camera.position, camera.look));
-            if(dist < balls[0].radius) {
-                balls[0].setMovement(camera.getPropperVector() * strength);
-            }
+// Apply this frame's input from the backend
+void handleInput() {
+    inputEvents.clear();
+    input->poll(inputEvents);
+
+    for(const InputEvent& event : inputEvents) {
+        switch(event.type) {
+        case InputEventType::KeyDown:
+            keyPressed(event.key);
+            break;
+        case InputEventType::KeyUp:
+            keys[event.key] = false;
+            break;
+        case InputEventType::Motion:
+            mouseMotion(event.dx, event.dy);
+            break;
+        case InputEventType::ButtonDown:
+            if(spectator) break; // nothing to shoot at
+            sim.send({SimCommandType::StartCharge}); // start charging the shot
+            break;
+        case InputEventType::ButtonUp:
+            if(!spectator) buttonReleased();
+            break;
         }
     }
 }
 
+// Idle callback to handle continuous movement
+void idle() {
+    PROFILE_SCOPE("idle");
+
+    // updateCamera();
+    {
+        PROFILE_SCOPE("handleInput");
+        handleInput();
+    }
+    handleKeys();  // Update the camera position based on input
+    glutPostRedisplay();  // Request a redraw to update the scene
+}
+
+int verifyReplay(const std::string& path) {
+    ReplayReader reader;
+    if(!reader.open(path)) {
+        std::cerr << "Can't read replay " << path << std::endl;
+        return 1;
+    }
+
+    long mismatch = reader.verify();
+    std::cout << path << ": " << reader.endTick() - reader.firstTick() << " ticks, " << reader.shotCount()
+              << " shots, " << reader.keyframeCount() << " keyframes, " << reader.checksumCount() << " checksums" << std::endl;
+    if(mismatch == -2) {
+        std::cout << "recorded with the " << reader.scalar() << " physics scalar, this build uses " << physics_scalar_name << std::endl;
+        return 3;
+    }
+    if(mismatch >= 0) {
+        std::cout << "diverges at tick " << mismatch << std::endl;
+        return 2;
+    }
+    std::cout << "matches" << std::endl;
+    return 0;
+}
+
 // Main function
 int main(int argc, char** argv) {
+    // Headless: re-simulate a recording as fast as possible and check it
+    bool recordOrReplay = false, customTable = false;
+    for(int i = 1;i < argc;i++) {
+        std::string arg = argv[i];
+        if(arg.compare(0, 16, "--verify-replay=") == 0) return verifyReplay(arg.substr(16));
+        recordOrReplay |= arg.compare(0, 9, "--record=") == 0 || arg.compare(0, 9, "--replay=") == 0;
+        customTable |= arg.compare(0, 13, "--table-file=") == 0;
+    }
+    // Recordings don't carry the table, they always play on the standard one
+    if(recordOrReplay && customTable) {
+        std::cerr << "--record and --replay only work on the standard table, not with --table-file" << std::endl;
+        return 1;
+    }
+
     // Initialize GLUT
     glutInit(&argc, argv);
+    PROFILE_THREAD("render");
+
+    std::string inputSpec = "x11", rackName;
+    double speedArg = 1;
+    for(int i = 1;i < argc;i++) {
+        std::string arg = argv[i];
+        if(arg.compare(0, 8, "--input=") == 0) inputSpec = arg.substr(8);
+        if(arg.compare(0, 9, "--record=") == 0) {
+            if(!recorder.open(arg.substr(9), sim.world.mode)) {
+                std::cerr << "Can't write " << arg.substr(9) << std::endl;
+                return 1;
+            }
+            sim.recorder = &recorder;
+        }
+        if(arg == "--record-checksums") recorder.checksumTicks = true;
+        if(arg == "--flat") renderer.bakedLighting = false;
+        if(arg.compare(0, 8, "--speed=") == 0) speedArg = atof(arg.c_str() + 8);
+        if(arg.compare(0, 9, "--replay=") == 0) {
+            if(!replay.open(arg.substr(9))) {
+                std::cerr << "Can't read replay " << arg.substr(9) << std::endl;
+                return 1;
+            }
+            sim.playback = &replay;
+        }
+        if(arg.compare(0, 11, "--spectate=") == 0) {
+            spectator.reset(new SpectatorClient());
+            if(!spectator->connect(arg.substr(11))) {
+                std::cerr << "Can't connect to " << arg.substr(11) << ": " << strerror(errno) << std::endl;
+                return 1;
+            }
+        }
+        if(arg.compare(0, 8, "--table=") == 0) spectatedTable = atoi(arg.c_str() + 8);
+        if(arg.compare(0, 13, "--table-file=") == 0 && !tableAsset.load(arg.substr(13))) return 1;
+        if(arg.compare(0, 7, "--rack=") == 0) rackName = arg.substr(7);
+        if(arg.compare(0, 13, "--shot-cache=") == 0) {
+            shotCachePath = arg.substr(13);
+            FILE* existing = fopen(shotCachePath.c_str(), "rb");
+            if(existing) {
+                fclose(existing);
+                if(!shotCache.load(shotCachePath)) std::cerr << "Ignoring unreadable shot cache " << shotCachePath << std::endl;
+            }
+        }
+    }
+    if(speedArg != 1 && !spectator) setSpeed(speedArg);
+    if(!sim.world.setTable(tableAsset.isOpen() ? tableAsset.table() : standard_table, rackName.empty() ? nullptr : rackName.c_str())) {
+        std::cerr << "The table has no rack " << rackName << std::endl;
+        return 1;
+    }
+    input = createInputBackend(inputSpec);
+    if(!input) {
+        std::cerr << "Unknown or unreadable input '" << inputSpec << "'" << std::endl;
+        return 1;
+    }
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
     glutInitWindowSize(screen_width, screen_height);  // Set initial window size
     glutCreateWindow("8 Ball Pool");
@@ -659,11 +814,7 @@ int main(int argc, char** argv) {
     glutKeyboardFunc(keyboard);
     glutKeyboardUpFunc(keyboardUp);
     glutIdleFunc(idle);
-    glutMotionFunc(mouseMotion);  // Register mouse motion callback
-    glutPassiveMotionFunc(mouseMotion);  // Also capture passive mouse movement
-    glutMouseFunc(mouse);
-
-    glutTimerFunc(0, timer, 0); // Set a timer to periodically reposition the cursor
+    glutMouseFunc(mouse); // Pointer motion comes from the input backend
 
     // Start the GLUT main loop
     glutMainLoop();
@@ -673,7 +824,10 @@ int main(int argc, char** argv) {
 
 
 // g++ -I/usr/include/glm -I/usr/include/GL tester.cpp -o test -Lls /usr/lib/libglut.so -lGL -lGLU -lglut -lX11
-// g++ main.cpp -o main -lGL -lGLU -lglut -lX11 && ./main
+// cmake -S . -B build && cmake --build build && ./build/billiards
+// or by hand:
+// g++ -ffp-contract=off main.cpp physics.cpp table_def.cpp ball_set.cpp collision_kernel.cpp event_solver.cpp motion.cpp broadphase.cpp mesh.cpp lightmap.cpp renderer.cpp lod.cpp frustum.cpp sim_thread.cpp input.cpp replay.cpp spectator.cpp profiler.cpp thread_pool.cpp shot_search.cpp shot_cache.cpp -DBILLIARDS_PROFILE -o main -pthread -lGL -lGLU -lglut -lX11 && ./main
+// add -DBILLIARDS_XINPUT2 -lXi for raw mouse motion
 
 
 
@@ -0,0 +1,281 @@
+#include "mesh.h"
+#include "physics.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <iterator>
+#include <unordered_map>
+
+extern const glm::vec2 legs[legs_count] = {
+    {leg_positions[0][0], leg_positions[0][1]}, {leg_positions[1][0], leg_positions[1][1]},
+    {leg_positions[2][0], leg_positions[2][1]}, {leg_positions[3][0], leg_positions[3][1]}
+};
+
+constexpr Rgb wood = {0.4, 0.2, 0.0}, cloth = {0.0, 0.5, 0.0};
+constexpr Rgb leg_color = {0.3, 0.2, 0.1}, pocket_color = {0.0, 0.0, 0.0};
+
+// Lamp bar, cloth and one rail behind each cushion: 2 + cushionCount boxes
+template<class M>
+constexpr void meshTableBody(M& mesh, const TableDef& table) {
+    // lights
+    meshBox(mesh, -1.12, 1.6, -0.2, 2.24, 0.5, 0.2, wood);
+
+    // Table Base
+    meshBox(mesh, table.minX, table_surface, table.minZ, table.width(), table.height(), 0.1, cloth);
+
+    // Rails
+    for(int i = 0;i < table.cushionCount;i++) {
+        RailRect rail = railRect(table, i);
+        meshBox(mesh, rail.x, rail_top, rail.z, rail.width, rail.depth, rail_height, wood);
+    }
+}
+
+constexpr int standard_body_boxes = 2 + std::size(standard_cushions);
+
+constexpr StaticMesh<standard_body_boxes * box_vertices, standard_body_boxes * box_indices> makeTableBody() {
+    StaticMesh<standard_body_boxes * box_vertices, standard_body_boxes * box_indices> mesh;
+    meshTableBody(mesh, standard_table);
+    return mesh;
+}
+
+template<int Slices>
+using LegMesh = StaticMesh<cylinderVertices(Slices), cylinderIndices(Slices)>;
+
+template<int Slices>
+constexpr std::array<LegMesh<Slices>, legs_count> makeLegs() {
+    std::array<LegMesh<Slices>, legs_count> meshes = {};
+    for(int leg = 0;leg < legs_count;leg++) {
+        meshCylinder(meshes[leg], leg_positions[leg][0], leg_top, leg_positions[leg][1], leg_radius, leg_height, leg_color,
+                     unit_circle<Slices>.cosines, unit_circle<Slices>.sines, Slices);
+    }
+    return meshes;
+}
+
+template<int Segments>
+using PocketMesh = StaticMesh<pocketVertices(Segments), pocketIndices(Segments)>;
+
+template<int Segments>
+constexpr std::array<PocketMesh<Segments>, 6> makePockets() {
+    std::array<PocketMesh<Segments>, 6> meshes = {};
+    for(int p = 0;p < 6;p++) {
+        const PocketDef& pocket = standard_pockets[p];
+        meshPocket(meshes[p], pocket.x, pocket_top, pocket.z, pocket.radius, pocketDepth, pocket_color,
+                   unit_circle<Segments>.cosines, unit_circle<Segments>.sines, Segments);
+    }
+    return meshes;
+}
+
+// The standard table at the segment counts in round_lod_segments, in read-only data
+static constexpr auto table_body = makeTableBody();
+// Sized exactly, so unused room can't upload as degenerate zero vertices
+static_assert(table_body.vertexCount == std::size(table_body.vertices) && table_body.indexCount == std::size(table_body.indices));
+template<int Slices>
+static constexpr auto leg_meshes = makeLegs<Slices>();
+template<int Segments>
+static constexpr auto pocket_meshes = makePockets<Segments>();
+
+// Circle table for a segment count: the compile time ones used by the LOD
+// tiers and the spheres' stacks, anything else is computed into scratch
+struct CircleRef {
+    const float* cosines;
+    const float* sines;
+};
+
+static CircleRef circleFor(int segments, std::vector<float>& scratch) {
+    switch(segments) {
+    case 6: return {unit_circle<6>.cosines, unit_circle<6>.sines};
+    case 8: return {unit_circle<8>.cosines, unit_circle<8>.sines};
+    case 12: return {unit_circle<12>.cosines, unit_circle<12>.sines};
+    case 16: return {unit_circle<16>.cosines, unit_circle<16>.sines};
+    case 24: return {unit_circle<24>.cosines, unit_circle<24>.sines};
+    case 32: return {unit_circle<32>.cosines, unit_circle<32>.sines};
+    case 48: return {unit_circle<48>.cosines, unit_circle<48>.sines};
+    case 50: return {unit_circle<50>.cosines, unit_circle<50>.sines};
+    case 100: return {unit_circle<100>.cosines, unit_circle<100>.sines};
+    }
+
+    scratch.resize(2 * (segments + 1));
+    for(int i = 0;i <= segments;i++) {
+        float angle = 2.0f * M_PI * i / segments;
+        scratch[i] = cosf(angle);
+        scratch[segments + 1 + i] = sinf(angle);
+    }
+    return {scratch.data(), scratch.data() + segments + 1};
+}
+
+static Rgb rgb(glm::vec3 color) {
+    return {color.x, color.y, color.z};
+}
+
+uint32_t Mesh::addVertex(glm::vec3 position, glm::vec3 normal, glm::vec3 color) {
+    return addVertex({position.x, position.y, position.z, normal.x, normal.y, normal.z, color.x, color.y, color.z});
+}
+
+uint32_t Mesh::addVertex(const Vertex& v) {
+    vertices.push_back(v);
+    return uint32_t(vertices.size() - 1);
+}
+
+void Mesh::addTriangle(uint32_t a, uint32_t b, uint32_t c) {
+    indices.push_back(a);
+    indices.push_back(b);
+    indices.push_back(c);
+}
+
+void Mesh::addQuad(glm::vec3 a, glm::vec3 b, glm::vec3 c, glm::vec3 d, glm::vec3 normal, glm::vec3 color) {
+    uint32_t ia = addVertex(a, normal, color);
+    uint32_t ib = addVertex(b, normal, color);
+    uint32_t ic = addVertex(c, normal, color);
+    uint32_t id = addVertex(d, normal, color);
+    addTriangle(ia, ib, ic);
+    addTriangle(ia, ic, id);
+}
+
+void Mesh::clear() {
+    vertices.clear();
+    indices.clear();
+}
+
+void addBox(Mesh& mesh, float x, float y, float z, float width, float depth, float height, glm::vec3 color) {
+    meshBox(mesh, x, y, z, width, depth, height, rgb(color));
+}
+
+void addCylinder(Mesh& mesh, float x, float y, float z, float radius, float height, glm::vec3 color, int slices) {
+    std::vector<float> scratch;
+    CircleRef circle = circleFor(slices, scratch);
+    meshCylinder(mesh, x, y, z, radius, height, rgb(color), circle.cosines, circle.sines, slices);
+}
+
+void addPocket(Mesh& mesh, float x, float y, float z, float radius, float depth, glm::vec3 color, int segments) {
+    std::vector<float> scratch;
+    CircleRef circle = circleFor(segments, scratch);
+    meshPocket(mesh, x, y, z, radius, depth, rgb(color), circle.cosines, circle.sines, segments);
+}
+
+void buildPlatformMesh(Mesh& mesh) {
+    mesh.addQuad({-20.0f, 0.0f, -20.0f}, {20.0f, 0.0f, -20.0f}, {20.0f, 0.0f, 20.0f}, {-20.0f, 0.0f, 20.0f},
+                 {0, 1, 0}, {0.6f, 0.6f, 0.6f});
+}
+
+void buildTableMesh(Mesh& mesh, const TableDef& table) {
+    buildTableBodyMesh(mesh, table);
+
+    for(int leg = 0;leg < legs_count;leg++) {
+        buildLegMesh(mesh, leg);
+    }
+
+    // Corner and side pockets, drawn where the physics looks for them
+    for(int p = 0;p < table.pocketCount;p++) {
+        buildPocketMesh(mesh, table.pockets[p]);
+    }
+}
+
+void buildTableBodyMesh(Mesh& mesh, const TableDef& table) {
+    if(&table == &standard_table) mesh.append(table_body);
+    else meshTableBody(mesh, table);
+}
+
+void buildLegMesh(Mesh& mesh, int leg, int slices) {
+    switch(slices) {
+    case 32: mesh.append(leg_meshes<32>[leg]); return;
+    case 16: mesh.append(leg_meshes<16>[leg]); return;
+    case 8: mesh.append(leg_meshes<8>[leg]); return;
+    }
+    addCylinder(mesh, legs[leg].x, leg_top, legs[leg].y, leg_radius, leg_height, glm::vec3(0.3, 0.2, 0.1), slices);
+}
+
+void buildPocketMesh(Mesh& mesh, const PocketDef& pocket, int segments) {
+    // A pocket of the standard table has its meshes prebuilt
+    for(int p = 0;p < 6;p++) {
+        const PocketDef& standard = standard_pockets[p];
+        if(pocket.x != standard.x || pocket.z != standard.z || pocket.radius != standard.radius) continue;
+        switch(segments) {
+        case 32: mesh.append(pocket_meshes<32>[p]); return;
+        case 16: mesh.append(pocket_meshes<16>[p]); return;
+        case 8: mesh.append(pocket_meshes<8>[p]); return;
+        }
+    }
+    addPocket(mesh, pocket.x, pocket_top, pocket.z, pocket.radius, pocketDepth, glm::vec3(0.0, 0.0, 0.0), segments);
+}
+
+void buildSphereMesh(Mesh& mesh, int slices, int stacks) {
+    if(slices == stacks) {
+        switch(slices) {
+        case 50: mesh.append(sphere_mesh<50, 50>); return;
+        case 24: mesh.append(sphere_mesh<24, 24>); return;
+        case 12: mesh.append(sphere_mesh<12, 12>); return;
+        case 6: mesh.append(sphere_mesh<6, 6>); return;
+        }
+    }
+
+    std::vector<float> ringScratch, scratch;
+    CircleRef rings = circleFor(2 * stacks, ringScratch);
+    CircleRef circle = circleFor(slices, scratch);
+    meshSphere(mesh, rings.cosines, rings.sines, stacks, circle.cosines, circle.sines, slices);
+}
+
+void subdivideMesh(Mesh& mesh, float maxEdge, float farScale) {
+    std::unordered_map<uint64_t, uint32_t> midpoints;
+    std::vector<uint32_t> out;
+
+    // Index of the midpoint of edge a b, -1 while the edge is short enough
+    auto split = [&](uint32_t a, uint32_t b) -> int64_t {
+        if(a > b) std::swap(a, b);
+        Vertex va = mesh.vertices[a], vb = mesh.vertices[b];
+        glm::vec3 pa(va.x, va.y, va.z), pb(vb.x, vb.y, vb.z);
+        glm::vec3 mid = 0.5f * (pa + pb);
+        float limit = std::max(maxEdge, maxEdge * farScale * sqrtf(mid.x * mid.x + mid.z * mid.z));
+        if(glm::length(pb - pa) <= limit) return -1;
+
+        auto found = midpoints.find(uint64_t(a) << 32 | b);
+        if(found != midpoints.end()) return found->second;
+
+        glm::vec3 normal(va.nx + vb.nx, va.ny + vb.ny, va.nz + vb.nz);
+        float length = glm::length(normal);
+        if(length > 0) normal /= length;
+        uint32_t m = mesh.addVertex(mid, normal, glm::vec3(va.r + vb.r, va.g + vb.g, va.b + vb.b) * 0.5f);
+        midpoints[uint64_t(a) << 32 | b] = m;
+        return m;
+    };
+
+    bool changed = true;
+    while(changed) {
+        changed = false;
+        midpoints.clear();
+        out.clear();
+        for(size_t t = 0;t + 2 < mesh.indices.size();t += 3) {
+            uint32_t v[3] = {mesh.indices[t], mesh.indices[t + 1], mesh.indices[t + 2]};
+            int64_t m[3] = {split(v[0], v[1]), split(v[1], v[2]), split(v[2], v[0])};
+            int splits = (m[0] >= 0) + (m[1] >= 0) + (m[2] >= 0);
+            changed |= splits > 0;
+
+            if(splits == 0) {
+                out.insert(out.end(), v, v + 3);
+            }
+            else if(splits == 3) {
+                uint32_t ab = uint32_t(m[0]), bc = uint32_t(m[1]), ca = uint32_t(m[2]);
+                uint32_t parts[12] = {v[0], ab, ca, ab, v[1], bc, ca, bc, v[2], ab, bc, ca};
+                out.insert(out.end(), parts, parts + 12);
+            }
+            else {
+                // Rotate so edge a b is split and, with two splits, b c too;
+                // the winding stays the same
+                int r = 0;
+                if(splits == 1) while(m[r] < 0) r++;
+                else while(m[r] < 0 || m[(r + 1) % 3] < 0) r++;
+                uint32_t a = v[r], b = v[(r + 1) % 3], c = v[(r + 2) % 3];
+                uint32_t ab = uint32_t(m[r]);
+                if(splits == 1) {
+                    uint32_t parts[6] = {a, ab, c, ab, b, c};
+                    out.insert(out.end(), parts, parts + 6);
+                }
+                else {
+                    uint32_t bc = uint32_t(m[(r + 1) % 3]);
+                    uint32_t parts[9] = {ab, b, bc, a, ab, bc, a, bc, c};
+                    out.insert(out.end(), parts, parts + 9);
+                }
+            }
+        }
+        mesh.indices.swap(out);
+    }
+}
@@ -0,0 +1,111 @@
+#ifndef MESH_H
+#define MESH_H
+
+// CPU side triangle meshes for the static scene. No GL in here, the renderer
+// uploads these once at startup. The geometry itself comes from the constexpr
+// builders in static_mesh.h, the table parts at the LOD segment counts are
+// generated at compile time and only copied here.
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "static_mesh.h"
+#include "table_def.h"
+
+const float pocketDepth = 0.2;
+const float pocket_top = 0.52;
+
+// Table legs: centres on the floor plane (x, z), all the same cylinder
+const int legs_count = 4;
+constexpr float leg_positions[legs_count][2] = {
+    {-1.3, -0.6}, {1.3, -0.6}, {-1.3, 0.6}, {1.3, 0.6}
+};
+extern const glm::vec2 legs[legs_count];
+const float leg_radius = 0.1;
+const float leg_top = 0.49;
+const float leg_height = 0.5;
+
+// Rails: one box behind each cushion
+constexpr float rail_width = 0.1;
+constexpr float rail_top = 0.6;
+constexpr float rail_height = 0.2;
+
+// Top face of the rail behind cushion i of table, x .. x + width, z .. z + depth.
+// Rails along x reach over the corners.
+struct RailRect {
+    float x, z, width, depth;
+};
+
+constexpr RailRect railRect(const TableDef& table, int i) {
+    const CushionDef& c = table.cushions[i];
+    float x0 = c.x0 < c.x1 ? c.x0 : c.x1, x1 = c.x0 < c.x1 ? c.x1 : c.x0;
+    float z0 = c.z0 < c.z1 ? c.z0 : c.z1, z1 = c.z0 < c.z1 ? c.z1 : c.z0;
+    if(z0 == z1) {
+        if(x0 == table.minX) x0 -= rail_width;
+        if(x1 == table.maxX) x1 += rail_width;
+        float z = 2 * z0 < table.minZ + table.maxZ ? z0 - rail_width : z0;
+        return {x0, z, x1 - x0, rail_width};
+    }
+    float x = 2 * x0 < table.minX + table.maxX ? x0 - rail_width : x0;
+    return {x, z0, rail_width, z1 - z0};
+}
+
+// Segments used around pockets and legs
+const int round_segments = 32;
+
+class Mesh {
+public:
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices; // triangle list
+
+    uint32_t addVertex(glm::vec3 position, glm::vec3 normal, glm::vec3 color);
+    uint32_t addVertex(const Vertex& v);
+    void addTriangle(uint32_t a, uint32_t b, uint32_t c);
+    // Two triangles a b c, a c d; all four corners get the same normal
+    void addQuad(glm::vec3 a, glm::vec3 b, glm::vec3 c, glm::vec3 d, glm::vec3 normal, glm::vec3 color);
+
+    // Copy a compile time mesh in, its indices shifted past what is already here
+    template<size_t VertexCount, size_t IndexCount>
+    void append(const StaticMesh<VertexCount, IndexCount>& part) {
+        uint32_t base = uint32_t(vertices.size());
+        vertices.insert(vertices.end(), part.vertices, part.vertices + part.vertexCount);
+        for(size_t i = 0;i < part.indexCount;i++) {
+            indices.push_back(base + part.indices[i]);
+        }
+    }
+
+    void clear();
+};
+
+// Same parameters as the immediate-mode drawRectangle(): the top face is at
+// height y and spans x .. x + width, z .. z + depth, the box goes height down
+void addBox(Mesh& mesh, float x, float y, float z, float width, float depth, float height, glm::vec3 color);
+
+// Same parameters as drawCylinder(): centred on x, z with the top cap at y
+void addCylinder(Mesh& mesh, float x, float y, float z, float radius, float height, glm::vec3 color, int slices = round_segments);
+
+// Same parameters as drawCircle(): a disc at height y with a wall going depth down
+void addPocket(Mesh& mesh, float x, float y, float z, float radius, float depth, glm::vec3 color, int segments = round_segments);
+
+// The grey floor under the table
+void buildPlatformMesh(Mesh& mesh);
+
+// Base, rails, legs, pockets and the lamp bar, same layout as drawTable().
+// The cloth, rails and pockets follow the table description; legs and lamp
+// stay where they are on any table.
+void buildTableMesh(Mesh& mesh, const TableDef& table = standard_table);
+
+// The parts of buildTableMesh(), so round parts can be built per detail level
+void buildTableBodyMesh(Mesh& mesh, const TableDef& table = standard_table); // base, rails and lamp bar
+void buildLegMesh(Mesh& mesh, int leg, int slices = round_segments);
+void buildPocketMesh(Mesh& mesh, const PocketDef& pocket, int segments = round_segments);
+
+// Split triangles until no edge is longer than maxEdge, or than maxEdge times
+// farScale times the distance of its midpoint from the table centre (x, z)
+// where that is more. An edge is split the same way in every triangle that
+// shares it, so the result has no T-junctions. For meshes lit per vertex.
+void subdivideMesh(Mesh& mesh, float maxEdge, float farScale = 0);
+
+// Unit sphere around the origin, vertex colors are white
+void buildSphereMesh(Mesh& mesh, int slices, int stacks);
+
+#endif
@@ -0,0 +1,5 @@
+#include "motion.h"
+
+template MotionPhase motionPhase(const BallMotion& m);
+template BallMotion motionAt(BallMotion m, double t);
+template double timeToRest(const BallMotion& m);
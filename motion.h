@@ -0,0 +1,127 @@
+#ifndef MOTION_H
+#define MOTION_H
+
+// Ball motion on the cloth, in closed form. A ball has a velocity v and a
+// rolling velocity w, the speed its spin would carry it at if it rolled
+// without slipping (spin times radius). Motion goes through up to three
+// phases, each with constant acceleration, so the state at any time is a
+// quadratic in t and can be evaluated directly instead of stepping:
+//
+//   sliding  slip u = v - w != 0. Cloth friction pulls against the slip:
+//            v' = -sliding_deceleration û, w' = 2.5 sliding_deceleration û
+//            (solid sphere), so u shrinks along a fixed direction and
+//            vanishes after |u| / (3.5 sliding_deceleration).
+//   rolling  v = w. Rolling resistance slows the ball by ball_deceleration
+//            along v until it stops after |v| / ball_deceleration.
+//   rest     v = w = 0.
+//
+// Times are in ticks, lengths in table units, like the rest of the physics.
+#include "scalar.h"
+
+// Speed lost by a rolling ball every tick, rolling resistance
+const float ball_deceleration = 0.0000625;
+// Speed lost by a sliding ball every tick, cloth friction (mu 0.2, g in units
+// per tick²)
+const float sliding_deceleration = 0.000545;
+
+// The model is written once for any scalar of scalar.h; BallMotion, in
+// double, is what the continuous solver and the rest of the code use.
+template<class T>
+struct BasicMotion {
+    T x, z;   // position on the table plane
+    T vx, vz; // velocity
+    T wx, wz; // rolling velocity
+};
+
+template<class T>
+struct BasicMotionPhase {
+    T ax, az;   // acceleration of v
+    T wax, waz; // acceleration of w
+    T duration; // until the next phase starts, ScalarLimits<T>::max() at rest
+    bool sliding;
+
+    bool atRest() const { return duration == ScalarLimits<T>::max(); }
+};
+
+typedef BasicMotion<double> BallMotion;
+typedef BasicMotionPhase<double> MotionPhase;
+
+// The phase the ball is in and how long it lasts
+template<class T>
+BasicMotionPhase<T> motionPhase(const BasicMotion<T>& m) {
+    BasicMotionPhase<T> phase = {T(0), T(0), T(0), T(0), ScalarLimits<T>::max(), false};
+
+    T ux = m.vx - m.wx, uz = m.vz - m.wz;
+    T slip = detLength(ux, uz);
+    if(slip > T(0)) {
+        T f = T(sliding_deceleration) / slip;
+        phase.ax = -f * ux;
+        phase.az = -f * uz;
+        phase.wax = T(2.5) * f * ux;
+        phase.waz = T(2.5) * f * uz;
+        phase.duration = slip / (T(3.5) * T(sliding_deceleration));
+        phase.sliding = true;
+        return phase;
+    }
+
+    T speed = detLength(m.vx, m.vz);
+    if(speed > T(0)) {
+        T f = T(ball_deceleration) / speed;
+        phase.ax = phase.wax = -f * m.vx;
+        phase.az = phase.waz = -f * m.vz;
+        phase.duration = speed / T(ball_deceleration);
+    }
+    return phase;
+}
+
+// State t ticks later. Crosses at most two phase boundaries, and snaps the
+// state exactly onto rolling or rest when it reaches them.
+template<class T>
+BasicMotion<T> motionAt(BasicMotion<T> m, T t) {
+    while(t > T(0)) {
+        BasicMotionPhase<T> phase = motionPhase(m);
+        if(phase.atRest()) break;
+
+        T dt = phase.duration < t ? phase.duration : t;
+        m.x += m.vx * dt + T(0.5) * phase.ax * dt * dt;
+        m.z += m.vz * dt + T(0.5) * phase.az * dt * dt;
+
+        if(dt < phase.duration) {
+            m.vx += phase.ax * dt;
+            m.vz += phase.az * dt;
+            m.wx += phase.wax * dt;
+            m.wz += phase.waz * dt;
+        }
+        else if(phase.sliding) {
+            // Slip gone, rolling from here on
+            m.vx += phase.ax * dt;
+            m.vz += phase.az * dt;
+            m.wx = m.vx;
+            m.wz = m.vz;
+        }
+        else {
+            m.vx = m.vz = m.wx = m.wz = T(0);
+        }
+        t -= dt;
+    }
+    return m;
+}
+
+// Ticks until the ball comes to rest
+template<class T>
+T timeToRest(const BasicMotion<T>& m) {
+    BasicMotionPhase<T> phase = motionPhase(m);
+    if(phase.atRest()) return T(0);
+
+    T t = phase.duration;
+    BasicMotionPhase<T> next = motionPhase(motionAt(m, t));
+    if(!next.atRest()) t += next.duration;
+    return t;
+}
+
+// Built once in motion.cpp
+extern template MotionPhase motionPhase(const BallMotion& m);
+extern template BallMotion motionAt(BallMotion m, double t);
+extern template double timeToRest(const BallMotion& m);
+
+#endif
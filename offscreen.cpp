@@ -0,0 +1,287 @@
+#define GL_GLEXT_PROTOTYPES
+#include "offscreen.h"
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/glext.h>
+#include <png.h>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+bool OffscreenContext::create(int width, int height) {
+    release();
+
+    // Mesa's surfaceless platform needs neither a GPU nor a display server
+    EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+    const char* extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if(extensions && strstr(extensions, "EGL_MESA_platform_surfaceless")) {
+        auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if(getPlatformDisplay) eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    }
+    if(eglDisplay == EGL_NO_DISPLAY) eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    EGLint major, minor;
+    if(eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, &major, &minor)) {
+        std::cerr << "Unable to initialise EGL" << std::endl;
+        return false;
+    }
+    display = eglDisplay;
+
+    const EGLint configAttributes[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+        EGL_DEPTH_SIZE, 24,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint configs = 0;
+    if(!eglChooseConfig(eglDisplay, configAttributes, &config, 1, &configs) || configs == 0) {
+        std::cerr << "No EGL config for an offscreen GL surface" << std::endl;
+        release();
+        return false;
+    }
+
+    const EGLint surfaceAttributes[] = {EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE};
+    surface = eglCreatePbufferSurface(eglDisplay, config, surfaceAttributes);
+    eglBindAPI(EGL_OPENGL_API);
+    context = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, nullptr);
+    if(surface == EGL_NO_SURFACE || context == EGL_NO_CONTEXT ||
+       !eglMakeCurrent(eglDisplay, (EGLSurface)surface, (EGLSurface)surface, (EGLContext)context)) {
+        std::cerr << "Unable to create an offscreen GL context" << std::endl;
+        release();
+        return false;
+    }
+    return true;
+}
+
+void OffscreenContext::release() {
+    if(!display) return;
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if(context && context != EGL_NO_CONTEXT) eglDestroyContext(display, (EGLContext)context);
+    if(surface && surface != EGL_NO_SURFACE) eglDestroySurface(display, (EGLSurface)surface);
+    eglTerminate(display);
+    display = surface = context = nullptr;
+}
+
+void FrameReadback::init(int width, int height, bool useBuffers) {
+    this->width = width;
+    this->height = height;
+    this->useBuffers = useBuffers;
+    written = taken = 0;
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    if(!useBuffers) return;
+
+    glGenBuffers(ring_size, buffers);
+    for(int i = 0;i < ring_size;i++) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, buffers[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, size_t(width) * height * 4, nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void FrameReadback::release() {
+    if(buffers[0]) glDeleteBuffers(ring_size, buffers);
+    memset(buffers, 0, sizeof(buffers));
+}
+
+bool FrameReadback::read(std::vector<uint8_t>& pixels) {
+    if(!useBuffers) {
+        pixels.resize(size_t(width) * height * 4);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        return true;
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, buffers[written % ring_size]);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    written++;
+
+    // Keep ring_size - 1 copies in flight
+    if(written - taken < ring_size) return false;
+    take(pixels);
+    return true;
+}
+
+bool FrameReadback::flush(std::vector<uint8_t>& pixels) {
+    if(!useBuffers || taken == written) return false;
+    take(pixels);
+    return true;
+}
+
+void FrameReadback::take(std::vector<uint8_t>& pixels) {
+    size_t size = size_t(width) * height * 4;
+    pixels.resize(size);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, buffers[taken % ring_size]);
+    const void* mapped = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+    if(mapped) {
+        memcpy(pixels.data(), mapped, size);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    taken++;
+}
+
+FrameEncoder::FrameEncoder(FrameFormat format, int width, int height, const std::string& path)
+    : format(format), width(width), height(height), path(path) {
+    if(format == FrameFormat::Yuv420) {
+        stream = path == "-" ? stdout : fopen(path.c_str(), "wb");
+        if(!stream) {
+            std::cerr << "Can't write " << path << std::endl;
+            failed = true;
+        }
+    }
+    thread = std::thread(&FrameEncoder::run, this);
+}
+
+std::vector<uint8_t> FrameEncoder::buffer() {
+    std::lock_guard<std::mutex> guard(mutex);
+    if(spare.empty()) return std::vector<uint8_t>();
+
+    std::vector<uint8_t> pixels = std::move(spare.back());
+    spare.pop_back();
+    return pixels;
+}
+
+void FrameEncoder::push(std::vector<uint8_t>&& pixels) {
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this] { return int(queue.size()) < max_queued; });
+    queue.push_back(std::move(pixels));
+    changed.notify_all();
+}
+
+bool FrameEncoder::finish() {
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        stopping = true;
+    }
+    changed.notify_all();
+    if(thread.joinable()) thread.join();
+
+    if(stream) {
+        if(fflush(stream) != 0) failed = true;
+        if(stream != stdout) fclose(stream);
+        stream = nullptr;
+    }
+    return !failed;
+}
+
+void FrameEncoder::run() {
+    for(int frame = 0;;frame++) {
+        std::vector<uint8_t> pixels;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [this] { return !queue.empty() || stopping; });
+            if(queue.empty()) return;
+            pixels = std::move(queue.front());
+            queue.pop_front();
+        }
+        changed.notify_all();
+
+        bool ok = encode(pixels, frame);
+
+        std::lock_guard<std::mutex> guard(mutex);
+        if(ok) written++;
+        else failed = true;
+        spare.push_back(std::move(pixels));
+    }
+}
+
+bool FrameEncoder::encode(const std::vector<uint8_t>& pixels, int frame) {
+    if(format == FrameFormat::Png) return writePng(pixels, frame);
+    return stream && writeYuv(pixels);
+}
+
+bool frameFileName(const std::string& pattern, int frame, std::string& out) {
+    std::string name;
+    int conversions = 0;
+    for(size_t i = 0;i < pattern.size();i++) {
+        if(pattern[i] != '%') {
+            name += pattern[i];
+            continue;
+        }
+        if(i + 1 < pattern.size() && pattern[i + 1] == '%') {
+            name += '%';
+            i++;
+            continue;
+        }
+
+        // Optional zero flag and width up to two digits, then d
+        size_t k = i + 1;
+        bool zero = k < pattern.size() && pattern[k] == '0';
+        if(zero) k++;
+        int width = 0, digits = 0;
+        while(k < pattern.size() && isdigit((unsigned char)pattern[k]) && digits < 2) {
+            width = width * 10 + (pattern[k++] - '0');
+            digits++;
+        }
+        if(k >= pattern.size() || pattern[k] != 'd') return false;
+
+        char number[32];
+        snprintf(number, sizeof(number), zero ? "%0*d" : "%*d", width, frame);
+        name += number;
+        conversions++;
+        i = k;
+    }
+    if(conversions != 1) return false;
+    out = name;
+    return true;
+}
+
+bool FrameEncoder::writePng(const std::vector<uint8_t>& pixels, int frame) {
+    std::string name;
+    if(!frameFileName(path, frame, name)) {
+        std::cerr << "Bad frame name pattern " << path << std::endl;
+        return false;
+    }
+
+    png_image image;
+    memset(&image, 0, sizeof(image));
+    image.version = PNG_IMAGE_VERSION;
+    image.width = width;
+    image.height = height;
+    image.format = PNG_FORMAT_RGBA;
+
+    // Negative stride: GL rows are bottom first
+    if(!png_image_write_to_file(&image, name.c_str(), 0, pixels.data(), -width * 4, nullptr)) {
+        std::cerr << "Can't write " << name << ": " << image.message << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// BT.601 limited range, the default ffmpeg assumes for yuv420p
+bool FrameEncoder::writeYuv(const std::vector<uint8_t>& pixels) {
+    int chromaWidth = width / 2, chromaHeight = height / 2;
+    yuv.resize(size_t(width) * height + 2 * size_t(chromaWidth) * chromaHeight);
+    uint8_t* planeY = yuv.data();
+    uint8_t* planeU = planeY + size_t(width) * height;
+    uint8_t* planeV = planeU + size_t(chromaWidth) * chromaHeight;
+
+    for(int row = 0;row < height;row++) {
+        const uint8_t* rgba = pixels.data() + size_t(height - 1 - row) * width * 4; // flip
+        for(int col = 0;col < width;col++) {
+            int r = rgba[col * 4], g = rgba[col * 4 + 1], b = rgba[col * 4 + 2];
+            planeY[size_t(row) * width + col] = uint8_t(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+        }
+    }
+
+    // Chroma from the average of each 2x2 block
+    for(int row = 0;row < chromaHeight;row++) {
+        const uint8_t* top = pixels.data() + size_t(height - 1 - 2 * row) * width * 4;
+        const uint8_t* bottom = top - size_t(width) * 4;
+        for(int col = 0;col < chromaWidth;col++) {
+            const uint8_t* p[4] = {top + col * 8, top + col * 8 + 4, bottom + col * 8, bottom + col * 8 + 4};
+            int r = (p[0][0] + p[1][0] + p[2][0] + p[3][0] + 2) / 4;
+            int g = (p[0][1] + p[1][1] + p[2][1] + p[3][1] + 2) / 4;
+            int b = (p[0][2] + p[1][2] + p[2][2] + p[3][2] + 2) / 4;
+            planeU[size_t(row) * chromaWidth + col] = uint8_t(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+            planeV[size_t(row) * chromaWidth + col] = uint8_t(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+        }
+    }
+
+    return fwrite(yuv.data(), 1, yuv.size(), stream) == yuv.size();
+}
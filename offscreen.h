@@ -0,0 +1,115 @@
+#ifndef OFFSCREEN_H
+#define OFFSCREEN_H
+
+#include <GL/gl.h>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Rendering without a window or X server: an EGL pbuffer context, an
+// asynchronous readback of the finished frames and an encoder thread writing
+// them out. Used by the headless billiards_render tool.
+
+// GL context on an offscreen EGL pbuffer. Uses Mesa's surfaceless platform
+// when it is there, so llvmpipe works on machines with no GPU and no display.
+class OffscreenContext {
+public:
+    ~OffscreenContext() { release(); }
+
+    // Creates the context and makes it current, false with a message on stderr
+    bool create(int width, int height);
+    void release();
+
+private:
+    void* display = nullptr;
+    void* surface = nullptr;
+    void* context = nullptr;
+};
+
+// Reads frames back through a ring of pixel-pack buffers. read() only queues
+// the copy of the current frame and returns one queued ring_size - 1 calls
+// earlier, which the GPU has long finished by then, so the CPU never waits on
+// the frame it just drew. Without buffer objects it reads synchronously.
+class FrameReadback {
+public:
+    static const int ring_size = 3;
+
+    // Needs a current context
+    void init(int width, int height, bool useBuffers);
+    void release();
+
+    // Queue the current framebuffer (RGBA, bottom row first). True when an
+    // older frame came out in pixels.
+    bool read(std::vector<uint8_t>& pixels);
+    // After the last read(): the frames still in flight, one per call
+    bool flush(std::vector<uint8_t>& pixels);
+
+private:
+    int width = 0, height = 0;
+    GLuint buffers[ring_size] = {0};
+    bool useBuffers = false;
+    long written = 0, taken = 0;
+
+    void take(std::vector<uint8_t>& pixels);
+};
+
+enum class FrameFormat {
+    Png,   // one file per frame
+    Yuv420 // raw I420 frames back to back, e.g. for ffmpeg -f rawvideo
+};
+
+// Expand a PNG frame name pattern: "%%" is a percent sign and the pattern's
+// one "%d", "%5d" or "%05d" is the frame number. False for any other
+// conversion, or for none or more than one, leaving out alone.
+bool frameFileName(const std::string& pattern, int frame, std::string& out);
+
+// Encodes frames on its own thread, so writing one frame overlaps with
+// rendering the next. push() only blocks when max_queued frames are waiting.
+class FrameEncoder {
+public:
+    static const int max_queued = 4;
+
+    // For Png, path is a pattern for frameFileName(); for Yuv420 a
+    // file name, or "-" for stdout. width and height must be even for Yuv420.
+    FrameEncoder(FrameFormat format, int width, int height, const std::string& path);
+    ~FrameEncoder() { finish(); }
+
+    FrameEncoder(const FrameEncoder&) = delete;
+    FrameEncoder& operator=(const FrameEncoder&) = delete;
+
+    // A buffer to read the next frame into, recycled from encoded frames
+    std::vector<uint8_t> buffer();
+    // Hand over a frame as read back by FrameReadback
+    void push(std::vector<uint8_t>&& pixels);
+
+    // Wait for every queued frame; false if anything failed to write
+    bool finish();
+    int framesWritten() const { return written; }
+
+private:
+    FrameFormat format;
+    int width, height;
+    std::string path;
+    FILE* stream = nullptr; // Yuv420 output
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::vector<uint8_t>> queue, spare;
+    bool stopping = false;
+    bool failed = false;
+    int written = 0;
+    std::vector<uint8_t> yuv;
+
+    void run();
+    bool encode(const std::vector<uint8_t>& pixels, int frame);
+    bool writePng(const std::vector<uint8_t>& pixels, int frame);
+    bool writeYuv(const std::vector<uint8_t>& pixels);
+};
+
+#endif
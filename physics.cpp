@@ -0,0 +1,407 @@
+#include "physics.h"
+#include "collision_kernel.h"
+#include <cmath>
+#include <cstring>
+
+float distance(glm::vec3 p1, glm::vec3 p2) {
+    return sqrt( (p1.x - p2.x) * (p1.x - p2.x) + (p1.y - p2.y) * (p1.y - p2.y) + (p1.z - p2.z) * (p1.z - p2.z) );
+}
+
+float dot(glm::vec3 v1, glm::vec3 v2) {
+    return (v1.x * v2.x + v1.y * v2.y + v1.z * v2.z);
+}
+
+// Motion in MotionScalar, stored as float
+template<class T>
+static BasicMotion<T> scalarMotion(float x, float z, float vx, float vz, float wx, float wz) {
+    return {T(x), T(z), T(vx), T(vz), T(wx), T(wz)};
+}
+
+void Ball::move() {
+    typedef MotionScalar S;
+    BasicMotion<S> m = scalarMotion<S>(position.x, position.z, velocity.x, velocity.z, spin.x, spin.z);
+    m = motionAt(m, S(1));
+    position.x = float(m.x);
+    position.z = float(m.z);
+    velocity = glm::vec3(float(m.vx), 0, float(m.vz));
+    spin = glm::vec3(float(m.wx), 0, float(m.wz));
+}
+
+void checkWallCollisions(Ball& ball, const TableDef& table) {
+    typedef ContactScalar S;
+    float r = ball.radius;
+    ball.velocity.x = float(bounce(S(ball.position.x), S(ball.velocity.x), S(table.minX + r), S(table.maxX - r)));
+    ball.velocity.z = float(bounce(S(ball.position.z), S(ball.velocity.z), S(table.minZ + r), S(table.maxZ - r)));
+}
+
+// Same rule as World::resolveBallPair(), on the table plane
+void checkBallCollisions(Ball& b1, Ball& b2) {
+    typedef ContactScalar S;
+    float dx = b1.position.x - b2.position.x, dz = b1.position.z - b2.position.z;
+    float rs = b1.radius + b2.radius;
+    if(dx * dx + dz * dz >= rs * rs) return;
+
+    PairImpulse<S> hit;
+    S mi = S(b1.mass), mj = S(b2.mass);
+    if(!pairImpulse(S(dx), S(dz), S(b1.velocity.x) - S(b2.velocity.x), S(b1.velocity.z) - S(b2.velocity.z), mi, mj, hit)) return;
+
+    b1.velocity.x = float(S(b1.velocity.x) - hit.impulse * hit.nx / mi);
+    b1.velocity.z = float(S(b1.velocity.z) - hit.impulse * hit.nz / mi);
+    b2.velocity.x = float(S(b2.velocity.x) + hit.impulse * hit.nx / mj);
+    b2.velocity.z = float(S(b2.velocity.z) + hit.impulse * hit.nz / mj);
+}
+
+void checkPocketCollisions(Ball& ball, const TableDef& table) {
+    typedef ContactScalar S;
+    for(int p = 0;p < table.pocketCount;p++) {
+        if(inPocket(S(ball.position.x), S(ball.position.z), S(ball.radius), table.pockets[p])) {
+            ball.active = false;
+        }
+    }
+}
+
+World::World() {
+    balls.resize(balls_count);
+}
+
+bool World::setTable(const TableDef& def, const char* rackName) {
+    const RackDef* rack = def.findRack(rackName);
+    if(rackName && !rack) return false;
+    table = &def;
+    layout = rack;
+    return true;
+}
+
+bool World::rack(const char* name) {
+    const RackDef* r = name ? table->findRack(name) : layout ? layout : table->findRack();
+    if(!r) return false;
+
+    balls.resize(r->count);
+    for(uint32_t k = 0;k < r->count;k++) {
+        const RackBallDef& b = table->rackBalls[r->first + k];
+        Ball ball(b.radius, b.r, b.g, b.b, b.x, table_surface + b.radius, b.z);
+        ball.mass = b.mass;
+        setBall(k, ball);
+    }
+
+    accumulator = 0;
+    return true;
+}
+
+void World::breakShot(float speed) {
+    rack();
+    if(balls.count < 2) return;
+
+    float x = 0, z = 0;
+    for(int i = 1;i < balls.count;i++) {
+        x += balls.x[i];
+        z += balls.z[i];
+    }
+    glm::vec3 aim(x / (balls.count - 1) - balls.x[0], 0, z / (balls.count - 1) - balls.z[0]);
+    float length = glm::length(aim);
+    if(length > 0) setMovement(0, aim * (speed / length));
+}
+
+void World::collideWalls(int i) {
+    typedef ContactScalar S;
+    float r = balls.radius[i];
+    balls.vx[i] = float(bounce(S(balls.x[i]), S(balls.vx[i]), S(table->minX + r), S(table->maxX - r)));
+    balls.vz[i] = float(bounce(S(balls.z[i]), S(balls.vz[i]), S(table->minZ + r), S(table->maxZ - r)));
+}
+
+void World::collidePockets(int i, uint8_t pocketMask) {
+    typedef ContactScalar S;
+    for(int p = 0;p < table->pocketCount;p++) {
+        if(!(pocketMask & (1 << p))) continue;
+        if(inPocket(S(balls.x[i]), S(balls.z[i]), S(balls.radius[i]), table->pockets[p])) {
+            balls.setActive(i, false);
+        }
+    }
+}
+
+void World::resolveBallPair(int i, int j) {
+    typedef ContactScalar S;
+    PairImpulse<S> hit;
+    S mi = S(balls.mass[i]), mj = S(balls.mass[j]);
+    if(!pairImpulse(S(balls.x[i] - balls.x[j]), S(balls.z[i] - balls.z[j]), S(balls.vx[i] - balls.vx[j]),
+                    S(balls.vz[i] - balls.vz[j]), mi, mj, hit)) return;
+
+    balls.vx[i] = float(S(balls.vx[i]) - hit.impulse * hit.nx / mi);
+    balls.vz[i] = float(S(balls.vz[i]) - hit.impulse * hit.nz / mi);
+    balls.vx[j] = float(S(balls.vx[j]) + hit.impulse * hit.nx / mj);
+    balls.vz[j] = float(S(balls.vz[j]) + hit.impulse * hit.nz / mj);
+
+    if(hit.impulse != S(0)) {
+        wake(i);
+        wake(j);
+    }
+}
+
+bool World::usesGrid() const {
+    return broadphase == BroadphaseMode::Grid || (broadphase == BroadphaseMode::Auto && balls.count >= grid_min_balls);
+}
+
+void World::update() {
+    // Nothing can happen on a table where every ball sleeps
+    if(balls.awakeCount == 0) return;
+
+    if(usesGrid()) updateGrid();
+    else updateBruteForce();
+
+    sleepIslands();
+}
+
+void World::updateBruteForce() {
+    int n = balls.count;
+    for(int i = 0;i < n;i++) {
+        if(!balls.isActive(i)) continue;
+
+        // A sleeping ball is at rest where it was last checked
+        if(!balls.isSleeping(i)) {
+            collideWalls(i);
+            collidePockets(i);
+        }
+
+        // Positions don't change inside update(), so the overlap masks can be
+        // computed 8 balls at a time and the hits resolved in index order
+        for(int j = i + 1;j < n;j += simd_width) {
+            uint32_t candidates = balls.activeBits8(j);
+            if(j + simd_width > n) candidates &= (1u << (n - j)) - 1;
+
+            // Two sleeping balls can't push each other
+            bool sleeping = balls.isSleeping(i);
+            uint32_t hits = sleeping ? candidates & ~balls.sleepingBits8(j) : candidates;
+            if(!hits) continue;
+
+            uint32_t overlaps = overlapMask8(balls, i, j) & candidates;
+            hits &= overlaps;
+            while(hits) {
+                int k = __builtin_ctz(hits);
+                hits &= hits - 1;
+                resolveBallPair(i, j + k);
+
+                // Woken by that hit, the sleeping balls left in this block count again
+                if(sleeping && !balls.isSleeping(i)) {
+                    sleeping = false;
+                    hits = overlaps & ~((2u << k) - 1);
+                }
+            }
+        }
+    }
+}
+
+void World::updateGrid() {
+    grid.update(balls, *table);
+
+    for(int i = 0;i < balls.count;i++) {
+        if(!balls.isActive(i)) continue;
+
+        if(!balls.isSleeping(i)) {
+            collideWalls(i);
+            collidePockets(i, grid.pocketsNear(i));
+        }
+
+        grid.candidates(balls, i, candidateBuffer);
+        for(int j : candidateBuffer) {
+            if(balls.isSleeping(i) && balls.isSleeping(j)) continue;
+            if(ballsOverlap(balls, i, j)) {
+                resolveBallPair(i, j);
+            }
+        }
+    }
+}
+
+BallMotion World::motion(int i) const {
+    return {balls.x[i], balls.z[i], balls.vx[i], balls.vz[i], balls.wx[i], balls.wz[i]};
+}
+
+void World::setMotion(int i, const BallMotion& m) {
+    balls.x[i] = float(m.x);
+    balls.z[i] = float(m.z);
+    balls.vx[i] = float(m.vx);
+    balls.vz[i] = float(m.vz);
+    balls.wx[i] = float(m.wx);
+    balls.wz[i] = float(m.wz);
+}
+
+bool World::isMoving(int i) const {
+    return balls.vx[i] != 0 || balls.vz[i] != 0 || balls.wx[i] != 0 || balls.wz[i] != 0;
+}
+
+void World::move() {
+    if(balls.awakeCount == 0) return;
+
+    for(int i = 0;i < balls.count;i++) {
+        if(!isMoving(i)) continue;
+        BasicMotion<MotionScalar> m = scalarMotion<MotionScalar>(balls.x[i], balls.z[i], balls.vx[i], balls.vz[i], balls.wx[i], balls.wz[i]);
+        m = motionAt(m, MotionScalar(1));
+        balls.x[i] = float(m.x);
+        balls.z[i] = float(m.z);
+        balls.vx[i] = float(m.vx);
+        balls.vz[i] = float(m.vz);
+        balls.wx[i] = float(m.wx);
+        balls.wz[i] = float(m.wz);
+    }
+}
+
+uint64_t World::checksum() const {
+    // FNV-1a over 32-bit words; the bit patterns, so -0 and 0 differ too
+    uint64_t hash = 0xcbf29ce484222325ull;
+    auto add = [&hash](const void* data, size_t bytes) {
+        const uint8_t* p = (const uint8_t*)data;
+        for(size_t k = 0;k + 4 <= bytes;k += 4) {
+            uint32_t word;
+            memcpy(&word, p + k, 4);
+            hash = (hash ^ word) * 0x100000001b3ull;
+        }
+    };
+    size_t n = balls.count;
+    add(&balls.count, sizeof(balls.count));
+    add(balls.x.data(), n * sizeof(float));
+    add(balls.z.data(), n * sizeof(float));
+    add(balls.vx.data(), n * sizeof(float));
+    add(balls.vz.data(), n * sizeof(float));
+    add(balls.wx.data(), n * sizeof(float));
+    add(balls.wz.data(), n * sizeof(float));
+    add(balls.activeMask.data(), (n + 63) / 64 * sizeof(uint64_t));
+    return hash;
+}
+
+void World::tick() {
+    if(mode == SolverMode::Continuous) {
+        events.advance(*this, 1);
+        return;
+    }
+
+    update();
+    move();
+}
+
+void World::advance(int ticks) {
+    if(mode == SolverMode::Continuous) {
+        events.advance(*this, ticks);
+        return;
+    }
+
+    for(int t = 0;t < ticks;t++) {
+        tick();
+    }
+}
+
+int World::step(float dt) {
+    accumulator += dt;
+
+    int ticks = 0;
+    while(accumulator >= fixed_dt && ticks < max_ticks_per_step) {
+        accumulator -= fixed_dt;
+        ticks++;
+    }
+    advance(ticks);
+
+    // Too far behind: drop the backlog instead of trying to catch up forever
+    if(accumulator >= fixed_dt) {
+        accumulator = 0;
+    }
+
+    return ticks;
+}
+
+void World::wake(int i) {
+    if(!balls.isSleeping(i)) return;
+
+    int id = balls.island[i];
+    for(int k = 0;k < balls.count;k++) {
+        if(balls.isSleeping(k) && balls.island[k] == id) {
+            balls.setSleeping(k, false);
+        }
+    }
+}
+
+int World::findIsland(int i) {
+    while(islandParent[i] != i) {
+        islandParent[i] = islandParent[islandParent[i]];
+        i = islandParent[i];
+    }
+    return i;
+}
+
+void World::sleepIslands() {
+    int n = balls.count;
+
+    // Only a ball that stopped can fall asleep
+    bool stopped = false;
+    for(int i = 0;i < n && !stopped;i++) {
+        stopped = !balls.isSleeping(i) && !isMoving(i);
+    }
+    if(!stopped) return;
+
+    // Union the awake balls with everything they touch. A sleeping neighbour
+    // brings its whole island along through the island's id ball.
+    islandParent.resize(n);
+    for(int i = 0;i < n;i++) islandParent[i] = i;
+
+    for(int i = 0;i < n;i++) {
+        if(balls.isSleeping(i) || !balls.isActive(i)) continue;
+
+        if(usesGrid()) {
+            grid.neighbours(balls, i, candidateBuffer);
+        } else {
+            candidateBuffer.clear();
+            for(int j = 0;j < n;j++) {
+                if(j != i && balls.isActive(j)) candidateBuffer.push_back(j);
+            }
+        }
+
+        for(int j : candidateBuffer) {
+            float dx = balls.x[i] - balls.x[j], dz = balls.z[i] - balls.z[j];
+            float reach = balls.radius[i] + balls.radius[j] + contact_margin;
+            if(dx * dx + dz * dz >= reach * reach) continue;
+
+            islandParent[findIsland(j)] = findIsland(i);
+            if(balls.isSleeping(j)) {
+                islandParent[findIsland(balls.island[j])] = findIsland(i);
+            }
+        }
+    }
+
+    islandMoving.assign(n, 0);
+    for(int i = 0;i < n;i++) {
+        if(!balls.isSleeping(i) && isMoving(i)) {
+            islandMoving[findIsland(i)] = 1;
+        }
+    }
+
+    for(int i = 0;i < n;i++) {
+        if(!balls.isSleeping(i)) {
+            int root = findIsland(i);
+            if(islandMoving[root]) continue;
+
+            balls.setSleeping(i, true);
+            balls.island[i] = root;
+        } else {
+            // Sleeping islands touched by one that just fell asleep join it
+            int root = findIsland(balls.island[i]);
+            if(!islandMoving[root]) balls.island[i] = root;
+        }
+    }
+}
+
+bool World::atRest() const {
+    for(int i = 0;i < balls.count;i++) {
+        if(!balls.isSleeping(i) && isMoving(i)) return false;
+    }
+    return true;
+}
+
+int World::runUntilRest(int maxTicks) {
+    if(mode == SolverMode::Continuous) {
+        return int(ceil(events.runUntilRest(*this, maxTicks)));
+    }
+
+    int ticks = 0;
+    while(ticks < maxTicks && !atRest()) {
+        tick();
+        ticks++;
+    }
+    return ticks;
+}
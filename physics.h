@@ -0,0 +1,178 @@
+#ifndef PHYSICS_H
+#define PHYSICS_H
+
+// Renderer-free physics core: no GL/GLUT/X11 includes allowed in here so it can
+// be linked into headless tools.
+#include <glm/glm.hpp>
+#include <vector>
+#include "ball_set.h"
+#include "broadphase.h"
+#include "contact.h"
+#include "event_solver.h"
+#include "motion.h"
+#include "table_def.h"
+
+const float EPS = 1e-6;
+
+const int balls_count = 16;
+
+// Gap up to which two balls count as touching when grouping them into islands
+const float contact_margin = 0.001;
+
+float distance(glm::vec3 p1, glm::vec3 p2 = {0, 0 ,0});
+float dot(glm::vec3 v1, glm::vec3 v2);
+
+class Ball {
+public:
+    bool active = true;
+    float radius, mass = 1.0;
+    glm::vec3 position, color, velocity = {0, 0, 0};
+    glm::vec3 spin = {0, 0, 0}; // rolling velocity, see motion.h
+
+    Ball() {
+        active = true;
+    }
+
+    Ball(float r) {
+        radius = r;
+        active = true;
+    }
+
+    Ball(float rad, float r, float g, float b) {
+        radius = rad;
+        color = {r, g, b};
+        active = true;
+    }
+
+    Ball(float rad, float r, float g, float b, float x, float y, float z) {
+        radius = rad;
+        color = glm::vec3(r, g, b);
+        position = glm::vec3(x, y, z);
+        active = true;
+    }
+
+    void setMovement(glm::vec3 v) {
+        velocity = v;
+        velocity.y = 0;
+    }
+
+    // Advance one tick along the motion model: velocity is in table units per tick
+    void move();
+};
+
+void checkWallCollisions(Ball& ball, const TableDef& table = standard_table);
+void checkBallCollisions(Ball& b1, Ball& b2);
+void checkPocketCollisions(Ball& ball, const TableDef& table = standard_table);
+
+// How World advances time
+enum class SolverMode {
+    FixedTick,  // move every ball one tick, then fix up overlaps
+    Continuous  // jump from contact to contact with the EventSolver
+};
+
+class World {
+public:
+    // Length of one physics tick in seconds, ball velocities are per tick
+    static constexpr float fixed_dt = 1.0f / 60.0f;
+    // Upper bound of ticks run by a single step() so a long stall can't spiral
+    static constexpr int max_ticks_per_step = 8;
+
+    BallSet balls; // zero is the cue ball
+    float accumulator = 0;
+    SolverMode mode = SolverMode::FixedTick;
+    EventSolver events;
+    BroadphaseMode broadphase = BroadphaseMode::Auto;
+    UniformGrid grid;
+    // Cushions, pockets and racks; points into standard_table or a TableAsset
+    // that outlives the world
+    const TableDef* table = &standard_table;
+    const RackDef* layout = nullptr; // what rack() places, the table's first rack if null
+
+    World();
+
+    Ball ball(int i) const { return balls.get(i); }
+    void setBall(int i, const Ball& ball) { balls.set(i, ball); }
+
+    // Position, velocity and spin of ball i for the motion model
+    BallMotion motion(int i) const;
+    void setMotion(int i, const BallMotion& m);
+    // Whether ball i has any velocity or spin left
+    bool isMoving(int i) const;
+
+    // Set the velocity of ball i, the vertical component is ignored
+    void setMovement(int i, glm::vec3 v) {
+        balls.vx[i] = v.x;
+        balls.vz[i] = v.z;
+        wake(i);
+    }
+
+    // Play on table from now on, racked with its rack called rackName (the
+    // first one by default). False if there is no such rack.
+    bool setTable(const TableDef& def, const char* rackName = nullptr);
+
+    // Place the balls of the rack called name, or of layout. Returns false,
+    // leaving the balls alone, if the table has no such rack.
+    bool rack(const char* name = nullptr);
+
+    // The opening break: rack, then send the cue ball at speed (per tick)
+    // straight at the middle of the other balls
+    void breakShot(float speed = 0.1f);
+
+    // Resolve wall, pocket and ball-ball collisions for the current positions
+    void update();
+
+    // Whether update() goes through the grid with the current settings
+    bool usesGrid() const;
+
+    // Bounce ball i back if it's past a cushion and still heading out
+    void collideWalls(int i);
+    // Take ball i off the table if it reached one of the pockets in pocketMask
+    void collidePockets(int i, uint8_t pocketMask = 0xff);
+    // Exchange momentum between two balls already known to overlap
+    void resolveBallPair(int i, int j);
+
+    // Move every ball by one tick
+    void move();
+
+    // Hash of the state the physics evolves: positions, velocities, spins and
+    // which balls are on the table. Equal on two machines exactly when their
+    // simulations agree, so comparing it every tick finds the first tick a
+    // run diverges at for the price of one pass over the hot arrays.
+    uint64_t checksum() const;
+
+    // Wake ball i and every ball sleeping in the same island
+    void wake(int i);
+
+    // Put islands of touching balls to sleep once none of their balls moves.
+    // Sleeping balls have zero velocity and spin, so skipping them changes
+    // nothing: update() and move() only look at pairs with an awake ball, and
+    // a tick with every ball asleep does no work at all.
+    void sleepIslands();
+
+    // One fixed tick: collisions then integration
+    void tick();
+
+    // Run ticks ticks in the current mode
+    void advance(int ticks);
+
+    // Feed dt seconds of wall time, run as many fixed ticks as fit and keep
+    // the remainder for the next call. Returns the number of ticks run.
+    int step(float dt);
+
+    bool atRest() const;
+
+    // Run until every ball stopped or maxTicks passed, returns the ticks run
+    int runUntilRest(int maxTicks);
+
+private:
+    std::vector<int> candidateBuffer;
+    std::vector<int> islandParent;
+    std::vector<uint8_t> islandMoving;
+
+    int findIsland(int i);
+
+    void updateBruteForce();
+    void updateGrid();
+};
+
+#endif
@@ -0,0 +1,147 @@
+#include "profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <utility>
+
+Profiler profiler;
+
+static uint64_t steadyNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Profiler::Profiler() : epoch(steadyNs()) {
+    for(int i = 0;i < max_threads;i++) threadNames[i] = nullptr;
+}
+
+Profiler::~Profiler() {
+    delete[] slots.load();
+}
+
+uint64_t Profiler::now() const {
+    return steadyNs() - epoch;
+}
+
+int Profiler::threadIndex() {
+    thread_local int index = -1;
+    if(index < 0) {
+        index = std::min(threads.fetch_add(1), max_threads - 1);
+    }
+    return index;
+}
+
+Profiler::Slot* Profiler::ring() {
+    Slot* ring = slots.load(std::memory_order_acquire);
+    if(ring) return ring;
+
+    // Threads racing to record first each allocate, one ring wins
+    Slot* fresh = new Slot[capacity];
+    if(slots.compare_exchange_strong(ring, fresh, std::memory_order_acq_rel)) return fresh;
+    delete[] fresh;
+    return ring;
+}
+
+void Profiler::record(const char* name, uint64_t start, uint64_t end) {
+    Slot* ring = this->ring();
+    uint64_t index = head.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = ring[index & (capacity - 1)];
+
+    slot.seq.store(0, std::memory_order_relaxed); // being written
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.start.store(start, std::memory_order_relaxed);
+    slot.duration.store(end - start, std::memory_order_relaxed);
+    slot.thread.store(threadIndex(), std::memory_order_relaxed);
+    slot.seq.store(index + 1, std::memory_order_release);
+}
+
+void Profiler::setThreadName(const char* name) {
+    threadNames[threadIndex()] = name;
+}
+
+const char* Profiler::threadName(int thread) const {
+    const char* name = thread >= 0 && thread < max_threads ? threadNames[thread].load() : nullptr;
+    return name ? name : "thread";
+}
+
+void Profiler::snapshot(std::vector<ProfileSample>& out, uint64_t windowNs) const {
+    out.clear();
+    const Slot* ring = slots.load(std::memory_order_acquire);
+    if(!ring) return;
+    uint64_t end = head.load(std::memory_order_acquire);
+    uint64_t begin = end > uint64_t(capacity) ? end - capacity : 0;
+    uint64_t current = now();
+    uint64_t cutoff = windowNs ? current - std::min(current, windowNs) : 0;
+
+    for(uint64_t index = begin;index < end;index++) {
+        const Slot& slot = ring[index & (capacity - 1)];
+        if(slot.seq.load(std::memory_order_acquire) != index + 1) continue;
+
+        ProfileSample sample;
+        sample.name = slot.name.load(std::memory_order_relaxed);
+        sample.start = slot.start.load(std::memory_order_relaxed);
+        sample.duration = slot.duration.load(std::memory_order_relaxed);
+        sample.thread = slot.thread.load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if(slot.seq.load(std::memory_order_relaxed) != index + 1) continue; // overwritten while copying
+
+        if(sample.start + sample.duration >= cutoff) out.push_back(sample);
+    }
+}
+
+std::vector<ProfileStat> Profiler::stats(uint64_t windowNs) const {
+    std::vector<ProfileSample> samples;
+    snapshot(samples, windowNs);
+
+    std::map<std::pair<int, const char*>, std::vector<uint64_t>> stages;
+    for(const ProfileSample& sample : samples) {
+        stages[{sample.thread, sample.name}].push_back(sample.duration);
+    }
+
+    std::vector<ProfileStat> result;
+    for(auto& stage : stages) {
+        std::vector<uint64_t>& durations = stage.second;
+        ProfileStat stat;
+        stat.thread = stage.first.first;
+        stat.name = stage.first.second;
+        stat.samples = int(durations.size());
+
+        uint64_t sum = 0;
+        for(uint64_t d : durations) sum += d;
+        size_t p99 = std::min(durations.size() - 1, durations.size() * 99 / 100);
+        std::nth_element(durations.begin(), durations.begin() + p99, durations.end());
+
+        stat.minMs = *std::min_element(durations.begin(), durations.end()) / 1e6f;
+        stat.avgMs = sum / 1e6f / durations.size();
+        stat.p99Ms = durations[p99] / 1e6f;
+        result.push_back(stat);
+    }
+    return result;
+}
+
+bool Profiler::writeTrace(const std::string& path) const {
+    FILE* out = fopen(path.c_str(), "w");
+    if(!out) return false;
+
+    std::vector<ProfileSample> samples;
+    snapshot(samples);
+
+    fprintf(out, "{\"traceEvents\":[");
+    const char* separator = "\n";
+    int count = std::min(threads.load(), int(max_threads));
+    for(int thread = 0;thread < count;thread++) {
+        fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                separator, thread, threadName(thread));
+        separator = ",\n";
+    }
+    for(const ProfileSample& s : samples) {
+        fprintf(out, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                separator, s.name, s.thread, s.start / 1e3, s.duration / 1e3);
+        separator = ",\n";
+    }
+    fprintf(out, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    return fclose(out) == 0;
+}
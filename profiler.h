@@ -0,0 +1,98 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Scoped stage timers. PROFILE_SCOPE("name") times the rest of the enclosing
+// block into a ring buffer shared by every thread; without BILLIARDS_PROFILE
+// the probes compile to nothing and the buffer is never allocated. Names must
+// be string literals, samples keep the pointer.
+
+struct ProfileSample {
+    const char* name;
+    uint64_t start;    // ns since the profiler started
+    uint64_t duration; // ns
+    int thread;
+};
+
+// Rolling numbers for one stage, in milliseconds
+struct ProfileStat {
+    const char* name;
+    int thread;
+    int samples;
+    float minMs, avgMs, p99Ms;
+};
+
+class Profiler {
+public:
+    // Samples kept, the oldest are overwritten
+    static const int capacity = 1 << 16;
+    static const int max_threads = 16;
+
+    Profiler();
+    ~Profiler();
+
+    uint64_t now() const;
+    // Lock-free, callable from any thread
+    void record(const char* name, uint64_t start, uint64_t end);
+
+    // Name shown for the calling thread in traces and the HUD
+    void setThreadName(const char* name);
+    const char* threadName(int thread) const;
+
+    // Copy of the samples that ended in the last windowNs (all if 0), oldest first
+    void snapshot(std::vector<ProfileSample>& out, uint64_t windowNs = 0) const;
+    // Per stage and thread min/avg/p99 over the last windowNs
+    std::vector<ProfileStat> stats(uint64_t windowNs) const;
+
+    // Chrome trace-event JSON, loadable in chrome://tracing or Perfetto
+    bool writeTrace(const std::string& path) const;
+
+private:
+    // A slot is valid when seq is its ring index + 1; readers check it before
+    // and after copying, so a slot that was overwritten meanwhile is skipped
+    struct Slot {
+        std::atomic<uint64_t> seq{0};
+        std::atomic<const char*> name{nullptr};
+        std::atomic<uint64_t> start{0}, duration{0};
+        std::atomic<int> thread{0};
+    };
+
+    // Allocated by the first record()
+    std::atomic<Slot*> slots{nullptr};
+    alignas(64) std::atomic<uint64_t> head{0};
+    std::atomic<int> threads{0};
+    std::atomic<const char*> threadNames[max_threads];
+    uint64_t epoch;
+
+    int threadIndex();
+    Slot* ring();
+};
+
+extern Profiler profiler;
+
+class ProfileScope {
+public:
+    explicit ProfileScope(const char* name) : name(name), start(profiler.now()) {}
+    ~ProfileScope() { profiler.record(name, start, profiler.now()); }
+
+private:
+    const char* name;
+    uint64_t start;
+};
+
+#define PROFILE_CONCAT2(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+
+#ifdef BILLIARDS_PROFILE
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_THREAD(name) profiler.setThreadName(name)
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_THREAD(name) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,464 @@
+#define GL_GLEXT_PROTOTYPES
+#include "renderer.h"
+#include <GL/glext.h>
+#include <GL/glu.h>
+#include <cstddef>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+// Attribute slots of the instancing shader, 0 aliases gl_Vertex
+const GLuint attribute_position = 0;
+const GLuint attribute_instance = 1;
+const GLuint attribute_instance_color = 2;
+
+static const char* instance_vertex_shader =
+    "#version 120\n"
+    "attribute vec3 position;\n"
+    "attribute vec4 instance;\n"       // xyz centre, w radius
+    "attribute vec3 instanceColor;\n"
+    "varying vec3 color;\n"
+    "void main() {\n"
+    "    gl_Position = gl_ModelViewProjectionMatrix * vec4(position * instance.w + instance.xyz, 1.0);\n"
+    "    color = instanceColor;\n"
+    "}\n";
+
+static const char* instance_fragment_shader =
+    "#version 120\n"
+    "varying vec3 color;\n"
+    "void main() {\n"
+    "    gl_FragColor = vec4(color, 1.0);\n"
+    "}\n";
+
+// Buffer objects are core since GL 1.5
+static bool hasBufferObjects() {
+    const char* version = (const char*)glGetString(GL_VERSION);
+    int major = 0, minor = 0;
+    if(!version || sscanf(version, "%d.%d", &major, &minor) != 2) return false;
+    return major > 1 || (major == 1 && minor >= 5);
+}
+
+static bool hasExtension(const char* name) {
+    const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+    if(!extensions) return false;
+
+    size_t length = strlen(name);
+    for(const char* p = strstr(extensions, name);p;p = strstr(p + length, name)) {
+        bool startOk = p == extensions || p[-1] == ' ';
+        bool endOk = p[length] == ' ' || p[length] == '\0';
+        if(startOk && endOk) return true;
+    }
+    return false;
+}
+
+static bool hasInstancedArrays() {
+    const char* version = (const char*)glGetString(GL_VERSION);
+    int major = 0, minor = 0;
+    if(version && sscanf(version, "%d.%d", &major, &minor) == 2 && (major > 3 || (major == 3 && minor >= 3))) {
+        return true;
+    }
+    return hasExtension("GL_ARB_draw_instanced") && hasExtension("GL_ARB_instanced_arrays");
+}
+
+static GLuint compileShader(GLenum type, const char* source) {
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+
+    GLint ok = 0;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if(!ok) {
+        char log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        std::cerr << "Ball shader failed to compile: " << log << std::endl;
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+void loadCamera(const Camera& camera) {
+    glm::vec3 center = camera.position + camera.look; // a point 1 unit in front of the camera
+    gluLookAt(camera.position.x, camera.position.y, camera.position.z,
+              center.x, center.y, center.z,
+              camera.up.x, camera.up.y, camera.up.z);
+}
+
+void GpuMesh::upload(const Mesh& mesh, bool useBuffers) {
+    release();
+    count = GLsizei(mesh.indices.size());
+
+    if(!useBuffers) {
+        cpu = mesh;
+        return;
+    }
+
+    glGenBuffers(1, &vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, mesh.vertices.size() * sizeof(Vertex), mesh.vertices.data(), GL_STATIC_DRAW);
+
+    glGenBuffers(1, &ibo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(uint32_t), mesh.indices.data(), GL_STATIC_DRAW);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void GpuMesh::draw(bool withColors) const {
+    if(count == 0) return;
+
+    // With a bound buffer the "pointers" are byte offsets into it
+    const char* base = nullptr;
+    const void* indices = nullptr;
+    if(vbo) {
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+    }
+    else {
+        base = (const char*)cpu.vertices.data();
+        indices = cpu.indices.data();
+    }
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_FLOAT, sizeof(Vertex), base + offsetof(Vertex, x));
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glNormalPointer(GL_FLOAT, sizeof(Vertex), base + offsetof(Vertex, nx));
+    if(withColors) {
+        glEnableClientState(GL_COLOR_ARRAY);
+        glColorPointer(3, GL_FLOAT, sizeof(Vertex), base + offsetof(Vertex, r));
+    }
+
+    glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, indices);
+
+    if(withColors) glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+
+    if(vbo) {
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
+}
+
+void GpuMesh::release() {
+    if(vbo) glDeleteBuffers(1, &vbo);
+    if(ibo) glDeleteBuffers(1, &ibo);
+    vbo = ibo = 0;
+    count = 0;
+    cpu.clear();
+}
+
+void Renderer::init(const TableDef& def) {
+    buffers = hasBufferObjects();
+    table = &def;
+
+    // Build the static scene first, so it can be lit before it goes up
+    Mesh platformMesh, bodyMesh;
+    Mesh legMesh[legs_count][round_lod_tiers], pocketMesh[max_pockets][round_lod_tiers];
+    buildPlatformMesh(platformMesh);
+    buildTableBodyMesh(bodyMesh, *table);
+    for(int tier = 0;tier < round_lod_tiers;tier++) {
+        for(int leg = 0;leg < legs_count;leg++) buildLegMesh(legMesh[leg][tier], leg, round_lod_segments[tier]);
+        for(int p = 0;p < table->pocketCount;p++) buildPocketMesh(pocketMesh[p][tier], table->pockets[p], round_lod_segments[tier]);
+    }
+
+    bakeStats = BakeStats();
+    if(bakedLighting) {
+        // Every leg tier is lit, the pockets are black and only shade
+        LightBaker baker;
+        baker.addReceiver(&platformMesh);
+        baker.addReceiver(&bodyMesh);
+        for(int leg = 0;leg < legs_count;leg++) {
+            for(int tier = 0;tier < round_lod_tiers;tier++) baker.addReceiver(&legMesh[leg][tier]);
+        }
+        for(int p = 0;p < table->pocketCount;p++) baker.addOccluder(pocketMesh[p][0]);
+        bakeStats = baker.bake(lightmapPath.empty() ? defaultLightmapPath() : lightmapPath);
+    }
+
+    platform.upload(platformMesh, buffers);
+    body.upload(bodyMesh, buffers);
+    for(int tier = 0;tier < round_lod_tiers;tier++) {
+        for(int leg = 0;leg < legs_count;leg++) legMeshes[leg][tier].upload(legMesh[leg][tier], buffers);
+        for(int p = 0;p < table->pocketCount;p++) pocketMeshes[p][tier].upload(pocketMesh[p][tier], buffers);
+    }
+
+    Mesh mesh;
+    for(int tier = 0;tier < sphere_lod_tiers;tier++) {
+        mesh.clear();
+        buildSphereMesh(mesh, sphere_lod_segments[tier], sphere_lod_segments[tier]);
+        spheres[tier].upload(mesh, buffers);
+    }
+
+    ballTier.clear();
+    for(int leg = 0;leg < legs_count;leg++) legTier[leg] = -1;
+    for(int p = 0;p < max_pockets;p++) pocketTier[p] = -1;
+
+    initInstancing();
+}
+
+void Renderer::initInstancing() {
+    if(!buffers || !hasInstancedArrays()) return;
+
+    GLuint vertex = compileShader(GL_VERTEX_SHADER, instance_vertex_shader);
+    GLuint fragment = compileShader(GL_FRAGMENT_SHADER, instance_fragment_shader);
+    if(!vertex || !fragment) {
+        if(vertex) glDeleteShader(vertex);
+        if(fragment) glDeleteShader(fragment);
+        return;
+    }
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vertex);
+    glAttachShader(program, fragment);
+    glBindAttribLocation(program, attribute_position, "position");
+    glBindAttribLocation(program, attribute_instance, "instance");
+    glBindAttribLocation(program, attribute_instance_color, "instanceColor");
+    glLinkProgram(program);
+    glDeleteShader(vertex);
+    glDeleteShader(fragment);
+
+    GLint ok = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &ok);
+    if(!ok) {
+        std::cerr << "Ball shader failed to link, drawing balls one by one" << std::endl;
+        glDeleteProgram(program);
+        return;
+    }
+
+    instanceProgram = program;
+    glGenBuffers(1, &instanceBuffer);
+}
+
+void Renderer::release() {
+    platform.release();
+    body.release();
+    for(int tier = 0;tier < round_lod_tiers;tier++) {
+        for(int leg = 0;leg < legs_count;leg++) legMeshes[leg][tier].release();
+        for(int p = 0;p < max_pockets;p++) pocketMeshes[p][tier].release();
+    }
+    for(int tier = 0;tier < sphere_lod_tiers;tier++) {
+        spheres[tier].release();
+    }
+
+    if(instanceProgram) glDeleteProgram(instanceProgram);
+    if(instanceBuffer) glDeleteBuffers(1, &instanceBuffer);
+    instanceProgram = instanceBuffer = 0;
+}
+
+void Renderer::beginFrame() {
+    float projection[16], modelview[16];
+    glGetFloatv(GL_PROJECTION_MATRIX, projection);
+    glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+    frustum.fromMatrices(projection, modelview);
+
+    stats = RenderStats();
+}
+
+void Renderer::setProjection(float fovY, int viewportHeight) {
+    view.fovY = fovY;
+    view.viewportHeight = viewportHeight;
+}
+
+// Counts the object one way or the other, returns whether to draw it
+bool Renderer::visible(bool inside) {
+    if(!cullingEnabled || inside) {
+        stats.drawn++;
+        return true;
+    }
+    stats.culled++;
+    return false;
+}
+
+int Renderer::pickTier(int& tier, glm::vec3 center, float radius, const float* thresholds, int tiers) {
+    if(!lodEnabled) {
+        tier = 0;
+        return 0;
+    }
+    tier = selectLod(view.projectedSize(center, radius), thresholds, tiers, tier);
+    return tier;
+}
+
+void Renderer::drawPlatform() {
+    if(visible(frustum.boxVisible(glm::vec3(-20, 0, -20), glm::vec3(20, 0, 20)))) {
+        platform.draw();
+    }
+}
+
+void Renderer::drawTable() {
+    // Base, rails and the lamp bar above
+    glm::vec3 low(table->minX - 0.1f, 0.4, table->minZ - 0.1f), high(table->maxX + 0.1f, 1.6, table->maxZ + 0.1f);
+    if(visible(frustum.boxVisible(low, high))) {
+        body.draw();
+    }
+
+    // Bounding spheres around the middle of each leg and pocket
+    float legBound = sqrtf(leg_radius * leg_radius + leg_height * leg_height / 4);
+    for(int leg = 0;leg < legs_count;leg++) {
+        glm::vec3 center(legs[leg].x, leg_top - leg_height / 2, legs[leg].y);
+        if(!visible(frustum.sphereVisible(center, legBound))) continue;
+        int tier = pickTier(legTier[leg], center, legBound, round_lod_pixels, round_lod_tiers);
+        legMeshes[leg][tier].draw();
+    }
+
+    for(int p = 0;p < table->pocketCount;p++) {
+        const PocketDef& pocket = table->pockets[p];
+        float pocketBound = sqrtf(pocket.radius * pocket.radius + pocketDepth * pocketDepth / 4);
+        glm::vec3 center(pocket.x, pocket_top - pocketDepth / 2, pocket.z);
+        if(!visible(frustum.sphereVisible(center, pocketBound))) continue;
+        int tier = pickTier(pocketTier[p], center, pocketBound, round_lod_pixels, round_lod_tiers);
+        pocketMeshes[p][tier].draw();
+    }
+}
+
+// Frustum test and detail tier for every active ball
+void Renderer::updateBalls(const BallSet& balls) {
+    if(int(ballTier.size()) != balls.count) {
+        ballTier.assign(balls.count, -1);
+        ballVisible.assign(balls.count, 0);
+    }
+
+    for(int i = 0;i < balls.count;i++) {
+        ballVisible[i] = 0;
+        if(!balls.isActive(i)) continue;
+
+        glm::vec3 center(balls.x[i], balls.y[i], balls.z[i]);
+        if(!visible(frustum.sphereVisible(center, balls.radius[i]))) continue;
+
+        ballVisible[i] = 1;
+        pickTier(ballTier[i], center, balls.radius[i], sphere_lod_pixels, sphere_lod_tiers);
+    }
+}
+
+void Renderer::drawBalls(const BallSet& balls) {
+    updateBalls(balls);
+    if(ballShadows) drawBallShadows(balls);
+
+    if(instancingEnabled && instanceProgram) drawBallsInstanced(balls);
+    else drawBallsEach(balls);
+}
+
+void Renderer::drawBallsInstanced(const BallSet& balls) {
+
+    // Group the instances by tier, one instanced draw per tier in use
+    int start[sphere_lod_tiers + 1] = {0};
+    for(int i = 0;i < balls.count;i++) {
+        if(ballVisible[i]) start[ballTier[i] + 1]++;
+    }
+    for(int tier = 0;tier < sphere_lod_tiers;tier++) {
+        start[tier + 1] += start[tier];
+    }
+
+    instances.resize(start[sphere_lod_tiers]);
+    int fill[sphere_lod_tiers];
+    for(int tier = 0;tier < sphere_lod_tiers;tier++) fill[tier] = start[tier];
+
+    for(int i = 0;i < balls.count;i++) {
+        if(!ballVisible[i]) continue;
+
+        BallInstance& instance = instances[fill[ballTier[i]]++];
+        instance.x = balls.x[i];
+        instance.y = balls.y[i];
+        instance.z = balls.z[i];
+        instance.radius = balls.radius[i];
+        instance.r = balls.color[i].x;
+        instance.g = balls.color[i].y;
+        instance.b = balls.color[i].z;
+    }
+
+    if(instances.empty()) return;
+
+    glUseProgram(instanceProgram);
+
+    // Orphan last frame's storage so the driver doesn't have to wait on it
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(BallInstance), nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(BallInstance), instances.data());
+
+    glEnableVertexAttribArray(attribute_position);
+    glEnableVertexAttribArray(attribute_instance);
+    glEnableVertexAttribArray(attribute_instance_color);
+    glVertexAttribDivisor(attribute_instance, 1);
+    glVertexAttribDivisor(attribute_instance_color, 1);
+
+    for(int tier = 0;tier < sphere_lod_tiers;tier++) {
+        int count = start[tier + 1] - start[tier];
+        if(count == 0) continue;
+
+        const GpuMesh& sphere = spheres[tier];
+        glBindBuffer(GL_ARRAY_BUFFER, sphere.vertexBuffer());
+        glVertexAttribPointer(attribute_position, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void*)offsetof(Vertex, x));
+
+        size_t offset = start[tier] * sizeof(BallInstance);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        glVertexAttribPointer(attribute_instance, 4, GL_FLOAT, GL_FALSE, sizeof(BallInstance), (const void*)(offset + offsetof(BallInstance, x)));
+        glVertexAttribPointer(attribute_instance_color, 3, GL_FLOAT, GL_FALSE, sizeof(BallInstance), (const void*)(offset + offsetof(BallInstance, r)));
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere.indexBuffer());
+        glDrawElementsInstanced(GL_TRIANGLES, sphere.indexCount(), GL_UNSIGNED_INT, nullptr, count);
+        stats.ballDrawCalls++;
+    }
+
+    glVertexAttribDivisor(attribute_instance, 0);
+    glVertexAttribDivisor(attribute_instance_color, 0);
+    glDisableVertexAttribArray(attribute_instance_color);
+    glDisableVertexAttribArray(attribute_instance);
+    glDisableVertexAttribArray(attribute_position);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glUseProgram(0);
+}
+
+void Renderer::drawBallsEach(const BallSet& balls) {
+    for(int i = 0;i < balls.count;i++) {
+        if(!ballVisible[i]) continue;
+
+        glColor3f(balls.color[i].x, balls.color[i].y, balls.color[i].z);
+        glPushMatrix();
+        glTranslatef(balls.x[i], balls.y[i], balls.z[i]);
+        glScalef(balls.radius[i], balls.radius[i], balls.radius[i]);
+        spheres[ballTier[i]].draw(false);
+        glPopMatrix();
+        stats.ballDrawCalls++;
+    }
+}
+
+// A soft disc on the cloth under each visible ball: the ball seen from the
+// lamp and projected onto the cloth, dark in the middle and fading out to
+// the rim. All of them go out as one blended draw from client memory.
+void Renderer::drawBallShadows(const BallSet& balls) {
+    shadowVertices.clear();
+    float y = table_surface + shadow_lift;
+    for(int i = 0;i < balls.count;i++) {
+        if(!ballVisible[i] || balls.y[i] >= lamp_position.y) continue;
+
+        float scale = (lamp_position.y - y) / (lamp_position.y - balls.y[i]);
+        float x = lamp_position.x + (balls.x[i] - lamp_position.x) * scale;
+        float z = lamp_position.z + (balls.z[i] - lamp_position.z) * scale;
+        float radius = balls.radius[i] * scale * shadow_spread;
+
+        const UnitCircle<shadow_segments>& circle = unit_circle<shadow_segments>;
+        for(int s = 0;s < shadow_segments;s++) {
+            shadowVertices.push_back({x, y, z, 0, 0, 0, shadow_alpha});
+            shadowVertices.push_back({x + radius * circle.cosines[s], y, z + radius * circle.sines[s], 0, 0, 0, 0});
+            shadowVertices.push_back({x + radius * circle.cosines[s + 1], y, z + radius * circle.sines[s + 1], 0, 0, 0, 0});
+        }
+    }
+    if(shadowVertices.empty()) return;
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glDepthMask(GL_FALSE);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(3, GL_FLOAT, sizeof(ShadowVertex), &shadowVertices[0].x);
+    glColorPointer(4, GL_FLOAT, sizeof(ShadowVertex), &shadowVertices[0].r);
+
+    glDrawArrays(GL_TRIANGLES, 0, GLsizei(shadowVertices.size()));
+
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDepthMask(GL_TRUE);
+    glDisable(GL_BLEND);
+}
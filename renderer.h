@@ -0,0 +1,152 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include <GL/gl.h>
+#include <string>
+#include <vector>
+#include "camera.h"
+#include "frustum.h"
+#include "lightmap.h"
+#include "lod.h"
+#include "mesh.h"
+#include "physics.h"
+
+// A mesh living in GL buffer objects. When the context has no buffer objects
+// (GL < 1.5) it keeps the arrays on the CPU and draws them as client-side
+// vertex arrays instead, which still avoids per-vertex calls.
+class GpuMesh {
+public:
+    void upload(const Mesh& mesh, bool useBuffers);
+    // withColors = false leaves the color to the current glColor
+    void draw(bool withColors = true) const;
+    void release();
+
+    GLsizei indexCount() const { return count; }
+    // 0 when drawn from client memory
+    GLuint vertexBuffer() const { return vbo; }
+    GLuint indexBuffer() const { return ibo; }
+
+private:
+    GLuint vbo = 0, ibo = 0;
+    GLsizei count = 0;
+    Mesh cpu; // only filled without buffer objects
+};
+
+// gluLookAt for the camera, onto the current matrix
+void loadCamera(const Camera& camera);
+
+// Per-ball data for the instanced draw, streamed from the BallSet each frame
+struct BallInstance {
+    float x, y, z, radius;
+    float r, g, b;
+};
+
+// Corner of the ball shadow discs
+struct ShadowVertex {
+    float x, y, z;
+    float r, g, b, a;
+};
+
+// Ball shadows: segments around the disc, opacity in the middle, how much
+// wider than the projected ball they fade out and how far above the cloth
+// they sit so they don't fight with it in the depth buffer
+const int shadow_segments = 16;
+const float shadow_alpha = 0.6f;
+const float shadow_spread = 1.3f;
+const float shadow_lift = 0.001f;
+
+// What the last frame did, reset by beginFrame()
+struct RenderStats {
+    int drawn = 0;  // objects submitted (floor, table body, legs, pockets, balls)
+    int culled = 0; // objects skipped because they were outside the frustum
+    int ballDrawCalls = 0;
+};
+
+// Retained-mode scene renderer: the floor, the table and a unit sphere are
+// tessellated and uploaded once by init(), each frame is then a handful of
+// indexed draws.
+//
+// Balls go out as a single instanced draw of the sphere when the context has
+// instanced arrays (GL 3.3, or ARB_draw_instanced + ARB_instanced_arrays):
+// a tiny shader places and colors each instance from a per-instance buffer.
+// Otherwise every ball is its own draw of the same sphere buffers.
+//
+// The floor, table and legs carry light baked into their vertex colors at
+// init (see lightmap.h), the balls cast a blended blob shadow each.
+//
+// Balls, pockets and legs each come in a few detail tiers (see lod.h), picked
+// per object every frame from its size on screen. Anything whose bounds fall
+// outside the view frustum is skipped altogether.
+class Renderer {
+public:
+    // Needs a current GL context. table has to outlive the renderer.
+    void init(const TableDef& table = standard_table);
+    void release();
+
+    // Call after the camera is set up (gluLookAt) and before drawing: picks
+    // up the frustum from the current GL matrices and clears the stats
+    void beginFrame();
+
+    // Camera used for detail selection, call before drawing each frame
+    void setEye(glm::vec3 eye) { view.eye = eye; }
+    // Projection used for detail selection, call from the reshape callback
+    void setProjection(float fovY, int viewportHeight);
+
+    void drawPlatform();
+    void drawTable();
+    void drawBalls(const BallSet& balls);
+
+    bool usingBuffers() const { return buffers; }
+    bool instancingSupported() const { return instanceProgram != 0; }
+
+    // Lets the per-ball fallback be forced even where instancing works
+    bool instancingEnabled = true;
+    // false draws everything at the finest tier
+    bool lodEnabled = true;
+    // false submits everything
+    bool cullingEnabled = true;
+    // false draws no ball shadows
+    bool ballShadows = true;
+
+    // Read by init(): false keeps the flat colors; the bake is cached at
+    // lightmapPath, defaultLightmapPath() when that's empty
+    bool bakedLighting = true;
+    std::string lightmapPath;
+    // How init() got the lighting
+    BakeStats bakeStats;
+
+    RenderStats stats;
+
+private:
+    bool buffers = false;
+    LodView view;
+    Frustum frustum;
+
+    GpuMesh platform, body;
+    GpuMesh spheres[sphere_lod_tiers];
+    GpuMesh legMeshes[legs_count][round_lod_tiers];
+    GpuMesh pocketMeshes[max_pockets][round_lod_tiers];
+
+    // Tier each object was drawn at last frame, -1 before the first
+    std::vector<int> ballTier;
+    std::vector<uint8_t> ballVisible;
+    int legTier[legs_count];
+    int pocketTier[max_pockets];
+    const TableDef* table = &standard_table;
+
+    GLuint instanceProgram = 0;
+    GLuint instanceBuffer = 0;
+    std::vector<BallInstance> instances;
+
+    std::vector<ShadowVertex> shadowVertices;
+
+    void initInstancing();
+    bool visible(bool inside);
+    int pickTier(int& tier, glm::vec3 center, float radius, const float* thresholds, int tiers);
+    void updateBalls(const BallSet& balls);
+    void drawBallsInstanced(const BallSet& balls);
+    void drawBallsEach(const BallSet& balls);
+    void drawBallShadows(const BallSet& balls);
+};
+
+#endif
@@ -0,0 +1,377 @@
+#include "replay.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+enum RecordType : uint32_t { record_shot = 1, record_keyframe = 2, record_checksum = 3 };
+
+const char header_magic[4] = {'B', 'R', 'P', 'L'};
+const char trailer_magic[8] = "BRPLIDX";
+
+// Keyframe payload: count, then every per-ball field as its own array
+static void serialize(const BallSet& balls, std::vector<uint8_t>& out) {
+    out.clear();
+    auto put = [&out](const void* data, size_t size) {
+        const uint8_t* bytes = (const uint8_t*)data;
+        out.insert(out.end(), bytes, bytes + size);
+    };
+
+    uint32_t count[2] = {uint32_t(balls.count), 0};
+    size_t n = balls.count;
+    put(count, sizeof(count));
+    put(balls.x.data(), n * sizeof(float));
+    put(balls.y.data(), n * sizeof(float));
+    put(balls.z.data(), n * sizeof(float));
+    put(balls.vx.data(), n * sizeof(float));
+    put(balls.vz.data(), n * sizeof(float));
+    put(balls.wx.data(), n * sizeof(float));
+    put(balls.wz.data(), n * sizeof(float));
+    put(balls.radius.data(), n * sizeof(float));
+    put(balls.mass.data(), n * sizeof(float));
+    put(balls.color.data(), n * sizeof(glm::vec3));
+    while(out.size() % 8) out.push_back(0);
+    put(balls.activeMask.data(), (n + 63) / 64 * sizeof(uint64_t));
+}
+
+// Bytes serialize() writes for count balls
+static uint64_t payloadSize(uint64_t count) {
+    uint64_t size = 8 + count * (9 * sizeof(float) + sizeof(glm::vec3));
+    return (size + 7) / 8 * 8 + (count + 63) / 64 * sizeof(uint64_t);
+}
+
+// Whether keyframe's payload lies inside the size bytes at data and holds
+// exactly the balls its count says
+static bool validKeyframe(const ReplayKeyframe& keyframe, const uint8_t* data, uint64_t size) {
+    if(keyframe.offset > size || keyframe.size < 8 || keyframe.size > size - keyframe.offset) return false;
+    uint32_t count;
+    memcpy(&count, data + keyframe.offset, sizeof(count));
+    return payloadSize(count) == keyframe.size;
+}
+
+// in must hold payloadSize() of its count, see validKeyframe()
+static void deserialize(const uint8_t* in, BallSet& balls) {
+    uint32_t count;
+    memcpy(&count, in, sizeof(count));
+    size_t offset = 8;
+    auto get = [&](void* data, size_t size) {
+        memcpy(data, in + offset, size);
+        offset += size;
+    };
+
+    balls.resize(count);
+    get(balls.x.data(), count * sizeof(float));
+    get(balls.y.data(), count * sizeof(float));
+    get(balls.z.data(), count * sizeof(float));
+    get(balls.vx.data(), count * sizeof(float));
+    get(balls.vz.data(), count * sizeof(float));
+    get(balls.wx.data(), count * sizeof(float));
+    get(balls.wz.data(), count * sizeof(float));
+    get(balls.radius.data(), count * sizeof(float));
+    get(balls.mass.data(), count * sizeof(float));
+    get(balls.color.data(), count * sizeof(glm::vec3));
+    offset = (offset + 7) / 8 * 8;
+    get(balls.activeMask.data(), (count + 63) / 64 * sizeof(uint64_t));
+}
+
+bool ReplayWriter::open(const std::string& path, SolverMode mode) {
+    finish();
+    file = fopen(path.c_str(), "wb");
+    if(!file) return false;
+
+    ReplayHeader header = {};
+    memcpy(header.magic, header_magic, sizeof(header.magic));
+    header.version = replay_version;
+    header.solverMode = uint32_t(mode);
+    header.keyframeInterval = replay_keyframe_interval;
+    strncpy(header.scalar, physics_scalar_name, sizeof(header.scalar) - 1);
+    fwrite(&header, sizeof(header), 1, file);
+    offset = sizeof(header);
+
+    keyframes.clear();
+    shots.clear();
+    checksums.clear();
+    return true;
+}
+
+void ReplayWriter::record(uint32_t type, const void* data, uint32_t size) {
+    uint32_t head[2] = {type, size};
+    fwrite(head, sizeof(head), 1, file);
+    fwrite(data, size, 1, file);
+    offset += sizeof(head) + size;
+}
+
+void ReplayWriter::keyframe(long tick, const World& world, bool reset) {
+    if(!file) return;
+
+    // A new rack wipes whatever this tick's shots did
+    if(reset) {
+        while(!shots.empty() && shots.back().tick == tick) shots.pop_back();
+    }
+
+    // Tick and flags go in front of the ball state
+    buffer.clear();
+    int64_t head[2] = {tick, reset};
+    std::vector<uint8_t> state;
+    serialize(world.balls, state);
+    buffer.resize(sizeof(head));
+    memcpy(buffer.data(), head, sizeof(head));
+    buffer.insert(buffer.end(), state.begin(), state.end());
+
+    ReplayKeyframe entry;
+    entry.tick = tick;
+    entry.offset = offset + 8 + sizeof(head);
+    entry.reset = reset;
+    entry.size = uint32_t(state.size());
+    keyframes.push_back(entry);
+
+    record(record_keyframe, buffer.data(), uint32_t(buffer.size()));
+}
+
+void ReplayWriter::shot(long tick, glm::vec3 direction, float strength) {
+    if(!file) return;
+
+    ReplayShot entry;
+    entry.tick = tick;
+    entry.dirX = direction.x;
+    entry.dirY = direction.y;
+    entry.dirZ = direction.z;
+    entry.strength = strength;
+    shots.push_back(entry);
+
+    record(record_shot, &entry, sizeof(entry));
+}
+
+void ReplayWriter::checksum(long tick, const World& world) {
+    if(!file || !checksumTicks) return;
+
+    ReplayChecksum entry;
+    entry.tick = tick;
+    entry.checksum = world.checksum();
+    checksums.push_back(entry);
+
+    record(record_checksum, &entry, sizeof(entry));
+}
+
+void ReplayWriter::finish() {
+    if(!file) return;
+
+    // The payloads are multiples of 8 bytes, so the index is already aligned
+    ReplayTrailer trailer;
+    trailer.indexOffset = offset;
+    trailer.keyframeCount = keyframes.size();
+    trailer.shotCount = shots.size();
+    trailer.checksumCount = checksums.size();
+    memcpy(trailer.magic, trailer_magic, sizeof(trailer.magic));
+
+    fwrite(keyframes.data(), sizeof(ReplayKeyframe), keyframes.size(), file);
+    fwrite(shots.data(), sizeof(ReplayShot), shots.size(), file);
+    fwrite(checksums.data(), sizeof(ReplayChecksum), checksums.size(), file);
+    fwrite(&trailer, sizeof(trailer), 1, file);
+    fclose(file);
+    file = nullptr;
+}
+
+bool ReplayReader::open(const std::string& path) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0) return false;
+
+    struct stat info;
+    if(fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(ReplayHeader)) {
+        ::close(fd);
+        return false;
+    }
+
+    void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(mapping == MAP_FAILED) return false;
+    data = (const uint8_t*)mapping;
+    size = info.st_size;
+
+    memcpy(&header, data, sizeof(header));
+    if(memcmp(header.magic, header_magic, sizeof(header.magic)) != 0 || header.version != replay_version ||
+       header.solverMode > uint32_t(SolverMode::Continuous)) {
+        close();
+        return false;
+    }
+
+    ReplayTrailer trailer;
+    bool indexed = false;
+    if(size >= sizeof(header) + sizeof(trailer)) {
+        memcpy(&trailer, data + size - sizeof(trailer), sizeof(trailer));
+        // Counts are bounded by the file first, so the sum can't overflow
+        bool counted = trailer.keyframeCount <= size / sizeof(ReplayKeyframe) && trailer.shotCount <= size / sizeof(ReplayShot) &&
+                       trailer.checksumCount <= size / sizeof(ReplayChecksum) && trailer.indexOffset <= size;
+        uint64_t indexSize = trailer.keyframeCount * sizeof(ReplayKeyframe) + trailer.shotCount * sizeof(ReplayShot) +
+                             trailer.checksumCount * sizeof(ReplayChecksum);
+        indexed = memcmp(trailer.magic, trailer_magic, sizeof(trailer.magic)) == 0 && counted &&
+                  trailer.indexOffset % 8 == 0 && trailer.indexOffset >= sizeof(header) &&
+                  trailer.indexOffset + indexSize + sizeof(trailer) == size;
+    }
+
+    if(indexed) {
+        keyframes = (const ReplayKeyframe*)(data + trailer.indexOffset);
+        numKeyframes = trailer.keyframeCount;
+        shots = (const ReplayShot*)(keyframes + numKeyframes);
+        numShots = trailer.shotCount;
+        checksums = (const ReplayChecksum*)(shots + numShots);
+        numChecksums = trailer.checksumCount;
+    }
+    else if(!scan()) {
+        close();
+        return false;
+    }
+
+    // Keyframes are read straight from the mapping, none may point outside it
+    for(size_t i = 0;i < numKeyframes;i++) {
+        if(!validKeyframe(keyframes[i], data, size)) {
+            close();
+            return false;
+        }
+    }
+
+    return numKeyframes > 0;
+}
+
+// Rebuild the index from the records of a file that was never finished
+bool ReplayReader::scan() {
+    scannedKeyframes.clear();
+    scannedShots.clear();
+    scannedChecksums.clear();
+
+    size_t offset = sizeof(ReplayHeader);
+    while(offset + 8 <= size) {
+        uint32_t head[2];
+        memcpy(head, data + offset, sizeof(head));
+        offset += sizeof(head);
+        if(offset + head[1] > size) break; // cut off mid record
+
+        if(head[0] == record_shot && head[1] == sizeof(ReplayShot)) {
+            ReplayShot shot;
+            memcpy(&shot, data + offset, sizeof(shot));
+            scannedShots.push_back(shot);
+        }
+        else if(head[0] == record_checksum && head[1] == sizeof(ReplayChecksum)) {
+            ReplayChecksum checksum;
+            memcpy(&checksum, data + offset, sizeof(checksum));
+            scannedChecksums.push_back(checksum);
+        }
+        else if(head[0] == record_keyframe && head[1] >= 16) {
+            int64_t keyHead[2];
+            memcpy(keyHead, data + offset, sizeof(keyHead));
+
+            ReplayKeyframe keyframe;
+            keyframe.tick = keyHead[0];
+            keyframe.offset = offset + sizeof(keyHead);
+            keyframe.reset = keyHead[1] != 0;
+            keyframe.size = head[1] - sizeof(keyHead);
+            if(keyframe.reset) {
+                while(!scannedShots.empty() && scannedShots.back().tick == keyframe.tick) scannedShots.pop_back();
+            }
+            scannedKeyframes.push_back(keyframe);
+        }
+        else break;
+
+        offset += head[1];
+    }
+
+    keyframes = scannedKeyframes.data();
+    numKeyframes = scannedKeyframes.size();
+    shots = scannedShots.data();
+    numShots = scannedShots.size();
+    checksums = scannedChecksums.data();
+    numChecksums = scannedChecksums.size();
+    return true;
+}
+
+void ReplayReader::close() {
+    if(data) munmap((void*)data, size);
+    data = nullptr;
+    size = 0;
+    keyframes = nullptr;
+    shots = nullptr;
+    checksums = nullptr;
+    numKeyframes = numShots = numChecksums = 0;
+    scannedKeyframes.clear();
+    scannedShots.clear();
+    scannedChecksums.clear();
+}
+
+void ReplayReader::load(const ReplayKeyframe& keyframe, World& world) const {
+    world.mode = mode();
+    deserialize(data + keyframe.offset, world.balls);
+}
+
+bool ReplayReader::matches(const ReplayKeyframe& keyframe, const World& world) const {
+    std::vector<uint8_t> state;
+    serialize(world.balls, state);
+    return state.size() == keyframe.size && memcmp(state.data(), data + keyframe.offset, state.size()) == 0;
+}
+
+bool ReplayReader::seek(World& world, long tick) const {
+    if(numKeyframes == 0 || tick < firstTick()) return false;
+
+    // Last keyframe at or before tick; a reset sorts after the periodic
+    // keyframe of the same tick, so it wins
+    const ReplayKeyframe* end = keyframes + numKeyframes;
+    const ReplayKeyframe* keyframe = std::upper_bound(keyframes, end, tick, [](long t, const ReplayKeyframe& k) {
+        return t < k.tick;
+    }) - 1;
+
+    load(*keyframe, world);
+    // Shots of the keyframe's own tick come after it
+    play(world, keyframe->tick, tick);
+    return true;
+}
+
+void ReplayReader::apply(World& world, long tick) const {
+    const ReplayKeyframe* end = keyframes + numKeyframes;
+    const ReplayKeyframe* keyframe = std::lower_bound(keyframes, end, tick, [](const ReplayKeyframe& k, long t) {
+        return k.tick < t;
+    });
+    for(;keyframe < end && keyframe->tick == tick;keyframe++) {
+        if(keyframe->reset) load(*keyframe, world);
+    }
+
+    const ReplayShot* shotEnd = shots + numShots;
+    const ReplayShot* shot = std::lower_bound(shots, shotEnd, tick, [](const ReplayShot& s, long t) {
+        return s.tick < t;
+    });
+    for(;shot < shotEnd && shot->tick == tick;shot++) {
+        world.setMovement(0, glm::vec3(shot->dirX, shot->dirY, shot->dirZ) * shot->strength);
+    }
+}
+
+void ReplayReader::play(World& world, long from, long to) const {
+    for(long tick = from;tick < to;tick++) {
+        apply(world, tick);
+        world.advance(1);
+    }
+}
+
+long ReplayReader::verify() const {
+    if(numKeyframes == 0) return -1;
+    if(!sameScalar()) return -2;
+
+    World world;
+    load(keyframes[0], world);
+
+    size_t next = 1, nextChecksum = 0;
+    for(long tick = firstTick();;tick++) {
+        for(;nextChecksum < numChecksums && checksums[nextChecksum].tick <= tick;nextChecksum++) {
+            if(checksums[nextChecksum].tick == tick && checksums[nextChecksum].checksum != world.checksum()) return tick;
+        }
+        for(;next < numKeyframes && keyframes[next].tick == tick;next++) {
+            if(!keyframes[next].reset && !matches(keyframes[next], world)) return tick;
+        }
+        if(tick >= endTick()) break;
+
+        apply(world, tick);
+        world.advance(1);
+    }
+    return -1;
+}
@@ -0,0 +1,170 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "physics.h"
+
+// Binary game recordings. Playback is re-simulation: the file holds the rack,
+// every shot and a keyframe of the full ball state every so often, and the
+// physics fills in the rest. That only works because stepping is
+// deterministic, one World::advance(1) per tick in the recorded solver mode,
+// so verify() doubles as a regression test for physics changes. A recording
+// can also carry World::checksum() of every tick, which lets verify() name the
+// exact tick a build or machine starts to disagree instead of the next
+// keyframe.
+//
+// Layout, little-endian:
+//   ReplayHeader
+//   records: uint32 type, uint32 size, then size bytes (shot, keyframe or checksum)
+//   index:   ReplayKeyframe[keyframes], ReplayShot[shots], ReplayChecksum[checksums],
+//            8-byte aligned
+//   ReplayTrailer
+// The index is what makes the file usable straight from mmap: seeking is a
+// binary search over it. A file whose recording was cut short has no index
+// and is read by scanning the records instead.
+
+// 2: keyframes carry the rolling velocity of the sliding/rolling model
+// 3: per-tick checksums
+// 4: the physics scalar of the recording build
+// 5: continuous mode predicts pairs only inside each call, older continuous
+//    recordings re-simulate differently
+// 6: ball contacts weigh the balls by mass rather than radius
+const uint32_t replay_version = 6;
+// Ticks between periodic keyframes, the most a seek has to re-simulate
+const int replay_keyframe_interval = 300;
+
+struct ReplayHeader {
+    char magic[4]; // "BRPL"
+    uint32_t version;
+    uint32_t solverMode; // SolverMode the game was played in
+    uint32_t keyframeInterval;
+    char scalar[8]; // physics_scalar_name of the build that recorded it
+};
+
+struct ReplayTrailer {
+    uint64_t indexOffset;
+    uint64_t keyframeCount;
+    uint64_t shotCount;
+    uint64_t checksumCount;
+    char magic[8]; // "BRPLIDX"
+};
+
+struct ReplayKeyframe {
+    int64_t tick;    // state after tick ticks, before that tick's shots
+    uint64_t offset; // of the keyframe payload
+    uint32_t reset;  // 1 when the state was set (rack) rather than simulated
+    uint32_t size;   // payload bytes
+};
+
+struct ReplayShot {
+    int64_t tick;
+    float dirX, dirY, dirZ; // cue direction, camera.getPropperVector()
+    float strength;
+};
+
+struct ReplayChecksum {
+    int64_t tick; // state after tick ticks, like a keyframe
+    uint64_t checksum;
+};
+
+// Records a game as it is played. Not thread safe, call from the thread that
+// steps the World.
+class ReplayWriter {
+public:
+    ~ReplayWriter() { finish(); }
+
+    bool open(const std::string& path, SolverMode mode);
+    bool isOpen() const { return file != nullptr; }
+
+    // reset marks state that simulation can't reach, like a fresh rack. A
+    // reset keyframe replaces any shot recorded earlier in the same tick.
+    void keyframe(long tick, const World& world, bool reset = false);
+    void shot(long tick, glm::vec3 direction, float strength);
+    // Record world.checksum(), does nothing unless checksumTicks is set
+    void checksum(long tick, const World& world);
+
+    // Write the index and close
+    void finish();
+
+    // Whether checksum() calls are recorded, 40 bytes a tick with the index entry
+    bool checksumTicks = false;
+
+private:
+    FILE* file = nullptr;
+    uint64_t offset = 0;
+    std::vector<ReplayKeyframe> keyframes;
+    std::vector<ReplayShot> shots;
+    std::vector<ReplayChecksum> checksums;
+    std::vector<uint8_t> buffer;
+
+    void record(uint32_t type, const void* data, uint32_t size);
+};
+
+// Reads a recording through a read-only memory map
+class ReplayReader {
+public:
+    ReplayReader() {}
+    ~ReplayReader() { close(); }
+
+    ReplayReader(const ReplayReader&) = delete;
+    ReplayReader& operator=(const ReplayReader&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+
+    SolverMode mode() const { return SolverMode(header.solverMode); }
+    long firstTick() const { return numKeyframes ? keyframes[0].tick : 0; }
+    // Tick of the last keyframe, the end of the recording
+    long endTick() const { return numKeyframes ? keyframes[numKeyframes - 1].tick : 0; }
+    size_t keyframeCount() const { return numKeyframes; }
+    size_t shotCount() const { return numShots; }
+    size_t checksumCount() const { return numChecksums; }
+    // Physics scalar of the recording build, and whether this build uses it
+    // too; re-simulation in another one diverges by design
+    std::string scalar() const { return std::string(header.scalar, strnlen(header.scalar, sizeof(header.scalar))); }
+    bool sameScalar() const { return scalar() == physics_scalar_name; }
+
+    // Put world into the recorded state at tick: the nearest keyframe at or
+    // before it, then re-simulation up to it
+    bool seek(World& world, long tick) const;
+
+    // What happens at the start of tick: reset keyframes are loaded, shots
+    // applied. Call before advancing world past tick.
+    void apply(World& world, long tick) const;
+
+    // Re-simulate from tick from to tick to, world has to be at from
+    void play(World& world, long from, long to) const;
+
+    // Re-simulate the whole recording, comparing every keyframe bit for bit
+    // and every recorded checksum. Returns the tick of the first mismatch, -1
+    // when all match and -2 without trying when the build's physics scalar
+    // isn't the recording's.
+    long verify() const;
+
+private:
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    ReplayHeader header = {};
+
+    const ReplayKeyframe* keyframes = nullptr;
+    size_t numKeyframes = 0;
+    const ReplayShot* shots = nullptr;
+    size_t numShots = 0;
+    const ReplayChecksum* checksums = nullptr;
+    size_t numChecksums = 0;
+
+    // Index rebuilt by scanning when the file has none
+    std::vector<ReplayKeyframe> scannedKeyframes;
+    std::vector<ReplayShot> scannedShots;
+    std::vector<ReplayChecksum> scannedChecksums;
+
+    bool scan();
+    void load(const ReplayKeyframe& keyframe, World& world) const;
+    bool matches(const ReplayKeyframe& keyframe, const World& world) const;
+};
+
+#endif
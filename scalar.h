@@ -0,0 +1,167 @@
+#ifndef SCALAR_H
+#define SCALAR_H
+
+// Scalar types for the fixed-tick physics and the few math functions it
+// needs, in versions that give the same bits on every machine.
+//
+// IEEE float and double are reproducible as long as every build rounds the
+// same way: +, -, *, / and sqrt are correctly rounded, so only contraction
+// into FMAs (we build with -ffp-contract=off), -ffast-math, x87 excess
+// precision and libm calls like sin/cos can make two machines disagree. The
+// first three are rejected below; the physics uses no libm beyond sqrt, and
+// detSinCos() covers the one place that needs an angle. Fixed-point needs
+// none of that, integer arithmetic is the same everywhere.
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+#ifdef __FAST_MATH__
+#error "The physics must not be built with -ffast-math, replays and checksums depend on IEEE rounding"
+#endif
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD != 0
+#error "The physics needs float math evaluated at float precision (SSE2, not x87)"
+#endif
+
+__extension__ typedef __int128 int128_t;
+
+// Signed fixed-point with Frac fraction bits stored in Rep; Wide holds a
+// product of two Reps. Products round to nearest, quotients truncate.
+template<int Frac, class Rep, class Wide>
+struct Fixed {
+    static constexpr Wide one = Wide(1) << Frac;
+
+    Rep raw = 0;
+
+    constexpr Fixed() = default;
+    // Nearest fixed value; the scale is a power of two so v * one is exact
+    explicit Fixed(double v) : raw(Rep(std::floor(v * double(one) + 0.5))) {}
+
+    static constexpr Fixed fromRaw(Rep raw) {
+        Fixed f;
+        f.raw = raw;
+        return f;
+    }
+
+    explicit operator double() const { return double(raw) / double(one); }
+    explicit operator float() const { return float(double(*this)); }
+
+    Fixed operator-() const { return fromRaw(-raw); }
+    Fixed operator+(Fixed b) const { return fromRaw(raw + b.raw); }
+    Fixed operator-(Fixed b) const { return fromRaw(raw - b.raw); }
+    Fixed operator*(Fixed b) const { return fromRaw(Rep((Wide(raw) * b.raw + (one >> 1)) >> Frac)); }
+    Fixed operator/(Fixed b) const { return fromRaw(Rep(Wide(raw) * one / b.raw)); }
+
+    Fixed& operator+=(Fixed b) { return *this = *this + b; }
+    Fixed& operator-=(Fixed b) { return *this = *this - b; }
+    Fixed& operator*=(Fixed b) { return *this = *this * b; }
+    Fixed& operator/=(Fixed b) { return *this = *this / b; }
+
+    bool operator==(Fixed b) const { return raw == b.raw; }
+    bool operator!=(Fixed b) const { return raw != b.raw; }
+    bool operator<(Fixed b) const { return raw < b.raw; }
+    bool operator<=(Fixed b) const { return raw <= b.raw; }
+    bool operator>(Fixed b) const { return raw > b.raw; }
+    bool operator>=(Fixed b) const { return raw >= b.raw; }
+};
+
+// Q16.16 resolves 1.5e-5 table units, coarse next to the rolling resistance
+// of 6.25e-5 per tick; Q32.32 is finer than float everywhere on the table.
+typedef Fixed<16, int32_t, int64_t> Q16_16;
+typedef Fixed<32, int64_t, int128_t> Q32_32;
+
+// Largest value of a scalar, infinity where there is one. Stands for "never"
+// in durations.
+template<class T>
+struct ScalarLimits {
+    static T max() { return T(HUGE_VAL); }
+};
+
+template<int Frac, class Rep, class Wide>
+struct ScalarLimits<Fixed<Frac, Rep, Wide>> {
+    static Fixed<Frac, Rep, Wide> max() { return Fixed<Frac, Rep, Wide>::fromRaw(std::numeric_limits<Rep>::max()); }
+};
+
+// IEEE sqrt is correctly rounded, so the hardware instruction is deterministic
+inline float detSqrt(float v) { return std::sqrt(v); }
+inline double detSqrt(double v) { return std::sqrt(v); }
+
+// Floor of the square root of n >= 0. The double estimate is off by a unit
+// or two at most and the integer steps make it exact, so the result doesn't
+// depend on how the estimate rounded.
+template<class Int>
+Int integerSqrt(Int n) {
+    Int root = Int(std::sqrt(double(n)));
+    while(root > 0 && root * root > n) root--;
+    while((root + 1) * (root + 1) <= n) root++;
+    return root;
+}
+
+// sqrt(raw / one) = sqrt(raw * one) / one, rounded down
+template<int Frac, class Rep, class Wide>
+Fixed<Frac, Rep, Wide> detSqrt(Fixed<Frac, Rep, Wide> v) {
+    if(v.raw <= 0) return Fixed<Frac, Rep, Wide>();
+    return Fixed<Frac, Rep, Wide>::fromRaw(Rep(integerSqrt(Wide(v.raw) * Fixed<Frac, Rep, Wide>::one)));
+}
+
+// Length of (a, b). Fixed-point squares the raw values so small vectors
+// don't vanish: 0.004 squared is below the resolution of Q16.16.
+inline float detLength(float a, float b) { return detSqrt(a * a + b * b); }
+inline double detLength(double a, double b) { return detSqrt(a * a + b * b); }
+
+template<int Frac, class Rep, class Wide>
+Fixed<Frac, Rep, Wide> detLength(Fixed<Frac, Rep, Wide> a, Fixed<Frac, Rep, Wide> b) {
+    return Fixed<Frac, Rep, Wide>::fromRaw(Rep(integerSqrt(Wide(a.raw) * a.raw + Wide(b.raw) * b.raw)));
+}
+
+// sin and cos without libm: reduce to a quarter turn around 0, then Taylor
+// series. Off from libm by up to about 2e-14 absolute for angles within
+// +-50 radians, the error of the reduction growing with the angle.
+inline void detSinCos(double angle, double& s, double& c) {
+    double k = std::floor(angle * 0.6366197723675814 + 0.5);
+    double r = angle - k * 1.5707963267948966;
+    double r2 = r * r;
+
+    double sr = r * (1 + r2 * (-1.0 / 6 + r2 * (1.0 / 120 + r2 * (-1.0 / 5040 + r2 * (1.0 / 362880 +
+                r2 * (-1.0 / 39916800 + r2 * (1.0 / 6227020800)))))));
+    double cr = 1 + r2 * (-0.5 + r2 * (1.0 / 24 + r2 * (-1.0 / 720 + r2 * (1.0 / 40320 + r2 * (-1.0 / 3628800 +
+                r2 * (1.0 / 479001600 + r2 * (-1.0 / 87178291200)))))));
+
+    switch(int64_t(k) & 3) {
+    case 0: s = sr; c = cr; break;
+    case 1: s = cr; c = -sr; break;
+    case 2: s = -sr; c = -cr; break;
+    default: s = -cr; c = sr; break;
+    }
+}
+
+// The scalars the fixed-tick physics computes in, chosen at build time with
+// the BILLIARDS_SCALAR CMake option (float, double, q16 or q32). Positions
+// and velocities are stored as float either way; Q16.16 values convert to
+// float exactly. Left unset, motion runs in double and contacts in float.
+// The continuous solver always works in double and solves its quartics with
+// libm's acos and cbrt, so only FixedTick runs are reproducible across
+// machines with different libms.
+#if defined(BILLIARDS_SCALAR_Q16)
+typedef Q16_16 MotionScalar;
+typedef Q16_16 ContactScalar;
+const char* const physics_scalar_name = "q16";
+#elif defined(BILLIARDS_SCALAR_Q32)
+typedef Q32_32 MotionScalar;
+typedef Q32_32 ContactScalar;
+const char* const physics_scalar_name = "q32";
+#elif defined(BILLIARDS_SCALAR_DOUBLE)
+typedef double MotionScalar;
+typedef double ContactScalar;
+const char* const physics_scalar_name = "double";
+#elif defined(BILLIARDS_SCALAR_FLOAT)
+typedef float MotionScalar;
+typedef float ContactScalar;
+const char* const physics_scalar_name = "float";
+#else
+typedef double MotionScalar;
+typedef float ContactScalar;
+const char* const physics_scalar_name = "native";
+#endif
+
+#endif
@@ -0,0 +1,180 @@
+// Spectator server: many headless tables playing random shots, streamed to
+// every connected viewer (see spectator.h):
+//   billiards_server [--listen=<address>] [--tables=<n>] [--seconds=<s>] [--seed=<n>]
+//                    [--table-file=<asset>] [--rack=<name>] [--loopback=<viewers>]
+//   billiards_server --probe=<address> [--seconds=<s>]
+// Addresses are tcp:<host>:<port> or unix:<path>, tcp:127.0.0.1:7777 by
+// default. --loopback starts that many stand-in viewers inside the server
+// process; --probe is the same viewer on its own, against a running server.
+// Both print bandwidth and latency once a second. The game watches a table
+// with billiards --spectate=<address> --table=<n>.
+#include <poll.h>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "profiler.h"
+#include "spectator.h"
+#include "table_batch.h"
+
+const int tick_rate = 60;
+// Ticks a table sits at rest before its next shot
+const int shot_delay = 120;
+
+static std::atomic<bool> running{true};
+
+// Stand-in viewer: decode and ack frames, report once a second. Stops after
+// seconds seconds (0 runs until the server goes away or running is cleared).
+static int probe(const std::string& address, double seconds, const char* label) {
+    using Clock = std::chrono::steady_clock;
+    SpectatorClient client;
+    Clock::time_point start = Clock::now(), report = start + std::chrono::seconds(1);
+    while(!client.connect(address)) {
+        if(!running || Clock::now() - start > std::chrono::seconds(5)) {
+            fprintf(stderr, "%s: can't connect to %s\n", label, address.c_str());
+            return 1;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+
+    while(running) {
+        pollfd pfd = {client.socket(), POLLIN, 0};
+        ::poll(&pfd, 1, 100);
+        if(client.poll() < 0) {
+            fprintf(stderr, "%s: server closed the stream\n", label);
+            break;
+        }
+
+        Clock::time_point now = Clock::now();
+        if(now >= report) {
+            const SpectatorStats& s = client.stats;
+            fprintf(stderr, "%s: tick %ld, %d tables, %llu frames, %.1f KB/s, %.1f balls/frame, latency %.3f ms mean %.3f ms max\n",
+                    label, client.tick, client.tableCount(), (unsigned long long)s.frames, s.bytes / 1024.0,
+                    s.frames ? double(s.ballsSent) / s.frames : 0.0, s.meanLatency(), s.latencyMax);
+            client.stats = SpectatorStats();
+            report += std::chrono::seconds(1);
+        }
+        if(seconds > 0 && now - start > std::chrono::duration<double>(seconds)) break;
+    }
+    return 0;
+}
+
+// Next shot on a table that came to rest: a random hit of the cue ball, or a
+// new rack once the cue ball or the last object ball is gone
+static void shoot(World& table, std::mt19937& random) {
+    int onTable = 0;
+    for(int i = 0;i < table.balls.count;i++) onTable += table.balls.isActive(i);
+    if(!table.balls.isActive(0) || onTable < 2) table.rack();
+
+    std::uniform_real_distribution<float> angle(0, 2 * float(M_PI)), speed(0.02f, 0.1f);
+    float a = angle(random), s = speed(random);
+    table.setMovement(0, glm::vec3(s * cosf(a), 0, s * sinf(a)));
+}
+
+int main(int argc, char** argv) {
+    std::string address = "tcp:127.0.0.1:7777", probeAddress, tablePath, rackName;
+    int tableCount = 64, loopback = 0;
+    unsigned seed = 1;
+    double seconds = 0;
+
+    for(int i = 1;i < argc;i++) {
+        std::string arg = argv[i];
+        std::string value = arg.substr(arg.find('=') + 1);
+        bool ok = arg.find('=') != std::string::npos;
+        if(arg.compare(0, 9, "--listen=") == 0) address = value;
+        else if(arg.compare(0, 9, "--tables=") == 0) ok = (tableCount = atoi(value.c_str())) > 0;
+        else if(arg.compare(0, 10, "--seconds=") == 0) ok = (seconds = atof(value.c_str())) >= 0;
+        else if(arg.compare(0, 7, "--seed=") == 0) seed = unsigned(atol(value.c_str()));
+        else if(arg.compare(0, 11, "--loopback=") == 0) ok = (loopback = atoi(value.c_str())) >= 0;
+        else if(arg.compare(0, 8, "--probe=") == 0) probeAddress = value;
+        else if(arg.compare(0, 13, "--table-file=") == 0) tablePath = value;
+        else if(arg.compare(0, 7, "--rack=") == 0) rackName = value;
+        else ok = false;
+
+        if(!ok) {
+            fprintf(stderr, "Bad argument %s, see the top of server.cpp for usage\n", arg.c_str());
+            return 1;
+        }
+    }
+
+    if(!probeAddress.empty()) return probe(probeAddress, seconds, "probe");
+
+    TableAsset asset;
+    if(!tablePath.empty() && !asset.load(tablePath)) return 1;
+    const TableDef& def = asset.isOpen() ? asset.table() : standard_table;
+
+    SpectatorServer server;
+    if(!server.listen(address)) return 1;
+    PROFILE_THREAD("server");
+
+    TableBatch batch(tableCount);
+    for(World& table : batch.tables) {
+        if(!table.setTable(def, rackName.empty() ? nullptr : rackName.c_str())) {
+            fprintf(stderr, "%s has no rack %s\n", def.name, rackName.c_str());
+            return 1;
+        }
+    }
+    batch.rack();
+    std::mt19937 random(seed);
+    std::vector<int> idle(tableCount, shot_delay);
+
+    std::vector<std::thread> viewers;
+    std::vector<std::string> labels(loopback);
+    for(int i = 0;i < loopback;i++) {
+        labels[i] = "viewer " + std::to_string(i);
+        viewers.emplace_back(probe, address, 0.0, labels[i].c_str());
+    }
+
+    using Clock = std::chrono::steady_clock;
+    const Clock::duration period = std::chrono::nanoseconds(1000000000 / tick_rate);
+    Clock::time_point start = Clock::now(), next = start, report = start + std::chrono::seconds(1);
+    double stepMs = 0, broadcastMs = 0;
+    long tick = 0;
+
+    fprintf(stderr, "Serving %d tables on %s\n", tableCount, address.c_str());
+    for(;;tick++) {
+        Clock::time_point t0 = Clock::now();
+        for(int i = 0;i < tableCount;i++) {
+            World& table = batch.tables[i];
+            idle[i] = table.balls.awakeCount == 0 ? idle[i] + 1 : 0;
+            if(idle[i] >= shot_delay) shoot(table, random);
+        }
+        batch.step();
+
+        Clock::time_point t1 = Clock::now();
+        {
+            PROFILE_SCOPE("broadcast");
+            server.broadcast(tick, batch.tables);
+        }
+        Clock::time_point t2 = Clock::now();
+        stepMs += std::chrono::duration<double, std::milli>(t1 - t0).count();
+        broadcastMs += std::chrono::duration<double, std::milli>(t2 - t1).count();
+
+        if(t2 >= report) {
+            int moving = 0;
+            for(const World& table : batch.tables) moving += table.balls.awakeCount > 0;
+            const SpectatorStats& s = server.stats;
+            fprintf(stderr, "server: tick %ld, %d/%d tables moving, %d viewers, %.1f KB/s, %llu skipped, "
+                            "step %.3f ms broadcast %.3f ms per tick, rtt %.3f ms mean %.3f ms max\n",
+                    tick, moving, tableCount, server.viewerCount(), s.bytes / 1024.0, (unsigned long long)s.skipped,
+                    stepMs / tick_rate, broadcastMs / tick_rate, s.meanLatency(), s.latencyMax);
+            server.stats = SpectatorStats();
+            stepMs = broadcastMs = 0;
+            report += std::chrono::seconds(1);
+        }
+        if(seconds > 0 && t2 - start > std::chrono::duration<double>(seconds)) break;
+
+        next += period;
+        std::this_thread::sleep_until(next);
+    }
+
+    running = false;
+    for(std::thread& viewer : viewers) viewer.join();
+    server.close();
+    return 0;
+}
@@ -0,0 +1,256 @@
+#include "shot_cache.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+// splitmix64 finaliser
+static uint64_t mix(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+static int32_t quantize(float v, float step) {
+    return int32_t(std::floor(double(v) / step + 0.5));
+}
+
+static uint64_t mixFloat(uint64_t hash, float v) {
+    uint32_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    return mix(hash ^ bits);
+}
+
+TableKey::Cell TableKey::cell(const World& world, int i) {
+    if(!world.balls.isActive(i)) return {0, 0, 0, 0, false};
+    return {quantize(world.balls.x[i], shot_cache_position_step), quantize(world.balls.z[i], shot_cache_position_step),
+            world.balls.radius[i], world.balls.mass[i], true};
+}
+
+uint64_t TableKey::term(int i, const Cell& cell) {
+    if(!cell.active) return mix(uint64_t(i) * 2);
+    uint64_t ball = mixFloat(mixFloat(mix(uint64_t(i) * 2 + 1), cell.radius), cell.mass);
+    return mix((uint64_t(uint32_t(cell.x)) << 32 | uint32_t(cell.z)) ^ ball);
+}
+
+void TableKey::reset(const World& world) {
+    // The table by content rather than address, so keys stay valid in a
+    // cache file loaded by another run
+    const TableDef& def = *world.table;
+    base = mix(uint64_t(world.mode) ^ uint64_t(world.balls.count) << 8);
+    for(const char* c = def.name;*c;c++) base = mix(base ^ uint8_t(*c));
+    for(float v : {def.minX, def.maxX, def.minZ, def.maxZ}) base = mixFloat(base, v);
+    for(int p = 0;p < def.pocketCount;p++) {
+        base = mixFloat(mixFloat(mixFloat(base, def.pockets[p].x), def.pockets[p].z), def.pockets[p].radius);
+    }
+    table = world.table;
+    mode = world.mode;
+
+    key = base;
+    cells.resize(world.balls.count);
+    for(int i = 0;i < world.balls.count;i++) {
+        cells[i] = cell(world, i);
+        key ^= term(i, cells[i]);
+    }
+}
+
+void TableKey::update(const World& world) {
+    if(world.table != table || world.mode != mode || world.balls.count != int(cells.size())) {
+        reset(world);
+        return;
+    }
+
+    for(int i = 0;i < world.balls.count;i++) {
+        Cell now = cell(world, i);
+        const Cell& was = cells[i];
+        if(now == was) continue;
+
+        key ^= term(i, was) ^ term(i, now);
+        cells[i] = now;
+    }
+}
+
+uint64_t TableKey::shot(glm::vec3 direction, float strength) const {
+    uint64_t shot = uint64_t(uint32_t(quantize(direction.x, shot_cache_direction_step))) << 32 |
+                    uint32_t(quantize(direction.z, shot_cache_direction_step));
+    return mix(mix(key ^ mix(shot)) ^ uint32_t(quantize(strength, shot_cache_strength_step)));
+}
+
+void ShotOutcome::capture(const World& start, const World& world) {
+    const BallSet& balls = world.balls;
+    x.assign(balls.x.begin(), balls.x.begin() + balls.count);
+    z.assign(balls.z.begin(), balls.z.begin() + balls.count);
+
+    size_t words = (balls.count + 63) / 64;
+    active.assign(balls.activeMask.begin(), balls.activeMask.begin() + words);
+    pocketed.resize(words);
+    for(size_t w = 0;w < words;w++) pocketed[w] = start.balls.activeMask[w] & ~active[w];
+    checksum = world.checksum();
+}
+
+void ShotOutcome::apply(World& world) const {
+    BallSet& balls = world.balls;
+    for(int i = 0;i < count();i++) {
+        balls.x[i] = x[i];
+        balls.z[i] = z[i];
+        balls.vx[i] = balls.vz[i] = balls.wx[i] = balls.wz[i] = 0;
+        balls.setActive(i, isActive(i));
+        balls.setSleeping(i, false); // update() puts them back to sleep
+    }
+}
+
+ShotCache::ShotCache(size_t capacity, int shardCount) {
+    shardBits = 0;
+    while((1 << shardBits) < shardCount) shardBits++;
+    int n = 1 << shardBits;
+    shardCapacity = capacity / n + (capacity % n != 0);
+    if(shardCapacity == 0) shardCapacity = 1;
+    shards.reset(new Shard[n]);
+}
+
+bool ShotCache::find(uint64_t key, ShotOutcome& out) {
+    Shard& shard = shardOf(key);
+    std::lock_guard<std::mutex> lock(shard.lock);
+    auto it = shard.index.find(key);
+    if(it == shard.index.end()) {
+        shard.misses++;
+        return false;
+    }
+
+    shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+    out = it->second->outcome;
+    shard.hits++;
+    return true;
+}
+
+void ShotCache::insert(uint64_t key, const ShotOutcome& outcome) {
+    Shard& shard = shardOf(key);
+    std::lock_guard<std::mutex> lock(shard.lock);
+    auto it = shard.index.find(key);
+    if(it != shard.index.end()) {
+        it->second->outcome = outcome;
+        shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+        return;
+    }
+
+    if(shard.entries.size() >= shardCapacity) {
+        shard.index.erase(shard.entries.back().key);
+        shard.entries.pop_back();
+        shard.evictions++;
+    }
+    shard.entries.push_front({key, outcome});
+    shard.index[key] = shard.entries.begin();
+    shard.insertions++;
+}
+
+void ShotCache::clear() {
+    for(int s = 0;s < (1 << shardBits);s++) {
+        std::lock_guard<std::mutex> lock(shards[s].lock);
+        shards[s].entries.clear();
+        shards[s].index.clear();
+    }
+}
+
+ShotCacheStats ShotCache::stats() const {
+    ShotCacheStats total;
+    for(int s = 0;s < (1 << shardBits);s++) {
+        Shard& shard = shards[s];
+        std::lock_guard<std::mutex> lock(shard.lock);
+        total.hits += shard.hits;
+        total.misses += shard.misses;
+        total.insertions += shard.insertions;
+        total.evictions += shard.evictions;
+        total.entries += shard.entries.size();
+    }
+    return total;
+}
+
+void ShotCache::resetStats() {
+    for(int s = 0;s < (1 << shardBits);s++) {
+        Shard& shard = shards[s];
+        std::lock_guard<std::mutex> lock(shard.lock);
+        shard.hits = shard.misses = shard.insertions = shard.evictions = 0;
+    }
+}
+
+// File layout, little-endian: this header, then per entry uint64 key,
+// uint64 checksum, uint32 balls, uint32 words, float x[balls], z[balls],
+// uint64 active[words], pocketed[words]. Entries go least recently used
+// first, so loading them in order restores the recency.
+struct ShotCacheFileHeader {
+    char magic[4]; // "BSHC"
+    uint32_t version;
+    float positionStep, directionStep, strengthStep;
+    uint32_t reserved;
+    char scalar[8]; // physics_scalar_name of the build
+    uint64_t count;
+};
+
+const char cache_magic[4] = {'B', 'S', 'H', 'C'};
+
+bool ShotCache::save(const std::string& path) const {
+    FILE* file = fopen(path.c_str(), "wb");
+    if(!file) return false;
+
+    ShotCacheFileHeader header = {};
+    memcpy(header.magic, cache_magic, sizeof(header.magic));
+    header.version = shot_cache_version;
+    header.positionStep = shot_cache_position_step;
+    header.directionStep = shot_cache_direction_step;
+    header.strengthStep = shot_cache_strength_step;
+    strncpy(header.scalar, physics_scalar_name, sizeof(header.scalar) - 1);
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    for(int s = 0;s < (1 << shardBits);s++) {
+        Shard& shard = shards[s];
+        std::lock_guard<std::mutex> lock(shard.lock);
+        for(auto it = shard.entries.rbegin();it != shard.entries.rend();++it) {
+            const ShotOutcome& o = it->outcome;
+            uint64_t head[2] = {it->key, o.checksum};
+            uint32_t sizes[2] = {uint32_t(o.count()), uint32_t(o.active.size())};
+            ok = ok && fwrite(head, sizeof(head), 1, file) == 1 && fwrite(sizes, sizeof(sizes), 1, file) == 1 &&
+                 fwrite(o.x.data(), sizeof(float), o.x.size(), file) == o.x.size() &&
+                 fwrite(o.z.data(), sizeof(float), o.z.size(), file) == o.z.size() &&
+                 fwrite(o.active.data(), sizeof(uint64_t), o.active.size(), file) == o.active.size() &&
+                 fwrite(o.pocketed.data(), sizeof(uint64_t), o.pocketed.size(), file) == o.pocketed.size();
+            header.count++;
+        }
+    }
+
+    // The count is only known now
+    ok = ok && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+    return fclose(file) == 0 && ok;
+}
+
+bool ShotCache::load(const std::string& path) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if(!file) return false;
+
+    ShotCacheFileHeader header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, cache_magic, sizeof(header.magic)) == 0 &&
+              header.version == shot_cache_version && header.positionStep == shot_cache_position_step &&
+              header.directionStep == shot_cache_direction_step && header.strengthStep == shot_cache_strength_step &&
+              strncmp(header.scalar, physics_scalar_name, sizeof(header.scalar)) == 0;
+
+    ShotOutcome o;
+    for(uint64_t e = 0;ok && e < header.count;e++) {
+        uint64_t head[2];
+        uint32_t sizes[2];
+        ok = fread(head, sizeof(head), 1, file) == 1 && fread(sizes, sizeof(sizes), 1, file) == 1 &&
+             sizes[0] <= (1u << 20) && sizes[1] == (sizes[0] + 63) / 64;
+        if(!ok) break;
+
+        o.checksum = head[1];
+        o.x.resize(sizes[0]);
+        o.z.resize(sizes[0]);
+        o.active.resize(sizes[1]);
+        o.pocketed.resize(sizes[1]);
+        ok = fread(o.x.data(), sizeof(float), sizes[0], file) == sizes[0] &&
+             fread(o.z.data(), sizeof(float), sizes[0], file) == sizes[0] &&
+             fread(o.active.data(), sizeof(uint64_t), sizes[1], file) == sizes[1] &&
+             fread(o.pocketed.data(), sizeof(uint64_t), sizes[1], file) == sizes[1];
+        if(ok) insert(head[0], o);
+    }
+    fclose(file);
+    return ok;
+}
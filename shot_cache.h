@@ -0,0 +1,141 @@
+#ifndef SHOT_CACHE_H
+#define SHOT_CACHE_H
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "physics.h"
+
+// Cache of shot outcomes, so the hint search and the AI don't play the same
+// opening to rest again every time they see it. An entry maps a key built
+// from the quantized table state and the shot to the state the table came to
+// rest in.
+//
+// Positions, the cue direction and the strength are rounded to these steps
+// before hashing, so states closer than a step share an entry. Changing a
+// step changes every key: bump shot_cache_version with it.
+const float shot_cache_position_step = 1.0f / 65536;
+const float shot_cache_direction_step = 1.0f / 65536;
+const float shot_cache_strength_step = 1.0f / (1 << 20);
+const uint32_t shot_cache_version = 3; // 3: contacts use the masses
+
+// Zobrist-style hash of a table: the XOR of one term per ball, taken from the
+// ball's index, radius, mass and quantized position (or from its index alone
+// once it is off the table), mixed with the table and solver mode. A ball only changes the
+// key through its own term, so after a shot update() re-hashes just the balls
+// that moved.
+class TableKey {
+public:
+    // Hash every ball of world
+    void reset(const World& world);
+    // Re-hash the balls whose quantized position, size or active bit changed since
+    // the last reset() or update(); resets when the ball count, table or mode
+    // changed
+    void update(const World& world);
+
+    uint64_t value() const { return key; }
+    // Key of playing shot (direction times strength, like World::setMovement) from this state
+    uint64_t shot(glm::vec3 direction, float strength) const;
+
+private:
+    struct Cell {
+        int32_t x, z;
+        float radius, mass;
+        bool active;
+
+        bool operator==(const Cell& b) const {
+            return x == b.x && z == b.z && radius == b.radius && mass == b.mass && active == b.active;
+        }
+    };
+
+    uint64_t key = 0;
+    uint64_t base = 0; // table and mode
+    const TableDef* table = nullptr;
+    SolverMode mode = SolverMode::FixedTick;
+    std::vector<Cell> cells;
+
+    static uint64_t term(int i, const Cell& cell);
+    static Cell cell(const World& world, int i);
+};
+
+// Where a shot left the table
+struct ShotOutcome {
+    std::vector<float> x, z;         // resting positions, by ball
+    std::vector<uint64_t> active;    // bit i set when ball i is still on the table
+    std::vector<uint64_t> pocketed;  // bit i set when ball i went down during the shot
+    uint64_t checksum = 0;           // World::checksum() at rest
+
+    int count() const { return int(x.size()); }
+    bool isActive(int i) const { return (active[i >> 6] >> (i & 63)) & 1; }
+    bool wasPocketed(int i) const { return (pocketed[i >> 6] >> (i & 63)) & 1; }
+
+    // The outcome of world, which was start before the shot, once it is at rest
+    void capture(const World& start, const World& world);
+    // Put the balls of world where the outcome left them, at rest
+    void apply(World& world) const;
+};
+
+struct ShotCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t insertions = 0;
+    uint64_t evictions = 0;
+    size_t entries = 0;
+
+    double hitRate() const { return hits + misses ? double(hits) / (hits + misses) : 0; }
+};
+
+// Bounded, thread-safe map from TableKey::shot() keys to outcomes. Keys are
+// spread over shards with a lock and a least recently used list each, so
+// search threads rarely wait on each other; a full shard evicts its least
+// recently used entry.
+class ShotCache {
+public:
+    // capacity entries over shards shards (rounded up to a power of two)
+    explicit ShotCache(size_t capacity = 1 << 16, int shards = 16);
+
+    ShotCache(const ShotCache&) = delete;
+    ShotCache& operator=(const ShotCache&) = delete;
+
+    // Copy the outcome stored for key into out; false on a miss
+    bool find(uint64_t key, ShotOutcome& out);
+    void insert(uint64_t key, const ShotOutcome& outcome);
+    void clear();
+
+    // Counters since construction or resetStats(), entries as of now
+    ShotCacheStats stats() const;
+    void resetStats();
+
+    // Persistence, so a warm cache survives a restart. load() adds the
+    // entries of a file written by save() with the same steps, version and
+    // physics scalar (outcomes differ between scalar builds),
+    // counting them as insertions; both return false on I/O errors or a
+    // foreign file.
+    bool save(const std::string& path) const;
+    bool load(const std::string& path);
+
+private:
+    struct Entry {
+        uint64_t key;
+        ShotOutcome outcome;
+    };
+
+    struct alignas(64) Shard {
+        std::mutex lock;
+        std::list<Entry> entries; // most recently used first
+        std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+        uint64_t hits = 0, misses = 0, insertions = 0, evictions = 0;
+    };
+
+    size_t shardCapacity;
+    int shardBits;
+    std::unique_ptr<Shard[]> shards;
+
+    Shard& shardOf(uint64_t key) const { return shards[shardBits ? key >> (64 - shardBits) : 0]; }
+};
+
+#endif
@@ -0,0 +1,125 @@
+#include "shot_search.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+ShotSearch::ShotSearch(int threads) : pool(threads), workers(pool.size()) {
+}
+
+// splitmix64, good enough to turn (seed, index) into independent numbers
+static uint64_t mix(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+static float unit(uint64_t bits) {
+    return (bits >> 40) / float(1 << 24);
+}
+
+ShotCandidate ShotSearch::sample(uint64_t seed, int index, const ShotSearchOptions& options) {
+    uint64_t a = mix(seed * 0x100000001b3ull + uint64_t(index));
+    uint64_t b = mix(a);
+
+    float angle = unit(a) * 2.0f * float(M_PI);
+    double s, c;
+    detSinCos(angle, s, c);
+    ShotCandidate shot;
+    shot.direction = glm::vec3(float(c), 0, float(s));
+    shot.strength = options.minStrength + unit(b) * (options.maxStrength - options.minStrength);
+    return shot;
+}
+
+void ShotSearch::keep(std::vector<ShotCandidate>& best, const ShotCandidate& shot, int topK) {
+    if(int(best.size()) == topK && shot.score <= best.back().score) return;
+    if(int(best.size()) == topK) best.pop_back();
+
+    auto at = std::upper_bound(best.begin(), best.end(), shot, [](const ShotCandidate& a, const ShotCandidate& b) {
+        return a.score > b.score;
+    });
+    best.insert(at, shot); // within reserved capacity
+}
+
+void ShotSearch::evaluate(Worker& worker, const World& start, ShotCandidate& shot, const ShotSearchOptions& options) {
+    World& table = worker.table;
+    ShotOutcome& outcome = worker.outcome;
+    uint64_t key = cache ? startKey.shot(shot.direction, shot.strength) : 0;
+
+    if(cache && cache->find(key, outcome)) {
+        shot.pocketed = 0;
+        for(int i = 1;i < outcome.count();i++) shot.pocketed += outcome.wasPocketed(i);
+        shot.scratch = !outcome.isActive(0);
+        shot.leave = glm::vec2(outcome.x[0], outcome.z[0]);
+        shot.checksum = outcome.checksum;
+    }
+    else {
+        table.balls = start.balls; // same size every time, reuses the storage
+        table.mode = start.mode;
+        table.broadphase = start.broadphase;
+        table.table = start.table;
+
+        table.setMovement(0, shot.direction * shot.strength);
+        table.runUntilRest(options.maxTicks); // stops as soon as everything is still
+
+        shot.pocketed = 0;
+        for(int i = 1;i < table.balls.count;i++) {
+            if(start.balls.isActive(i) && !table.balls.isActive(i)) shot.pocketed++;
+        }
+        shot.scratch = !table.balls.isActive(0);
+        shot.leave = glm::vec2(table.balls.x[0], table.balls.z[0]);
+        shot.checksum = table.checksum();
+
+        if(cache && table.atRest()) {
+            outcome.capture(start, table);
+            cache->insert(key, outcome);
+        }
+    }
+
+    // Leaving the cue ball near the middle of the table scores best
+    const TableDef& def = *start.table;
+    float width = def.width(), height = def.height();
+    float halfDiagonal = 0.5f * sqrtf(width * width + height * height);
+    float dx = shot.leave.x - 0.5f * (def.minX + def.maxX), dz = shot.leave.y - 0.5f * (def.minZ + def.maxZ);
+    float leave = shot.scratch ? 0 : 1 - sqrtf(dx * dx + dz * dz) / halfDiagonal;
+    shot.score = shot.pocketed * options.pocketWeight - (shot.scratch ? options.scratchPenalty : 0) + options.leaveWeight * leave;
+}
+
+ShotSearchResult ShotSearch::search(const World& start, const ShotSearchOptions& options) {
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point begin = Clock::now();
+    Clock::time_point deadline = begin + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double, std::milli>(options.budgetMs));
+
+    int topK = std::max(1, options.topK);
+    if(cache) startKey.update(start); // only re-hashes the balls that moved since the last search
+    for(Worker& worker : workers) {
+        worker.table.balls = start.balls;
+        worker.best.clear();
+        worker.best.reserve(topK);
+        worker.evaluated = 0;
+    }
+
+    // Small chunks so a worker notices the deadline soon and stealing evens out
+    // shots that take very different times to settle
+    pool.parallelFor(options.samples, 4, [&](int first, int last, int id) {
+        Worker& worker = workers[id];
+        for(int i = first;i < last;i++) {
+            if(Clock::now() >= deadline) return;
+
+            ShotCandidate shot = sample(options.seed, i, options);
+            evaluate(worker, start, shot, options);
+            keep(worker.best, shot, topK);
+            worker.evaluated++;
+        }
+    });
+
+    ShotSearchResult result;
+    result.best.reserve(topK);
+    for(const Worker& worker : workers) {
+        for(const ShotCandidate& shot : worker.best) keep(result.best, shot, topK);
+        result.evaluated += worker.evaluated;
+    }
+    result.seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+    return result;
+}
@@ -0,0 +1,79 @@
+#ifndef SHOT_SEARCH_H
+#define SHOT_SEARCH_H
+
+#include <cstdint>
+#include <vector>
+#include "physics.h"
+#include "shot_cache.h"
+#include "thread_pool.h"
+
+struct ShotCandidate {
+    glm::vec3 direction = glm::vec3(0, 0, -1); // unit, on the table plane
+    float strength = 0;                        // same scale as SimThread's charge
+    float score = 0;
+    int pocketed = 0;    // object balls that went down
+    bool scratch = false; // the cue ball went down
+    glm::vec2 leave = glm::vec2(0, 0); // where the cue ball stopped (x, z)
+    uint64_t checksum = 0; // World::checksum() of the outcome, to compare runs across machines
+};
+
+struct ShotSearchOptions {
+    int samples = 4096;       // most shots tried
+    int topK = 5;             // best shots returned
+    float budgetMs = 50;      // wall time limit, whatever isn't done by then is skipped
+    int maxTicks = 60 * 30;   // a shot still moving after this is scored as it stands
+    float minStrength = 0.01f;
+    float maxStrength = 0.1f;
+    uint64_t seed = 1;
+
+    // score = pocketed * pocketWeight - scratch * scratchPenalty + leaveWeight * (1 - cue distance from the centre / half diagonal)
+    float pocketWeight = 1.0f;
+    float scratchPenalty = 1.5f;
+    float leaveWeight = 0.25f;
+};
+
+struct ShotSearchResult {
+    std::vector<ShotCandidate> best; // highest score first
+    int evaluated = 0;
+    double seconds = 0;
+};
+
+// Monte Carlo "best shot" search: samples (direction, strength) pairs for the
+// cue ball, plays each to rest on a copy of the table and scores the outcome.
+// Sample i is always the same shot for a given seed, so results don't depend
+// on the thread count, only on how many samples fit in the budget. Sampling
+// and the fixed-tick physics avoid libm, so the same holds across machines.
+class ShotSearch {
+public:
+    // Outcomes of shots played before are taken from here instead of being
+    // simulated again, and new ones that came to rest are added. A hit gives
+    // the resting state, which is what simulating gives too unless the shot
+    // runs past maxTicks. Shared between searches and threads, may be null.
+    ShotCache* cache = nullptr;
+
+    // threads = 0 uses every hardware thread
+    explicit ShotSearch(int threads = 0);
+
+    ShotSearchResult search(const World& start, const ShotSearchOptions& options);
+
+    // The shot tried as sample index for seed
+    static ShotCandidate sample(uint64_t seed, int index, const ShotSearchOptions& options);
+
+private:
+    // Per participant state, sized once so the inner loop never allocates
+    struct Worker {
+        World table;
+        std::vector<ShotCandidate> best; // sorted, at most topK
+        ShotOutcome outcome;
+        int evaluated = 0;
+    };
+
+    ThreadPool pool;
+    std::vector<Worker> workers;
+    TableKey startKey; // of the last search's start, kept up to date incrementally
+
+    void evaluate(Worker& worker, const World& start, ShotCandidate& shot, const ShotSearchOptions& options);
+    static void keep(std::vector<ShotCandidate>& best, const ShotCandidate& shot, int topK);
+};
+
+#endif
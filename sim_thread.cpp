@@ -0,0 +1,206 @@
+#include "sim_thread.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include "profiler.h"
+
+void SimSnapshot::interpolate(BallSet& out, float alpha) const {
+    out = balls;
+    for(int i = 0;i < balls.count;i++) {
+        out.x[i] = prevX[i] + (balls.x[i] - prevX[i]) * alpha;
+        out.z[i] = prevZ[i] + (balls.z[i] - prevZ[i]) * alpha;
+    }
+}
+
+float SimSnapshot::alphaAt(Clock::time_point now) const {
+    float alpha = std::chrono::duration<float>(now - time).count() / duration;
+    return std::min(1.0f, std::max(0.0f, alpha));
+}
+
+void SimThread::start() {
+    if(running) return;
+
+    if(playback) {
+        tickCount = playback->firstTick();
+        playback->seek(world, tickCount);
+    }
+    if(recorder) recorder->keyframe(tickCount, world, true);
+
+    prevX = world.balls.x;
+    prevZ = world.balls.z;
+    publish(SimSnapshot::Clock::now(), World::fixed_dt);
+
+    running = true;
+    thread = std::thread(&SimThread::run, this);
+}
+
+void SimThread::stop() {
+    running = false;
+    if(thread.joinable()) thread.join();
+
+    if(recorder && recorder->isOpen()) {
+        recorder->keyframe(tickCount, world);
+        recorder->finish();
+    }
+}
+
+void SimThread::run() {
+    using Clock = SimSnapshot::Clock;
+
+    PROFILE_THREAD("sim");
+
+    Clock::time_point last = Clock::now();
+    double due = 0; // ticks the clock is ahead of the world
+    while(running) {
+        SimCommand command;
+        while(commands.pop(command)) {
+            handle(command);
+        }
+
+        if(skipRequested) {
+            skipToRest();
+            skipRequested = false;
+            last = Clock::now();
+            due = 0;
+            continue;
+        }
+
+        Clock::time_point now = Clock::now();
+        double tickSeconds = World::fixed_dt / speed;
+        due += std::chrono::duration<double>(now - last).count() / tickSeconds;
+        last = now;
+
+        // Catch up in steps, for at most one tick of wall time per wakeup
+        Clock::time_point deadline = now + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(World::fixed_dt));
+        while(due >= 1) {
+            // A step sized at rest ends early when a tick starts motion (a
+            // replayed shot), and the other way round, so stepTicks() can
+            // size the rest of it
+            int limit = int(std::min<double>(due, stepTicks()));
+            bool wasAtRest = world.atRest();
+            prevX = world.balls.x;
+            prevZ = world.balls.z;
+            int ticks = 0;
+            while(ticks < limit) {
+                tick();
+                ticks++;
+                if(world.atRest() != wasAtRest) break;
+            }
+            due -= ticks;
+
+            Clock::time_point done = now - std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(due * tickSeconds));
+            publish(done, float(ticks * tickSeconds));
+            if(Clock::now() >= deadline) break;
+        }
+
+        // Too far behind: drop the backlog instead of trying to catch up forever
+        if(due >= 1) due = 0;
+
+        // Until the next tick is due, but look at the queue at least once a
+        // tick of wall time when the clock runs slow
+        double wait = std::min((1 - due) * tickSeconds, double(World::fixed_dt));
+        std::this_thread::sleep_until(now + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(wait)));
+    }
+}
+
+void SimThread::handle(const SimCommand& command) {
+    if(playback && (command.type == SimCommandType::Shoot || command.type == SimCommandType::Rack)) return;
+
+    switch(command.type) {
+    case SimCommandType::StartCharge:
+        charging = true;
+        break;
+    case SimCommandType::Shoot:
+        world.setMovement(0, command.direction * strength);
+        if(recorder) recorder->shot(tickCount, command.direction, strength);
+        charging = false;
+        strength = 0;
+        break;
+    case SimCommandType::CancelCharge:
+        charging = false;
+        strength = 0;
+        break;
+    case SimCommandType::Rack:
+        world.rack();
+        if(recorder) recorder->keyframe(tickCount, world, true);
+        // Nothing to blend from after a jump
+        prevX = world.balls.x;
+        prevZ = world.balls.z;
+        break;
+    case SimCommandType::SetSpeed:
+        speed = std::min(max_speed, std::max(min_speed, command.speed));
+        break;
+    case SimCommandType::SkipToRest:
+        skipRequested = true;
+        break;
+    }
+}
+
+// Ticks in the next step: until the fastest ball could have covered
+// step_radii of the smallest radius, everything due once the table is at rest
+int SimThread::stepTicks() const {
+    if(world.atRest()) return INT_MAX;
+
+    const BallSet& balls = world.balls;
+    float fastest = 0, smallest = HUGE_VALF;
+    for(int i = 0;i < balls.count;i++) {
+        if(!balls.isActive(i)) continue;
+        fastest = std::max(fastest, balls.vx[i] * balls.vx[i] + balls.vz[i] * balls.vz[i]);
+        smallest = std::min(smallest, balls.radius[i]);
+    }
+    if(fastest == 0) return max_step_ticks; // spinning in place
+    float ticks = step_radii * smallest / sqrtf(fastest);
+    return ticks >= max_step_ticks ? max_step_ticks : std::max(1, int(ticks));
+}
+
+void SimThread::tick() {
+    PROFILE_SCOPE("tick");
+
+    // The shot only charges while everything is still
+    if(charging && world.atRest()) {
+        strength = std::min(strength + charge_per_tick, max_strength);
+    }
+    else strength = 0;
+
+    if(playback) playback->apply(world, tickCount);
+
+    {
+        PROFILE_SCOPE("advance");
+        world.advance(1);
+    }
+    tickCount++;
+
+    if(recorder) {
+        recorder->checksum(tickCount, world);
+        if(tickCount % replay_keyframe_interval == 0) recorder->keyframe(tickCount, world);
+    }
+}
+
+// The rest of the shot flat out, without snapshots on the way. Ticks go
+// through tick() like any other, so recordings and replays see no difference.
+void SimThread::skipToRest() {
+    PROFILE_SCOPE("skipToRest");
+    for(int t = 0;t < max_skip_ticks && !world.atRest();t++) {
+        tick();
+    }
+
+    // Nothing to blend from after a jump
+    prevX = world.balls.x;
+    prevZ = world.balls.z;
+    publish(SimSnapshot::Clock::now(), World::fixed_dt);
+}
+
+void SimThread::publish(SimSnapshot::Clock::time_point time, float duration) {
+    PROFILE_SCOPE("publish");
+    SimSnapshot& snapshot = snapshots.back();
+    snapshot.tick = tickCount;
+    snapshot.time = time;
+    snapshot.duration = duration;
+    snapshot.speed = speed;
+    snapshot.balls = world.balls;
+    snapshot.prevX = prevX;
+    snapshot.prevZ = prevZ;
+    snapshot.strength = strength;
+    snapshot.atRest = world.atRest();
+    snapshots.publish();
+}
@@ -0,0 +1,118 @@
+#ifndef SIM_THREAD_H
+#define SIM_THREAD_H
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "physics.h"
+#include "replay.h"
+#include "spsc_queue.h"
+#include "triple_buffer.h"
+
+enum class SimCommandType {
+    StartCharge,  // shot button went down
+    Shoot,        // button released aiming at the cue ball
+    CancelCharge, // button released aiming elsewhere
+    Rack,         // start a new game
+    SetSpeed,     // run the clock at another multiple of real time
+    SkipToRest    // play the rest of the shot at once
+};
+
+struct SimCommand {
+    SimCommandType type;
+    glm::vec3 direction = glm::vec3(0, 0, 0); // Shoot: unit direction of the cue
+    double speed = 1;                         // SetSpeed: the multiplier
+};
+
+// Immutable copy of the table after a tick, what the render thread draws
+struct SimSnapshot {
+    using Clock = std::chrono::steady_clock;
+
+    long tick = 0;
+    Clock::time_point time; // when this tick was due
+    float duration = World::fixed_dt; // wall seconds the step up to it took on the clock
+    BallSet balls;
+    std::vector<float> prevX, prevZ; // positions at the previous snapshot
+    float strength = 0;              // current shot charge
+    bool atRest = true;
+    double speed = 1;                // clock multiplier
+
+    // Positions blended from the previous snapshot (alpha 0) to this one (alpha 1)
+    void interpolate(BallSet& out, float alpha) const;
+    // alpha for drawing at time now, one step behind the simulation
+    float alphaAt(Clock::time_point now) const;
+};
+
+// Runs a World on its own thread at World::fixed_dt. The render thread never
+// touches the World: it reads snapshots published after every step and talks
+// back only through the command queue, so a slow frame doesn't hold up
+// physics and a heavy tick doesn't hold up the frame.
+//
+// The thread keeps its own clock, running at speed times real time. Speed
+// only changes how many ticks fall due per second, never the tick itself, so
+// replays, checksums and the shot cache don't care how fast a game was
+// watched. The due ticks run in steps sized from how fast the balls move
+// against their radius: a snapshot after each tick while a break scatters
+// the rack, after many of them while the last ball rolls out, after all of
+// them at rest. A fast clock then costs snapshots only while there is motion
+// to show.
+class SimThread {
+public:
+    // Charge added per tick while the shot button is held, and its limit
+    static constexpr float charge_per_tick = 0.00025f;
+    static constexpr float max_strength = 0.1f;
+
+    // Range of the clock multiplier
+    static constexpr double min_speed = 0.1;
+    static constexpr double max_speed = 1000;
+    // A step ends once the fastest ball may have moved this many radii of the
+    // smallest ball, and after max_step_ticks in any case
+    static constexpr float step_radii = 1;
+    static constexpr int max_step_ticks = 60;
+    // SkipToRest gives up on shots longer than this
+    static constexpr int max_skip_ticks = 60 * 60 * 10;
+
+    // Only touch before start() or after stop()
+    World world;
+    // Optional, set before start(). The recorder gets the starting state, every
+    // shot, a keyframe every replay_keyframe_interval ticks and a last one in
+    // stop(). With playback set the game comes from the recording and shot
+    // and rack commands are ignored.
+    ReplayWriter* recorder = nullptr;
+    const ReplayReader* playback = nullptr;
+
+    ~SimThread() { stop(); }
+
+    void start();
+    void stop();
+
+    // Render thread: queue a command for the next tick, false if the queue is full
+    bool send(const SimCommand& command) { return commands.push(command); }
+    // Render thread: the newest snapshot
+    const SimSnapshot& latest() { return snapshots.latest(); }
+
+private:
+    std::thread thread;
+    std::atomic<bool> running{false};
+
+    SpscQueue<SimCommand, 64> commands;
+    TripleBuffer<SimSnapshot> snapshots;
+
+    // Sim thread state
+    long tickCount = 0;
+    bool charging = false;
+    float strength = 0;
+    double speed = 1;
+    bool skipRequested = false;
+    std::vector<float> prevX, prevZ;
+
+    void run();
+    void handle(const SimCommand& command);
+    int stepTicks() const;
+    void tick();
+    void skipToRest();
+    void publish(SimSnapshot::Clock::time_point time, float duration);
+};
+
+#endif
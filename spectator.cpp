@@ -0,0 +1,540 @@
+#include "spectator.h"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+static uint64_t steadyNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int16_t quantize(float v) {
+    float q = std::round(v * spectator_position_scale);
+    return int16_t(std::min(std::max(q, -32768.0f), 32767.0f));
+}
+
+static bool bit(const std::vector<uint8_t>& bits, int i) {
+    return (bits[i >> 3] >> (i & 7)) & 1;
+}
+
+void QuantizedTable::quantize(const BallSet& balls) {
+    int n = balls.count;
+    x.resize(n);
+    z.resize(n);
+    active.assign((n + 7) / 8, 0);
+    for(int i = 0;i < n;i++) {
+        x[i] = ::quantize(balls.x[i]);
+        z[i] = ::quantize(balls.z[i]);
+        if(balls.isActive(i)) active[i >> 3] |= 1 << (i & 7);
+    }
+}
+
+bool QuantizedTable::sameBall(const QuantizedTable& other, int i) const {
+    return x[i] == other.x[i] && z[i] == other.z[i] && bit(active, i) == bit(other.active, i);
+}
+
+void SpectatorStats::addLatency(double ms) {
+    latencySum += ms;
+    latencyMax = std::max(latencyMax, ms);
+    latencyCount++;
+}
+
+// Fill in a sockaddr for "tcp:host:port" or "unix:path"
+static socklen_t parseAddress(const std::string& address, sockaddr_storage& storage, int& family) {
+    memset(&storage, 0, sizeof(storage));
+
+    if(address.compare(0, 5, "unix:") == 0) {
+        std::string path = address.substr(5);
+        sockaddr_un* un = (sockaddr_un*)&storage;
+        if(path.empty() || path.size() >= sizeof(un->sun_path)) return 0;
+        un->sun_family = family = AF_UNIX;
+        memcpy(un->sun_path, path.c_str(), path.size() + 1);
+        return sizeof(sockaddr_un);
+    }
+
+    if(address.compare(0, 4, "tcp:") == 0) {
+        size_t colon = address.rfind(':');
+        if(colon <= 4) return 0;
+        std::string host = address.substr(4, colon - 4);
+        int port = atoi(address.c_str() + colon + 1);
+        if(host == "localhost") host = "127.0.0.1";
+
+        sockaddr_in* in = (sockaddr_in*)&storage;
+        in->sin_family = family = AF_INET;
+        in->sin_port = htons(uint16_t(port));
+        if(port <= 0 || port > 65535 || inet_pton(AF_INET, host.c_str(), &in->sin_addr) != 1) return 0;
+        return sizeof(sockaddr_in);
+    }
+    return 0;
+}
+
+static void configure(int fd, int family) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    if(family == AF_INET) {
+        // Frames are small and go out once per tick, don't let Nagle hold them
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+}
+
+int spectatorListen(const std::string& address) {
+    sockaddr_storage storage;
+    int family;
+    socklen_t length = parseAddress(address, storage, family);
+    if(!length) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    int fd = ::socket(family, SOCK_STREAM, 0);
+    if(fd < 0) return -1;
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if(family == AF_UNIX) unlink(((sockaddr_un*)&storage)->sun_path);
+
+    if(bind(fd, (sockaddr*)&storage, length) < 0 || ::listen(fd, 64) < 0) {
+        int error = errno;
+        ::close(fd);
+        errno = error;
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+int spectatorConnect(const std::string& address) {
+    sockaddr_storage storage;
+    int family;
+    socklen_t length = parseAddress(address, storage, family);
+    if(!length) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // Connect blocking so errors show up here, then switch to non-blocking
+    int fd = ::socket(family, SOCK_STREAM, 0);
+    if(fd < 0) return -1;
+    if(::connect(fd, (sockaddr*)&storage, length) < 0) {
+        int error = errno;
+        ::close(fd);
+        errno = error;
+        return -1;
+    }
+    configure(fd, family);
+    return fd;
+}
+
+// Little-endian writers, the header structs go in with memcpy like the replay
+// format does
+template<class T>
+static void put(std::vector<uint8_t>& out, const T& value) {
+    const uint8_t* bytes = (const uint8_t*)&value;
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+SpectatorServer::~SpectatorServer() {
+    close();
+}
+
+bool SpectatorServer::listen(const std::string& address) {
+    close();
+    listenFd = spectatorListen(address);
+    if(listenFd < 0) {
+        std::cerr << "Can't listen on " << address << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    if(address.compare(0, 5, "unix:") == 0) unixPath = address.substr(5);
+    return true;
+}
+
+void SpectatorServer::close() {
+    for(Viewer& viewer : viewers) ::close(viewer.fd);
+    viewers.clear();
+    if(listenFd >= 0) ::close(listenFd);
+    listenFd = -1;
+    if(!unixPath.empty()) unlink(unixPath.c_str());
+    unixPath.clear();
+}
+
+void SpectatorServer::accept() {
+    for(;;) {
+        int fd = ::accept(listenFd, nullptr, nullptr);
+        if(fd < 0) return;
+
+        sockaddr_storage local;
+        socklen_t length = sizeof(local);
+        getsockname(fd, (sockaddr*)&local, &length);
+        configure(fd, local.ss_family);
+
+        Viewer viewer;
+        viewer.fd = fd;
+        viewers.push_back(std::move(viewer));
+    }
+}
+
+bool SpectatorServer::readAcks(Viewer& viewer) {
+    uint8_t buffer[4096];
+    for(;;) {
+        ssize_t got = recv(viewer.fd, buffer, sizeof(buffer), 0);
+        if(got == 0) return false;
+        if(got < 0) {
+            if(errno == EAGAIN || errno == EWOULDBLOCK) break;
+            if(errno == EINTR) continue;
+            return false;
+        }
+        viewer.inbox.insert(viewer.inbox.end(), buffer, buffer + got);
+    }
+
+    size_t used = 0;
+    uint64_t now = steadyNs();
+    while(viewer.inbox.size() - used >= sizeof(SpectatorAck)) {
+        SpectatorAck ack;
+        memcpy(&ack, viewer.inbox.data() + used, sizeof(ack));
+        used += sizeof(ack);
+        if(ack.magic != spectator_ack_magic) return false;
+
+        viewer.ackedTick = std::max(viewer.ackedTick, long(ack.tick));
+        stats.addLatency((now - ack.sentNs) * 1e-6);
+    }
+    viewer.inbox.erase(viewer.inbox.begin(), viewer.inbox.begin() + used);
+    return true;
+}
+
+// Send what's left of the viewer's last frame, false when it hung up
+bool SpectatorServer::flush(Viewer& viewer) {
+    while(viewer.pendingOffset < viewer.pending.size()) {
+        ssize_t sent = send(viewer.fd, viewer.pending.data() + viewer.pendingOffset,
+                            viewer.pending.size() - viewer.pendingOffset, MSG_NOSIGNAL);
+        if(sent < 0) {
+            if(errno == EAGAIN || errno == EWOULDBLOCK) return true;
+            if(errno == EINTR) continue;
+            return false;
+        }
+        viewer.pendingOffset += sent;
+        stats.bytes += sent;
+    }
+    viewer.pending.clear();
+    viewer.pendingOffset = 0;
+    return true;
+}
+
+void SpectatorServer::snapshot(long tick, const std::vector<World>& tables) {
+    Snapshot& current = history[tick % spectator_history];
+    const Snapshot& previous = history[(tick + spectator_history - 1) % spectator_history];
+    bool continues = previous.tick == tick - 1 && previous.tables.size() == tables.size();
+
+    current.tick = tick;
+    current.tables.resize(tables.size());
+    if(changedAt.size() != tables.size() || setups.size() != tables.size()) {
+        changedAt.assign(tables.size(), tick);
+        setups.resize(tables.size());
+        if(tables.size() > size_t(spectator_max_tables)) {
+            std::cerr << "Streaming only the first " << spectator_max_tables << " of " << tables.size() << " tables" << std::endl;
+        }
+    }
+
+    for(size_t t = 0;t < tables.size();t++) {
+        const BallSet& balls = tables[t].balls;
+        QuantizedTable& table = current.tables[t];
+
+        // A table where every ball sleeps is exactly where it was last tick
+        if(continues && balls.awakeCount == 0 && previous.tables[t].count() == balls.count) {
+            table = previous.tables[t];
+            continue;
+        }
+
+        table.quantize(balls);
+        bool same = continues && previous.tables[t].count() == table.count();
+        for(int i = 0;same && i < table.count();i++) {
+            same = table.sameBall(previous.tables[t], i);
+        }
+        if(!same) changedAt[t] = tick;
+
+        if(int(setups[t].radius.size()) != balls.count) {
+            if(balls.count > spectator_max_balls) {
+                std::cerr << "Streaming only the first " << spectator_max_balls << " of " << balls.count << " balls on table " << t << std::endl;
+            }
+            TableSetup& setup = setups[t];
+            setup.radius.assign(balls.radius.begin(), balls.radius.begin() + balls.count);
+            setup.y = balls.y;
+            setup.rgb.resize(3 * balls.count);
+            for(int i = 0;i < balls.count;i++) {
+                for(int c = 0;c < 3;c++) {
+                    setup.rgb[3 * i + c] = uint8_t(std::round(std::min(std::max(balls.color[i][c], 0.0f), 1.0f) * 255));
+                }
+            }
+        }
+    }
+}
+
+void SpectatorServer::encode(long tick, const Viewer& viewer) {
+    const Snapshot& current = history[tick % spectator_history];
+    const Snapshot* base = nullptr;
+    if(viewer.ackedTick >= 0 && tick - viewer.ackedTick < spectator_history) {
+        const Snapshot& candidate = history[viewer.ackedTick % spectator_history];
+        if(candidate.tick == viewer.ackedTick && candidate.tables.size() == current.tables.size()) base = &candidate;
+    }
+
+    frame.resize(sizeof(SpectatorFrameHeader));
+    uint32_t tableCount = 0;
+    std::vector<uint8_t> changed;
+
+    size_t streamed = std::min(current.tables.size(), size_t(spectator_max_tables));
+    for(size_t t = 0;t < streamed;t++) {
+        const QuantizedTable& table = current.tables[t];
+        const QuantizedTable* before = base ? &base->tables[t] : nullptr;
+        if(before && before->count() != table.count()) before = nullptr;
+
+        // Nothing on this table moved since the viewer's ack
+        if(before && changedAt[t] <= viewer.ackedTick) continue;
+
+        int n = std::min(table.count(), spectator_max_balls);
+        int bytes = (n + 7) / 8;
+        changed.assign(bytes, 0);
+        int changedCount = 0;
+        for(int i = 0;i < n;i++) {
+            if(before && table.sameBall(*before, i)) continue;
+            changed[i >> 3] |= 1 << (i & 7);
+            changedCount++;
+        }
+        if(before && changedCount == 0) continue;
+
+        put(frame, uint16_t(t));
+        put(frame, uint8_t(before ? 0 : 1));
+        put(frame, uint16_t(n));
+        if(!before) {
+            const TableSetup& setup = setups[t];
+            for(int i = 0;i < n;i++) {
+                put(frame, setup.radius[i]);
+                put(frame, setup.y[i]);
+                frame.insert(frame.end(), setup.rgb.begin() + 3 * i, setup.rgb.begin() + 3 * i + 3);
+            }
+        }
+        frame.insert(frame.end(), table.active.begin(), table.active.begin() + bytes);
+        frame.insert(frame.end(), changed.begin(), changed.end());
+        for(int i = 0;i < n;i++) {
+            if(!bit(changed, i)) continue;
+            put(frame, table.x[i]);
+            put(frame, table.z[i]);
+        }
+
+        tableCount++;
+        stats.tablesSent++;
+        stats.ballsSent += changedCount;
+    }
+
+    SpectatorFrameHeader header;
+    header.magic = spectator_frame_magic;
+    header.size = uint32_t(frame.size() - sizeof(header));
+    header.tick = tick;
+    header.baseTick = base ? viewer.ackedTick : -1;
+    header.sentNs = steadyNs();
+    header.tableCount = tableCount;
+    header.reserved = 0;
+    memcpy(frame.data(), &header, sizeof(header));
+}
+
+void SpectatorServer::broadcast(long tick, const std::vector<World>& tables) {
+    if(listenFd < 0) return;
+
+    accept();
+    snapshot(tick, tables);
+
+    for(size_t v = 0;v < viewers.size();) {
+        Viewer& viewer = viewers[v];
+        bool alive = readAcks(viewer) && flush(viewer);
+
+        if(alive && viewer.pending.empty()) {
+            encode(tick, viewer);
+            viewer.pending.swap(frame);
+            stats.frames++;
+            alive = flush(viewer);
+        }
+        else if(alive) {
+            // Still busy with an older frame: skip this tick, the next frame
+            // is a delta against whatever it acks by then
+            stats.skipped++;
+            if(viewer.pending.size() - viewer.pendingOffset > spectator_max_backlog) alive = false;
+        }
+
+        if(!alive) {
+            ::close(viewer.fd);
+            viewers.erase(viewers.begin() + v);
+            continue;
+        }
+        v++;
+    }
+}
+
+SpectatorClient::~SpectatorClient() {
+    close();
+}
+
+bool SpectatorClient::connect(const std::string& address) {
+    close();
+    fd = spectatorConnect(address);
+    if(fd < 0) return false;
+    for(int k = 0;k < spectator_history;k++) historyTick[k] = -1;
+    return true;
+}
+
+void SpectatorClient::close() {
+    if(fd >= 0) ::close(fd);
+    fd = -1;
+    inbox.clear();
+    outbox.clear();
+    tables.clear();
+    setups.clear();
+    tick = -1;
+}
+
+bool SpectatorClient::decode(const SpectatorFrameHeader& header, const uint8_t* data) {
+    const uint8_t* end = data + header.size;
+
+    if(header.baseTick >= 0) {
+        int slot = header.baseTick % spectator_history;
+        if(historyTick[slot] != header.baseTick) return false;
+        tables = history[slot];
+    }
+
+    for(uint32_t k = 0;k < header.tableCount;k++) {
+        if(end - data < 5) return false;
+        uint16_t index, count;
+        memcpy(&index, data, 2);
+        uint8_t flags = data[2];
+        memcpy(&count, data + 3, 2);
+        int n = count;
+        data += 5;
+
+        if(index >= tables.size()) {
+            tables.resize(index + 1);
+            setups.resize(index + 1);
+        }
+        QuantizedTable& table = tables[index];
+        int bytes = (n + 7) / 8;
+
+        if(flags & 1) {
+            if(end - data < ptrdiff_t(n * 11)) return false;
+            TableSetup& setup = setups[index];
+            setup.radius.resize(n);
+            setup.y.resize(n);
+            setup.rgb.resize(3 * n);
+            for(int i = 0;i < n;i++) {
+                memcpy(&setup.radius[i], data, 4);
+                memcpy(&setup.y[i], data + 4, 4);
+                memcpy(&setup.rgb[3 * i], data + 8, 3);
+                data += 11;
+            }
+            table.x.assign(n, 0);
+            table.z.assign(n, 0);
+        }
+        if(table.count() != n || end - data < 2 * bytes) return false;
+
+        table.active.assign(data, data + bytes);
+        const uint8_t* changed = data + bytes;
+        data += 2 * bytes;
+        for(int i = 0;i < n;i++) {
+            if(!((changed[i >> 3] >> (i & 7)) & 1)) continue;
+            if(end - data < 4) return false;
+            memcpy(&table.x[i], data, 2);
+            memcpy(&table.z[i], data + 2, 2);
+            data += 4;
+            stats.ballsSent++;
+        }
+        stats.tablesSent++;
+    }
+
+    int slot = header.tick % spectator_history;
+    history[slot] = tables;
+    historyTick[slot] = header.tick;
+    tick = header.tick;
+    return true;
+}
+
+int SpectatorClient::poll() {
+    if(fd < 0) return -1;
+
+    uint8_t buffer[65536];
+    for(;;) {
+        ssize_t got = recv(fd, buffer, sizeof(buffer), 0);
+        if(got == 0) {
+            close();
+            return -1;
+        }
+        if(got < 0) {
+            if(errno == EAGAIN || errno == EWOULDBLOCK) break;
+            if(errno == EINTR) continue;
+            close();
+            return -1;
+        }
+        inbox.insert(inbox.end(), buffer, buffer + got);
+        stats.bytes += got;
+    }
+
+    int decoded = 0;
+    size_t used = 0;
+    while(inbox.size() - used >= sizeof(SpectatorFrameHeader)) {
+        SpectatorFrameHeader header;
+        memcpy(&header, inbox.data() + used, sizeof(header));
+        if(header.magic != spectator_frame_magic) {
+            close();
+            return -1;
+        }
+        if(inbox.size() - used - sizeof(header) < header.size) break;
+
+        if(!decode(header, inbox.data() + used + sizeof(header))) {
+            close();
+            return -1;
+        }
+        used += sizeof(header) + header.size;
+        stats.frames++;
+        stats.addLatency((steadyNs() - header.sentNs) * 1e-6);
+        decoded++;
+
+        SpectatorAck ack = {spectator_ack_magic, 0, header.tick, header.sentNs};
+        put(outbox, ack);
+    }
+    inbox.erase(inbox.begin(), inbox.begin() + used);
+
+    // Acks are tiny, but a full socket buffer can still take only part of one
+    while(!outbox.empty()) {
+        ssize_t sent = send(fd, outbox.data(), outbox.size(), MSG_NOSIGNAL);
+        if(sent < 0) {
+            if(errno == EAGAIN || errno == EWOULDBLOCK) break;
+            if(errno == EINTR) continue;
+            close();
+            return -1;
+        }
+        outbox.erase(outbox.begin(), outbox.begin() + sent);
+    }
+    return decoded;
+}
+
+void SpectatorClient::table(int index, BallSet& out) const {
+    if(index < 0 || index >= tableCount()) {
+        out.resize(0);
+        return;
+    }
+
+    const QuantizedTable& table = tables[index];
+    const TableSetup& setup = setups[index];
+    int n = table.count();
+    if(out.count != n) out.resize(n);
+    for(int i = 0;i < n;i++) {
+        out.x[i] = table.x[i] / spectator_position_scale;
+        out.z[i] = table.z[i] / spectator_position_scale;
+        out.y[i] = setup.y[i];
+        out.radius[i] = setup.radius[i];
+        out.color[i] = glm::vec3(setup.rgb[3 * i], setup.rgb[3 * i + 1], setup.rgb[3 * i + 2]) / 255.0f;
+        out.setActive(i, bit(table.active, i));
+    }
+}
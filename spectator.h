@@ -0,0 +1,170 @@
+#ifndef SPECTATOR_H
+#define SPECTATOR_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "physics.h"
+
+// Live ball state of many tables streamed to viewers over TCP or a Unix
+// socket. Addresses are "tcp:<ipv4 or localhost>:<port>" or "unix:<path>".
+//
+// Every tick the server sends each viewer one frame holding all tables, as a
+// delta against the last tick that viewer acked: a table only appears when
+// something on it changed since then, and inside it only the balls that did.
+// Positions go as int16 in 1/spectator_position_scale table units. Viewers
+// ack every frame they decode, echoing the server's send time, which gives
+// the server its round trip and the viewer its one-way latency (on one host).
+//
+// Frame, little-endian:
+//   SpectatorFrameHeader
+//   per table: uint16 table, uint8 flags, uint16 ball count,
+//              [setup: per ball float radius, float y, uint8 r, g, b],
+//              active bits, changed bits, per changed ball int16 x, z
+// A frame with baseTick -1 is a full one: every table, every ball, with setup.
+// Tables past spectator_max_tables and balls past spectator_max_balls aren't
+// streamed.
+
+const uint32_t spectator_frame_magic = 0x32505342; // "BSP2", ball counts went from 8 to 16 bits
+const uint32_t spectator_ack_magic = 0x4b434142;   // "BACK"
+const float spectator_position_scale = 8192;
+const int spectator_max_tables = 65536;
+const int spectator_max_balls = 65535;
+// Ticks of state both ends keep to decode deltas against, an older ack gets
+// a full frame
+const int spectator_history = 64;
+// A viewer whose unsent bytes pile up past this skips frames until it drains
+const size_t spectator_max_backlog = 1 << 20;
+
+struct SpectatorFrameHeader {
+    uint32_t magic;
+    uint32_t size;     // bytes after the header
+    int64_t tick;
+    int64_t baseTick;  // tick the deltas are against, -1 for a full frame
+    uint64_t sentNs;   // server steady clock
+    uint32_t tableCount;
+    uint32_t reserved;
+};
+
+struct SpectatorAck {
+    uint32_t magic;
+    uint32_t reserved;
+    int64_t tick;
+    uint64_t sentNs; // echoed from the frame
+};
+
+// One table as it goes over the wire
+struct QuantizedTable {
+    std::vector<int16_t> x, z;
+    std::vector<uint8_t> active; // one bit per ball
+
+    int count() const { return int(x.size()); }
+    void quantize(const BallSet& balls);
+    bool sameBall(const QuantizedTable& other, int i) const;
+};
+
+// Radius, height and color of a table's balls, sent once per viewer
+struct TableSetup {
+    std::vector<float> radius, y;
+    std::vector<uint8_t> rgb;
+};
+
+// Counts are of what the server sent or what a client received
+struct SpectatorStats {
+    uint64_t bytes = 0;
+    uint64_t frames = 0;
+    uint64_t skipped = 0;   // frames a backed up viewer didn't get
+    uint64_t tablesSent = 0;
+    uint64_t ballsSent = 0;
+    // ms: one way on a client, round trip on the server, which includes the
+    // wait until the next broadcast() reads the ack
+    double latencySum = 0;
+    double latencyMax = 0;
+    uint64_t latencyCount = 0;
+
+    double meanLatency() const { return latencyCount ? latencySum / latencyCount : 0; }
+    void addLatency(double ms);
+};
+
+// Bound or connected non-blocking socket for an address, -1 with errno set
+int spectatorListen(const std::string& address);
+int spectatorConnect(const std::string& address);
+
+class SpectatorServer {
+public:
+    SpectatorStats stats;
+
+    ~SpectatorServer();
+
+    bool listen(const std::string& address);
+    void close();
+
+    // Accept new viewers, read their acks and send each of them tick's state
+    // of every table in one frame. Call once per tick from the simulation
+    // thread, after stepping the tables.
+    void broadcast(long tick, const std::vector<World>& tables);
+
+    int viewerCount() const { return int(viewers.size()); }
+
+private:
+    struct Viewer {
+        int fd;
+        long ackedTick = -1;
+        std::vector<uint8_t> pending; // unsent part of the last frame
+        size_t pendingOffset = 0;
+        std::vector<uint8_t> inbox;
+    };
+
+    struct Snapshot {
+        long tick = -1;
+        std::vector<QuantizedTable> tables;
+    };
+
+    int listenFd = -1;
+    std::string unixPath;
+    std::vector<Viewer> viewers;
+    Snapshot history[spectator_history];
+    std::vector<long> changedAt; // last tick each table differed from the tick before
+    std::vector<TableSetup> setups;
+    std::vector<uint8_t> frame;
+
+    void accept();
+    bool readAcks(Viewer& viewer);
+    bool flush(Viewer& viewer);
+    void snapshot(long tick, const std::vector<World>& tables);
+    void encode(long tick, const Viewer& viewer);
+};
+
+class SpectatorClient {
+public:
+    SpectatorStats stats;
+    long tick = -1; // of the latest decoded frame
+
+    ~SpectatorClient();
+
+    // False with errno set when it can't
+    bool connect(const std::string& address);
+    void close();
+    bool isOpen() const { return fd >= 0; }
+    int socket() const { return fd; }
+
+    // Read whatever arrived, decode and ack every complete frame. Returns the
+    // number of frames decoded, -1 once the server is gone or sent garbage.
+    int poll();
+
+    int tableCount() const { return int(tables.size()); }
+    // Ball state of one table as of the latest frame
+    void table(int index, BallSet& out) const;
+
+private:
+    int fd = -1;
+    std::vector<uint8_t> inbox, outbox;
+    std::vector<QuantizedTable> tables;
+    std::vector<TableSetup> setups;
+    long historyTick[spectator_history];
+    std::vector<QuantizedTable> history[spectator_history];
+
+    bool decode(const SpectatorFrameHeader& header, const uint8_t* data);
+};
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+
+// Bounded lock-free ring for exactly one producer thread and one consumer
+// thread. Capacity has to be a power of two.
+template<class T, size_t Capacity>
+class SpscQueue {
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    // Producer only, false when the queue is full
+    bool push(const T& value) {
+        size_t write = writePos.load(std::memory_order_relaxed);
+        if(write - readPos.load(std::memory_order_acquire) == Capacity) return false;
+
+        items[write & (Capacity - 1)] = value;
+        writePos.store(write + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only, false when the queue is empty
+    bool pop(T& value) {
+        size_t read = readPos.load(std::memory_order_relaxed);
+        if(read == writePos.load(std::memory_order_acquire)) return false;
+
+        value = items[read & (Capacity - 1)];
+        readPos.store(read + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    // Kept on separate cache lines so the two threads don't fight over one
+    alignas(64) std::atomic<size_t> readPos{0};
+    alignas(64) std::atomic<size_t> writePos{0};
+    T items[Capacity];
+};
+
+#endif
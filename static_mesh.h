@@ -0,0 +1,206 @@
+#ifndef STATIC_MESH_H
+#define STATIC_MESH_H
+
+// Geometry that can be built at compile time: sin/cos usable in constant
+// expressions, unit circle tables and mesh builders that work the same on a
+// fixed-size StaticMesh (constexpr, ends up in read-only data) and on the
+// growable Mesh from mesh.h. No GL and no glm in here.
+#include <cstddef>
+#include <cstdint>
+
+struct Vertex {
+    float x, y, z;
+    float nx, ny, nz;
+    float r, g, b;
+};
+
+struct Rgb {
+    float r, g, b;
+};
+
+constexpr double const_pi = 3.14159265358979323846;
+
+// Taylor series after reducing to [-pi, pi], good to double precision
+constexpr double constSin(double x) {
+    double turns = x / (2 * const_pi);
+    long k = long(turns + (turns >= 0 ? 0.5 : -0.5));
+    x -= k * 2 * const_pi;
+
+    double term = x, sum = x;
+    for(int n = 1;n < 16;n++) {
+        term *= -x * x / ((2 * n) * (2 * n + 1));
+        sum += term;
+    }
+    return sum;
+}
+
+constexpr double constCos(double x) {
+    return constSin(x + const_pi / 2);
+}
+
+// cos and sin of 2 pi i / Segments for i = 0 .. Segments, the last entry
+// repeats the first so loops can close the ring without a modulo
+template<int Segments>
+struct UnitCircle {
+    float cosines[Segments + 1];
+    float sines[Segments + 1];
+};
+
+template<int Segments>
+constexpr UnitCircle<Segments> makeUnitCircle() {
+    UnitCircle<Segments> circle = {};
+    for(int i = 0;i <= Segments;i++) {
+        double angle = 2 * const_pi * i / Segments;
+        circle.cosines[i] = float(constCos(angle));
+        circle.sines[i] = float(constSin(angle));
+    }
+    return circle;
+}
+
+template<int Segments>
+inline constexpr UnitCircle<Segments> unit_circle = makeUnitCircle<Segments>();
+
+// Mesh with room for exactly VertexCount vertices and IndexCount indices
+template<size_t VertexCount, size_t IndexCount>
+struct StaticMesh {
+    Vertex vertices[VertexCount] = {};
+    uint32_t indices[IndexCount] = {};
+    size_t vertexCount = 0, indexCount = 0;
+
+    constexpr uint32_t addVertex(const Vertex& v) {
+        vertices[vertexCount] = v;
+        return uint32_t(vertexCount++);
+    }
+
+    constexpr void addTriangle(uint32_t a, uint32_t b, uint32_t c) {
+        indices[indexCount++] = a;
+        indices[indexCount++] = b;
+        indices[indexCount++] = c;
+    }
+};
+
+// Sizes of what the builders below add
+constexpr size_t box_vertices = 24, box_indices = 36;
+constexpr size_t discVertices(int segments) { return segments + 2; }
+constexpr size_t discIndices(int segments) { return 3 * segments; }
+constexpr size_t tubeVertices(int segments) { return 2 * (segments + 1); }
+constexpr size_t tubeIndices(int segments) { return 6 * segments; }
+constexpr size_t cylinderVertices(int segments) { return tubeVertices(segments) + 2 * discVertices(segments); }
+constexpr size_t cylinderIndices(int segments) { return tubeIndices(segments) + 2 * discIndices(segments); }
+constexpr size_t pocketVertices(int segments) { return discVertices(segments) + tubeVertices(segments); }
+constexpr size_t pocketIndices(int segments) { return discIndices(segments) + tubeIndices(segments); }
+constexpr size_t sphereVertices(int slices, int stacks) { return size_t(stacks + 1) * (slices + 1); }
+constexpr size_t sphereIndices(int slices, int stacks) { return size_t(6) * stacks * slices; }
+
+// The builders take any M with addVertex(const Vertex&) and addTriangle(a, b, c)
+
+// Two triangles a b c, a c d with one normal
+template<class M>
+constexpr void meshQuad(M& mesh, const float (&a)[3], const float (&b)[3], const float (&c)[3], const float (&d)[3],
+                        float nx, float ny, float nz, Rgb color) {
+    uint32_t ia = mesh.addVertex({a[0], a[1], a[2], nx, ny, nz, color.r, color.g, color.b});
+    uint32_t ib = mesh.addVertex({b[0], b[1], b[2], nx, ny, nz, color.r, color.g, color.b});
+    uint32_t ic = mesh.addVertex({c[0], c[1], c[2], nx, ny, nz, color.r, color.g, color.b});
+    uint32_t id = mesh.addVertex({d[0], d[1], d[2], nx, ny, nz, color.r, color.g, color.b});
+    mesh.addTriangle(ia, ib, ic);
+    mesh.addTriangle(ia, ic, id);
+}
+
+// Top face at height y spanning x .. x + width, z .. z + depth, going height down
+template<class M>
+constexpr void meshBox(M& mesh, float x, float y, float z, float width, float depth, float height, Rgb color) {
+    float x1 = x + width, y0 = y - height, z1 = z + depth;
+
+    meshQuad(mesh, {x, y, z}, {x1, y, z}, {x1, y, z1}, {x, y, z1}, 0, 1, 0, color);        // Top face
+    meshQuad(mesh, {x, y0, z}, {x1, y0, z}, {x1, y0, z1}, {x, y0, z1}, 0, -1, 0, color);   // Bottom face
+    meshQuad(mesh, {x, y0, z}, {x1, y0, z}, {x1, y, z}, {x, y, z}, 0, 0, -1, color);       // Front face
+    meshQuad(mesh, {x, y0, z1}, {x1, y0, z1}, {x1, y, z1}, {x, y, z1}, 0, 0, 1, color);    // Back face
+    meshQuad(mesh, {x, y0, z}, {x, y0, z1}, {x, y, z1}, {x, y, z}, -1, 0, 0, color);       // Left face
+    meshQuad(mesh, {x1, y0, z}, {x1, y0, z1}, {x1, y, z1}, {x1, y, z}, 1, 0, 0, color);    // Right face
+}
+
+// Triangle fan around (x, y, z) facing along normalY. cosines and sines hold
+// segments + 1 entries, as in UnitCircle.
+template<class M>
+constexpr void meshDisc(M& mesh, float x, float y, float z, float radius, float normalY, Rgb color,
+                        const float* cosines, const float* sines, int segments) {
+    uint32_t center = mesh.addVertex({x, y, z, 0, normalY, 0, color.r, color.g, color.b});
+    for(int i = 0;i <= segments;i++) {
+        uint32_t v = mesh.addVertex({x + radius * cosines[i], y, z + radius * sines[i], 0, normalY, 0, color.r, color.g, color.b});
+        if(i > 0) mesh.addTriangle(center, v - 1, v);
+    }
+}
+
+// Open tube from y down to y - height
+template<class M>
+constexpr void meshTube(M& mesh, float x, float y, float z, float radius, float height, Rgb color,
+                        const float* cosines, const float* sines, int segments) {
+    uint32_t base = 0;
+    for(int i = 0;i <= segments;i++) {
+        float c = cosines[i], s = sines[i];
+        uint32_t top = mesh.addVertex({x + radius * c, y, z + radius * s, c, 0, s, color.r, color.g, color.b}); // Top edge
+        mesh.addVertex({x + radius * c, y - height, z + radius * s, c, 0, s, color.r, color.g, color.b});       // Bottom edge
+        if(i == 0) base = top;
+    }
+    for(int i = 0;i < segments;i++) {
+        uint32_t top = base + 2 * i;
+        mesh.addTriangle(top, top + 1, top + 3);
+        mesh.addTriangle(top, top + 3, top + 2);
+    }
+}
+
+// Closed cylinder centred on x, z with the top cap at y
+template<class M>
+constexpr void meshCylinder(M& mesh, float x, float y, float z, float radius, float height, Rgb color,
+                            const float* cosines, const float* sines, int segments) {
+    meshTube(mesh, x, y, z, radius, height, color, cosines, sines, segments);
+    meshDisc(mesh, x, y, z, radius, 1, color, cosines, sines, segments);
+    meshDisc(mesh, x, y - height, z, radius, -1, color, cosines, sines, segments);
+}
+
+// Disc at height y with a wall going depth down
+template<class M>
+constexpr void meshPocket(M& mesh, float x, float y, float z, float radius, float depth, Rgb color,
+                          const float* cosines, const float* sines, int segments) {
+    meshDisc(mesh, x, y, z, radius, 1, color, cosines, sines, segments);
+    meshTube(mesh, x, y, z, radius, depth, color, cosines, sines, segments);
+}
+
+// Unit sphere around the origin, white. ringCos/ringSin come from a circle of
+// 2 * stacks segments (only the first half is used), cosines/sines from one of
+// slices segments.
+template<class M>
+constexpr void meshSphere(M& mesh, const float* ringCos, const float* ringSin, int stacks,
+                          const float* cosines, const float* sines, int slices) {
+    uint32_t base = 0;
+    for(int i = 0;i <= stacks;i++) {
+        float y = ringCos[i], ring = ringSin[i];
+        for(int j = 0;j <= slices;j++) {
+            float px = ring * cosines[j], pz = ring * sines[j];
+            uint32_t v = mesh.addVertex({px, y, pz, px, y, pz, 1, 1, 1});
+            if(i == 0 && j == 0) base = v;
+        }
+    }
+
+    for(int i = 0;i < stacks;i++) {
+        for(int j = 0;j < slices;j++) {
+            uint32_t a = base + i * (slices + 1) + j;
+            uint32_t b = a + slices + 1;
+            mesh.addTriangle(a, b, b + 1);
+            mesh.addTriangle(a, b + 1, a + 1);
+        }
+    }
+}
+
+template<int Slices, int Stacks>
+constexpr StaticMesh<sphereVertices(Slices, Stacks), sphereIndices(Slices, Stacks)> makeSphere() {
+    StaticMesh<sphereVertices(Slices, Stacks), sphereIndices(Slices, Stacks)> mesh;
+    meshSphere(mesh, unit_circle<2 * Stacks>.cosines, unit_circle<2 * Stacks>.sines, Stacks,
+               unit_circle<Slices>.cosines, unit_circle<Slices>.sines, Slices);
+    return mesh;
+}
+
+template<int Slices, int Stacks>
+inline constexpr auto sphere_mesh = makeSphere<Slices, Stacks>();
+
+#endif
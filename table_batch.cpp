@@ -0,0 +1,39 @@
+#include "table_batch.h"
+#include <atomic>
+
+TableBatch::TableBatch(int count, int threads) : tables(count), restTicks(count, 0), pool(threads) {
+}
+
+void TableBatch::rack() {
+    for(World& world : tables) {
+        world.rack();
+    }
+}
+
+void TableBatch::step(int ticks) {
+    pool.parallelFor(size(), step_grain, [&](int begin, int end, int) {
+        for(int i = begin;i < end;i++) {
+            for(int t = 0;t < ticks;t++) {
+                tables[i].tick();
+            }
+        }
+    });
+}
+
+int TableBatch::runUntilRest(int maxTicks) {
+    std::atomic<int> moving(0);
+
+    // Shots take very different times to settle, so hand out one table at a
+    // time and let idle workers steal the rest
+    pool.parallelFor(size(), 1, [&](int begin, int end, int) {
+        for(int i = begin;i < end;i++) {
+            World& world = tables[i];
+            restTicks[i] = world.runUntilRest(maxTicks);
+            if(!world.atRest()) {
+                moving.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    });
+
+    return moving.load();
+}
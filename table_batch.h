@@ -0,0 +1,43 @@
+#ifndef TABLE_BATCH_H
+#define TABLE_BATCH_H
+
+#include <vector>
+#include "physics.h"
+#include "thread_pool.h"
+
+// Many independent tables stepped in parallel. Each worker gets a contiguous
+// run of tables, so a table's ball arrays stay in one core's cache for the
+// whole call.
+class TableBatch {
+public:
+    // Tables handed to a worker at once by step()
+    static const int step_grain = 16;
+
+    std::vector<World> tables;
+    // Ticks each table needed to come to rest in the last runUntilRest()
+    std::vector<int> restTicks;
+
+    // threads = 0 uses every hardware thread
+    explicit TableBatch(int count, int threads = 0);
+
+    int size() const { return int(tables.size()); }
+    World& table(int i) { return tables[i]; }
+
+    // Put the standard rack on every table
+    void rack();
+
+    // Run ticks fixed ticks on every table
+    void step(int ticks = 1);
+
+    // Tick every table until it is at rest or has run maxTicks. Tables don't
+    // wait for each other: a worker keeps ticking one table until it stops and
+    // then moves on to the next. Returns how many tables are still moving.
+    int runUntilRest(int maxTicks);
+
+    int threadCount() const { return pool.size(); }
+
+private:
+    ThreadPool pool;
+};
+
+#endif
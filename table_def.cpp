@@ -0,0 +1,302 @@
+#include "table_def.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const RackDef* TableDef::findRack(const char* rackName) const {
+    if(!rackName) return rackCount > 0 ? &racks[0] : nullptr;
+    for(int i = 0;i < rackCount;i++) {
+        if(strncmp(racks[i].name, rackName, sizeof(racks[i].name)) == 0) return &racks[i];
+    }
+    return nullptr;
+}
+
+TableAsset::~TableAsset() {
+    close();
+}
+
+void TableAsset::close() {
+    if(mapped) munmap(mapped, mappedSize);
+    mapped = nullptr;
+    mappedSize = 0;
+    image.clear();
+    def = {};
+}
+
+bool TableAsset::load(const std::string& path) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0) {
+        std::cerr << "Can't open " << path << std::endl;
+        return false;
+    }
+
+    struct stat info;
+    uint32_t magic = 0;
+    if(fstat(fd, &info) != 0 || pread(fd, &magic, sizeof(magic), 0) != ssize_t(sizeof(magic)) || magic != table_file_magic) {
+        ::close(fd);
+        std::ifstream in(path);
+        std::stringstream text;
+        text << in.rdbuf();
+        return parse(text.str(), path);
+    }
+
+    void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(mapping == MAP_FAILED) {
+        std::cerr << "Can't map " << path << std::endl;
+        return false;
+    }
+    mapped = mapping;
+    mappedSize = info.st_size;
+
+    if(!view(mapped, mappedSize, path)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool TableAsset::view(const void* data, size_t size, const std::string& source) {
+    TableFileHeader header;
+    if(size < sizeof(header)) {
+        std::cerr << source << ": truncated table file" << std::endl;
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+
+    uint64_t expected = sizeof(header) + uint64_t(header.cushionCount) * sizeof(CushionDef) +
+                        uint64_t(header.pocketCount) * sizeof(PocketDef) + uint64_t(header.rackCount) * sizeof(RackDef) +
+                        uint64_t(header.rackBallCount) * sizeof(RackBallDef);
+    if(header.magic != table_file_magic || header.version != table_file_version || header.size != size || expected != size) {
+        std::cerr << source << ": not a version " << table_file_version << " table file" << std::endl;
+        return false;
+    }
+    if(header.pocketCount > uint32_t(max_pockets) || !memchr(header.name, 0, sizeof(header.name)) ||
+       !(header.minX < header.maxX && header.minZ < header.maxZ)) {
+        std::cerr << source << ": bad table header" << std::endl;
+        return false;
+    }
+
+    const uint8_t* bytes = (const uint8_t*)data;
+    def.name = (const char*)bytes + offsetof(TableFileHeader, name);
+    def.minX = header.minX;
+    def.maxX = header.maxX;
+    def.minZ = header.minZ;
+    def.maxZ = header.maxZ;
+    def.cushions = (const CushionDef*)(bytes + sizeof(header));
+    def.cushionCount = header.cushionCount;
+    def.pockets = (const PocketDef*)(def.cushions + def.cushionCount);
+    def.pocketCount = header.pocketCount;
+    def.racks = (const RackDef*)(def.pockets + def.pocketCount);
+    def.rackCount = header.rackCount;
+    def.rackBalls = (const RackBallDef*)(def.racks + def.rackCount);
+    def.rackBallCount = header.rackBallCount;
+
+    // The same limits parse() puts on text assets
+    for(int i = 0;i < def.pocketCount;i++) {
+        if(!(def.pockets[i].radius > 0)) {
+            std::cerr << source << ": bad pocket " << i << std::endl;
+            def = {};
+            return false;
+        }
+    }
+    for(int i = 0;i < def.rackBallCount;i++) {
+        if(!(def.rackBalls[i].radius > 0 && def.rackBalls[i].mass > 0)) {
+            std::cerr << source << ": bad rack ball " << i << std::endl;
+            def = {};
+            return false;
+        }
+    }
+
+    for(int i = 0;i < def.rackCount;i++) {
+        const RackDef& rack = def.racks[i];
+        if(!memchr(rack.name, 0, sizeof(rack.name)) || rack.count == 0 ||
+           uint64_t(rack.first) + rack.count > uint64_t(def.rackBallCount)) {
+            std::cerr << source << ": bad rack " << i << std::endl;
+            def = {};
+            return false;
+        }
+    }
+    return true;
+}
+
+// Fail parse() with a message pointing at the line
+static bool parseError(const std::string& source, int line, const std::string& message) {
+    std::cerr << source << ":" << line << ": " << message << std::endl;
+    return false;
+}
+
+bool TableAsset::parse(const std::string& text, const std::string& source) {
+    close();
+
+    std::string name = "table";
+    std::vector<CushionDef> cushions;
+    std::vector<PocketDef> pockets;
+    std::vector<RackDef> racks;
+    std::vector<RackBallDef> rackBalls;
+
+    std::istringstream lines(text);
+    std::string line;
+    for(int number = 1;std::getline(lines, line);number++) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream in(line);
+        std::string keyword, extra;
+        if(!(in >> keyword)) continue;
+
+        bool ok = true;
+        if(keyword == "table") {
+            ok = bool(in >> name) && name.size() < sizeof(TableFileHeader::name);
+        }
+        else if(keyword == "cushion") {
+            CushionDef c;
+            ok = bool(in >> c.x0 >> c.z0 >> c.x1 >> c.z1);
+            if(ok && c.x0 != c.x1 && c.z0 != c.z1) return parseError(source, number, "cushions must run along x or z");
+            cushions.push_back(c);
+        }
+        else if(keyword == "pocket") {
+            PocketDef p;
+            ok = bool(in >> p.x >> p.z >> p.radius) && p.radius > 0;
+            if(ok && int(pockets.size()) == max_pockets) return parseError(source, number, "too many pockets");
+            pockets.push_back(p);
+        }
+        else if(keyword == "rack") {
+            RackDef r = {};
+            std::string rackName;
+            ok = bool(in >> rackName) && rackName.size() < sizeof(r.name);
+            strncpy(r.name, rackName.c_str(), sizeof(r.name) - 1);
+            r.first = uint32_t(rackBalls.size());
+            racks.push_back(r);
+        }
+        else if(keyword == "ball") {
+            if(racks.empty()) return parseError(source, number, "ball before the first rack");
+            RackBallDef b;
+            ok = bool(in >> b.x >> b.z >> b.radius >> b.mass >> b.r >> b.g >> b.b) && b.radius > 0 && b.mass > 0;
+            rackBalls.push_back(b);
+            racks.back().count++;
+        }
+        else {
+            return parseError(source, number, "unknown item '" + keyword + "'");
+        }
+
+        if(!ok || in >> extra) return parseError(source, number, "bad " + keyword);
+    }
+
+    if(cushions.empty()) return parseError(source, 0, "no cushions");
+    for(const RackDef& r : racks) {
+        if(r.count == 0) return parseError(source, 0, std::string("rack ") + r.name + " has no balls");
+    }
+
+    TableFileHeader header = {};
+    header.magic = table_file_magic;
+    header.version = table_file_version;
+    header.cushionCount = uint32_t(cushions.size());
+    header.pocketCount = uint32_t(pockets.size());
+    header.rackCount = uint32_t(racks.size());
+    header.rackBallCount = uint32_t(rackBalls.size());
+    header.minX = header.maxX = cushions[0].x0;
+    header.minZ = header.maxZ = cushions[0].z0;
+    for(const CushionDef& c : cushions) {
+        header.minX = std::min(header.minX, std::min(c.x0, c.x1));
+        header.maxX = std::max(header.maxX, std::max(c.x0, c.x1));
+        header.minZ = std::min(header.minZ, std::min(c.z0, c.z1));
+        header.maxZ = std::max(header.maxZ, std::max(c.z0, c.z1));
+    }
+    if(!(header.minX < header.maxX && header.minZ < header.maxZ)) return parseError(source, 0, "cushions don't enclose anything");
+    strncpy(header.name, name.c_str(), sizeof(header.name) - 1);
+
+    size_t size = sizeof(header) + cushions.size() * sizeof(CushionDef) + pockets.size() * sizeof(PocketDef) +
+                  racks.size() * sizeof(RackDef) + rackBalls.size() * sizeof(RackBallDef);
+    header.size = uint32_t(size);
+
+    image.assign(size / 4, 0);
+    uint8_t* out = (uint8_t*)image.data();
+    auto put = [&out](const void* data, size_t bytes) {
+        if(bytes) memcpy(out, data, bytes);
+        out += bytes;
+    };
+    put(&header, sizeof(header));
+    put(cushions.data(), cushions.size() * sizeof(CushionDef));
+    put(pockets.data(), pockets.size() * sizeof(PocketDef));
+    put(racks.data(), racks.size() * sizeof(RackDef));
+    put(rackBalls.data(), rackBalls.size() * sizeof(RackBallDef));
+
+    if(!view(image.data(), size, source)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool writeTableBinary(const TableDef& table, const std::string& path) {
+    TableFileHeader header = {};
+    header.magic = table_file_magic;
+    header.version = table_file_version;
+    header.cushionCount = table.cushionCount;
+    header.pocketCount = table.pocketCount;
+    header.rackCount = table.rackCount;
+    header.rackBallCount = table.rackBallCount;
+    header.minX = table.minX;
+    header.maxX = table.maxX;
+    header.minZ = table.minZ;
+    header.maxZ = table.maxZ;
+    strncpy(header.name, table.name, sizeof(header.name) - 1);
+    header.size = uint32_t(sizeof(header) + table.cushionCount * sizeof(CushionDef) + table.pocketCount * sizeof(PocketDef) +
+                           table.rackCount * sizeof(RackDef) + table.rackBallCount * sizeof(RackBallDef));
+
+    FILE* file = fopen(path.c_str(), "wb");
+    if(!file) return false;
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(table.cushions, sizeof(CushionDef), table.cushionCount, file);
+    fwrite(table.pockets, sizeof(PocketDef), table.pocketCount, file);
+    fwrite(table.racks, sizeof(RackDef), table.rackCount, file);
+    fwrite(table.rackBalls, sizeof(RackBallDef), table.rackBallCount, file);
+    return fclose(file) == 0;
+}
+
+// Shortest decimal that reads back as the same float
+static std::string shortest(float v) {
+    char buffer[32];
+    for(int digits = 6;digits < 9;digits++) {
+        snprintf(buffer, sizeof(buffer), "%.*g", digits, v);
+        if(strtof(buffer, nullptr) == v) return buffer;
+    }
+    snprintf(buffer, sizeof(buffer), "%.9g", v);
+    return buffer;
+}
+
+bool writeTableText(const TableDef& table, const std::string& path) {
+    FILE* file = fopen(path.c_str(), "w");
+    if(!file) return false;
+
+    fprintf(file, "table %s\n\n", table.name);
+    for(int i = 0;i < table.cushionCount;i++) {
+        const CushionDef& c = table.cushions[i];
+        fprintf(file, "cushion %s %s %s %s\n", shortest(c.x0).c_str(), shortest(c.z0).c_str(), shortest(c.x1).c_str(), shortest(c.z1).c_str());
+    }
+    fprintf(file, "\n");
+    for(int i = 0;i < table.pocketCount;i++) {
+        const PocketDef& p = table.pockets[i];
+        fprintf(file, "pocket %s %s %s\n", shortest(p.x).c_str(), shortest(p.z).c_str(), shortest(p.radius).c_str());
+    }
+    for(int i = 0;i < table.rackCount;i++) {
+        const RackDef& r = table.racks[i];
+        fprintf(file, "\nrack %s\n", r.name);
+        fprintf(file, "# x z radius mass  r g b\n");
+        for(uint32_t k = r.first;k < r.first + r.count;k++) {
+            const RackBallDef& b = table.rackBalls[k];
+            fprintf(file, "ball %s %s %s %s  %s %s %s\n", shortest(b.x).c_str(), shortest(b.z).c_str(), shortest(b.radius).c_str(),
+                    shortest(b.mass).c_str(), shortest(b.r).c_str(), shortest(b.g).c_str(), shortest(b.b).c_str());
+        }
+    }
+    return fclose(file) == 0;
+}
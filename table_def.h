@@ -0,0 +1,184 @@
+#ifndef TABLE_DEF_H
+#define TABLE_DEF_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Table and rack descriptions: cushions, pockets and the ball layouts a table
+// can be racked with. World and the renderer both read a TableDef, so a table
+// loaded from an asset plays and draws the same.
+//
+// Assets are authored as text and compiled to a binary form that is mapped
+// and used in place, no parsing (see TableAsset). Text, one item per line,
+// '#' starts a comment:
+//   table <name>
+//   cushion <x0> <z0> <x1> <z1>
+//   pocket <x> <z> <radius>
+//   rack <name>
+//   ball <x> <z> <radius> <mass> <r> <g> <b>   # in the last rack, cue ball first
+
+// The standard table, the built-in default
+constexpr float pocketRadius = 0.1;
+constexpr float table_width = 2.8f;
+constexpr float table_height = 1.4;
+// Height of the cloth, a ball rests at table_surface + its radius
+constexpr float table_surface = 0.5;
+
+// Pocket centres on the table plane (x, z)
+constexpr float pocket_positions[6][2] = {
+    {1.4, 0.7}, {-1.4, 0.7}, {1.4, -0.7}, {-1.4, -0.7}, {0.0, -0.7}, {0.0, 0.7}
+};
+
+// World keeps sets of pockets in a byte
+const int max_pockets = 8;
+
+// A straight cushion, along x (z0 == z1) or along z (x0 == x1). Balls bounce
+// off the rectangle the cushions bound; the segments themselves decide where
+// the rails are drawn.
+struct CushionDef {
+    float x0, z0, x1, z1;
+};
+
+// A ball drops once its centre is within radius / 2 plus its own radius of
+// the pocket centre
+struct PocketDef {
+    float x, z, radius;
+};
+
+struct RackBallDef {
+    float x, z, radius, mass;
+    float r, g, b;
+};
+
+// Balls first .. first + count - 1 of TableDef::rackBalls, the first is the
+// cue ball
+struct RackDef {
+    char name[24];
+    uint32_t first, count;
+};
+
+// A table description. Only points at its arrays: they live in a TableAsset
+// or, for standard_table, in read-only data.
+struct TableDef {
+    const char* name;
+    float minX, maxX, minZ, maxZ; // inside of the cushions
+    const CushionDef* cushions;
+    int cushionCount;
+    const PocketDef* pockets;
+    int pocketCount;
+    const RackDef* racks;
+    int rackCount;
+    const RackBallDef* rackBalls;
+    int rackBallCount;
+
+    constexpr float width() const { return maxX - minX; }
+    constexpr float height() const { return maxZ - minZ; }
+
+    // The rack called name, the first one for nullptr; nullptr if there is none
+    const RackDef* findRack(const char* name = nullptr) const;
+};
+
+inline constexpr CushionDef standard_cushions[4] = {
+    {-table_width / 2, -table_height / 2, table_width / 2, -table_height / 2},
+    {-table_width / 2, table_height / 2, table_width / 2, table_height / 2},
+    {-table_width / 2, -table_height / 2, -table_width / 2, table_height / 2},
+    {table_width / 2, -table_height / 2, table_width / 2, table_height / 2}
+};
+
+inline constexpr PocketDef standard_pockets[6] = {
+    {pocket_positions[0][0], pocket_positions[0][1], pocketRadius},
+    {pocket_positions[1][0], pocket_positions[1][1], pocketRadius},
+    {pocket_positions[2][0], pocket_positions[2][1], pocketRadius},
+    {pocket_positions[3][0], pocket_positions[3][1], pocketRadius},
+    {pocket_positions[4][0], pocket_positions[4][1], pocketRadius},
+    {pocket_positions[5][0], pocket_positions[5][1], pocketRadius}
+};
+
+// 8-ball: the cue ball, then a triangle of reds with the black in the middle
+inline constexpr RackBallDef standard_rack_balls[16] = {
+    {float(2.0 + (-1.15)), float(1.0 + (-1.0)), 0.05, 1, 1, 1, 1},
+
+    {float(1.0 + (-1.7)), float(1.0 + (-1.0)), 0.05, 1, 1, 0, 0},
+    {float(1.0 + (-1.7)), float(1.1 + (-1.0)), 0.05, 1, 1, 0, 0},
+    {float(1.0 + (-1.7)), float(0.9 + (-1.0)), 0.05, 1, 1, 0, 0},
+    {float(1.0 + (-1.7)), float(1.2 + (-1.0)), 0.05, 1, 1, 0, 0},
+    {float(1.0 + (-1.7)), float(0.8 + (-1.0)), 0.05, 1, 1, 0, 0},
+
+    {float(1.1 + (-1.7) - (0.0134 * 1)), float(1.05 + (-1.0)), 0.05, 1, 1, 0, 0},
+    {float(1.1 + (-1.7) - (0.0134 * 1)), float(1.15 + (-1.0)), 0.05, 1, 1, 0, 0},
+    {float(1.2 + (-1.7) - (0.0134 * 2)), float(1.0 + (-1.0)), 0.05, 1, 0, 0, 0},
+    {float(1.1 + (-1.7) - (0.0134 * 1)), float(0.95 + (-1.0)), 0.05, 1, 1, 0, 0},
+    {float(1.1 + (-1.7) - (0.0134 * 1)), float(0.85 + (-1.0)), 0.05, 1, 1, 0, 0},
+
+    {float(1.2 + (-1.7) - (0.0134 * 2)), float(1.1 + (-1.0)), 0.05, 1, 1, 0, 0},
+    {float(1.2 + (-1.7) - (0.0134 * 2)), float(0.9 + (-1.0)), 0.05, 1, 1, 0, 0},
+
+    {float(1.3 + (-1.7) - (0.0134 * 3)), float(1.05 + (-1.0)), 0.05, 1, 1, 0, 0},
+    {float(1.3 + (-1.7) - (0.0134 * 3)), float(0.95 + (-1.0)), 0.05, 1, 1, 0, 0},
+
+    {float(1.4 + (-1.7) - (0.0134 * 4)), float(1.00 + (-1.0)), 0.05, 1, 1, 0, 0}
+};
+
+inline constexpr RackDef standard_racks[1] = {
+    {"8ball", 0, 16}
+};
+
+inline constexpr TableDef standard_table = {
+    "standard",
+    -table_width / 2, table_width / 2, -table_height / 2, table_height / 2,
+    standard_cushions, 4,
+    standard_pockets, 6,
+    standard_racks, 1,
+    standard_rack_balls, 16
+};
+
+// Binary form: this header, then the cushion, pocket, rack and rack ball
+// arrays back to back. Everything is 4-byte aligned and little-endian.
+const uint32_t table_file_magic = 0x4c425442; // "BTBL"
+const uint32_t table_file_version = 1;
+
+struct TableFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size; // of the whole file
+    uint32_t cushionCount, pocketCount, rackCount, rackBallCount;
+    float minX, maxX, minZ, maxZ;
+    char name[32];
+};
+
+// A loaded table. Binary files are mapped read-only and the TableDef points
+// straight into the mapping, so loading one costs an open and an mmap; text
+// is compiled into the same layout in memory first. Hold it by pointer: the
+// TableDef points into the asset, so it can't be copied or moved.
+class TableAsset {
+public:
+    TableAsset() = default;
+    TableAsset(const TableAsset&) = delete;
+    TableAsset& operator=(const TableAsset&) = delete;
+    ~TableAsset();
+
+    // Text or binary, told apart by the magic
+    bool load(const std::string& path);
+    // Compile the text form, source names it in error messages
+    bool parse(const std::string& text, const std::string& source = "<text>");
+    void close();
+
+    bool isOpen() const { return def.name != nullptr; }
+    const TableDef& table() const { return def; }
+
+private:
+    TableDef def = {};
+    std::vector<uint32_t> image; // compiled text
+    void* mapped = nullptr;
+    size_t mappedSize = 0;
+
+    // Check the binary form at data and point def into it
+    bool view(const void* data, size_t size, const std::string& source);
+};
+
+bool writeTableBinary(const TableDef& table, const std::string& path);
+bool writeTableText(const TableDef& table, const std::string& path);
+
+#endif
@@ -0,0 +1,39 @@
+// Table assets (see table_def.h) between their text and binary forms:
+//   billiards_table <in> <out>       compile; out is text if it ends in .table
+//   billiards_table --standard <out> write the built-in table
+//   billiards_table <in>             print what's in a table
+#include <cstdio>
+#include <string>
+#include "table_def.h"
+
+static void describe(const TableDef& table) {
+    printf("%s: %.3f x %.3f, %d cushions, %d pockets\n", table.name, table.width(), table.height(),
+           table.cushionCount, table.pocketCount);
+    for(int i = 0;i < table.rackCount;i++) {
+        printf("  rack %s: %u balls\n", table.racks[i].name, table.racks[i].count);
+    }
+}
+
+int main(int argc, char** argv) {
+    std::string in = argc > 1 ? argv[1] : "", out = argc > 2 ? argv[2] : "";
+    if(argc < 2 || argc > 3 || (in == "--standard" && out.empty())) {
+        fprintf(stderr, "usage: %s <in> [<out>] | --standard <out>\n", argv[0]);
+        return 1;
+    }
+
+    TableAsset asset;
+    if(in != "--standard" && !asset.load(in)) return 1;
+    const TableDef& table = in == "--standard" ? standard_table : asset.table();
+
+    if(out.empty()) {
+        describe(table);
+        return 0;
+    }
+
+    bool text = out.size() > 6 && out.compare(out.size() - 6, 6, ".table") == 0;
+    if(!(text ? writeTableText(table, out) : writeTableBinary(table, out))) {
+        fprintf(stderr, "Can't write %s\n", out.c_str());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,128 @@
+#include "thread_pool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(int threads) {
+    if(threads <= 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    participants = threads;
+    ranges.reset(new Range[participants]);
+
+    for(int i = 1;i < participants;i++) {
+        this->threads.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for(std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+void ThreadPool::parallelFor(int n, int grain, const std::function<void(int, int, int)>& body) {
+    if(n <= 0) return;
+    grain = std::max(1, grain);
+
+    std::lock_guard<std::mutex> call(callLock);
+
+    if(participants == 1 || n <= grain) {
+        for(int begin = 0;begin < n;begin += grain) {
+            body(begin, std::min(n, begin + grain), 0);
+        }
+        return;
+    }
+
+    // Hand out one contiguous slice per participant
+    for(int i = 0;i < participants;i++) {
+        std::lock_guard<std::mutex> guard(ranges[i].lock);
+        ranges[i].begin = int(int64_t(n) * i / participants);
+        ranges[i].end = int(int64_t(n) * (i + 1) / participants);
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        job = &body;
+        this->grain = grain;
+        busy = participants - 1;
+        generation++;
+    }
+    wake.notify_all();
+
+    runParticipant(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return busy == 0; });
+    job = nullptr;
+}
+
+void ThreadPool::workerLoop(int id) {
+    uint64_t seen = 0;
+    while(true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if(stopping) return;
+            seen = generation;
+        }
+
+        runParticipant(id);
+
+        std::lock_guard<std::mutex> guard(mutex);
+        if(--busy == 0) {
+            done.notify_one();
+        }
+    }
+}
+
+void ThreadPool::runParticipant(int id) {
+    int begin, end;
+    while(true) {
+        if(popFront(id, begin, end) || (steal(id) && popFront(id, begin, end))) {
+            (*job)(begin, end, id);
+        }
+        else {
+            break;
+        }
+    }
+}
+
+bool ThreadPool::popFront(int id, int& begin, int& end) {
+    Range& own = ranges[id];
+    std::lock_guard<std::mutex> guard(own.lock);
+    if(own.begin >= own.end) return false;
+
+    begin = own.begin;
+    end = std::min(own.end, own.begin + grain);
+    own.begin = end;
+    return true;
+}
+
+bool ThreadPool::steal(int id) {
+    for(int offset = 1;offset < participants;offset++) {
+        Range& victim = ranges[(id + offset) % participants];
+
+        int begin, end;
+        {
+            std::lock_guard<std::mutex> guard(victim.lock);
+            int remaining = victim.end - victim.begin;
+            if(remaining <= 0) continue;
+
+            // Leave the victim the front half, it is already warming its cache
+            end = victim.end;
+            begin = victim.end - (remaining + 1) / 2;
+            victim.end = begin;
+        }
+
+        Range& own = ranges[id];
+        std::lock_guard<std::mutex> guard(own.lock);
+        own.begin = begin;
+        own.end = end;
+        return true;
+    }
+    return false;
+}
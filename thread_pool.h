@@ -0,0 +1,60 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads running range-splitting parallel loops.
+// Every participant starts with one contiguous slice of the index range and
+// eats it from the front, an idle participant steals the back half of
+// somebody else's slice. That keeps neighbouring items on the same core while
+// still balancing uneven work.
+class ThreadPool {
+public:
+    // threads = 0 uses every hardware thread. The calling thread takes part in
+    // parallelFor() too, so threads - 1 extra threads are started.
+    explicit ThreadPool(int threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Number of participants, including the calling thread
+    int size() const { return participants; }
+
+    // Call body(begin, end, worker) over [0, n) in chunks of at most grain
+    // items and return once every item is done. worker is in [0, size()).
+    // Calls from different threads are serialised.
+    void parallelFor(int n, int grain, const std::function<void(int, int, int)>& body);
+
+private:
+    struct alignas(64) Range {
+        std::mutex lock;
+        int begin = 0, end = 0;
+    };
+
+    void workerLoop(int id);
+    void runParticipant(int id);
+    bool popFront(int id, int& begin, int& end);
+    bool steal(int id);
+
+    int participants;
+    std::vector<std::thread> threads;
+    std::unique_ptr<Range[]> ranges;
+
+    std::mutex callLock; // one parallelFor() at a time
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    const std::function<void(int, int, int)>* job = nullptr;
+    int grain = 1;
+    uint64_t generation = 0;
+    int busy = 0;
+    bool stopping = false;
+};
+
+#endif
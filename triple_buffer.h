@@ -0,0 +1,43 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+
+// Lock-free handoff of the newest value from one writer thread to one reader
+// thread. The writer fills back() and publishes it, the reader takes whatever
+// was published last. Neither side ever waits: each owns one slot and the
+// third is swapped between them through a single atomic.
+template<class T>
+class TripleBuffer {
+public:
+    // Writer only: the slot to fill next. It holds a stale value, so every
+    // field has to be written before publish().
+    T& back() { return slots[backIndex]; }
+
+    // Writer only: hand back() over to the reader
+    void publish() {
+        int old = middle.exchange(backIndex | fresh_bit, std::memory_order_acq_rel);
+        backIndex = old & index_mask;
+    }
+
+    // Reader only: the newest published value. Stays valid and unchanged
+    // until the next call.
+    const T& latest() {
+        if(middle.load(std::memory_order_relaxed) & fresh_bit) {
+            int old = middle.exchange(frontIndex, std::memory_order_acq_rel);
+            frontIndex = old & index_mask;
+        }
+        return slots[frontIndex];
+    }
+
+private:
+    static const int index_mask = 3;
+    static const int fresh_bit = 4; // set while the middle slot is unread
+
+    T slots[3];
+    int backIndex = 0;  // writer's slot
+    int frontIndex = 1; // reader's slot
+    alignas(64) std::atomic<int> middle{2};
+};
+
+#endif